@@ -2,6 +2,7 @@
 import socket
 import struct
 import time
+import traj_bin
 
 s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
 s.connect(("localhost", 5555))
@@ -387,6 +388,91 @@ def handle_unset_railway():
     s.sendall(pack_int(robot_id))
     s.sendall(bunny_id_packer.pack(from_id))
 
+def handle_upload_bin():
+    robot_id = int(input("\trobot id : "))
+    fname = input("\tinput file (.utrj) : ")
+    shifting = int(input( "\tshifting   : "))
+    count, records = traj_bin.read_traj_bin(fname)
+    s.sendall(pack_int(13))
+    s.sendall(pack_int(robot_id))
+    s.sendall(pack_int(shifting))
+    s.sendall(bunny_id_packer.pack(count))
+    s.sendall(records)
+
+def handle_load_bin():
+    robot_id = int(input("\trobot id : "))
+    fname = input("\tfile on the server (.utrj) : ").encode()
+    shifting = int(input( "\tshifting   : "))
+    s.sendall(pack_int(14))
+    s.sendall(pack_int(robot_id))
+    s.sendall(pack_int(shifting))
+    s.sendall(bunny_id_packer.pack(len(fname)))
+    s.sendall(fname)
+    count = struct.Struct("i").unpack(s.recv(4,socket.MSG_WAITALL))[0]
+    print("\tLoaded points:",count)
+
+def handle_upload_csv():
+    robot_id = int(input("\trobot id : "))
+    fname = input("\tinput file (.csv) : ")
+    shifting = int(input( "\tshifting   : "))
+    data = open(fname, "rb").read()
+    s.sendall(pack_int(15))
+    s.sendall(pack_int(robot_id))
+    s.sendall(pack_int(shifting))
+    s.sendall(bunny_id_packer.pack(len(data)))
+    s.sendall(data)
+
+def handle_delta_csv():
+    robot_id = int(input("\trobot id : "))
+    fname = input("\treplanned traj (.csv) : ")
+    shifting = int(input( "\tshifting   : "))
+    data = open(fname, "rb").read()
+    s.sendall(pack_int(19))
+    s.sendall(pack_int(robot_id))
+    s.sendall(pack_int(shifting))
+    s.sendall(bunny_id_packer.pack(len(data)))
+    s.sendall(data)
+    count = struct.Struct("i").unpack(s.recv(4,socket.MSG_WAITALL))[0]
+    print("\tWritten entries:",count)
+
+def handle_clear_robot():
+    robot_id = int(input("\trobot id : "))
+    s.sendall(pack_int(20))
+    s.sendall(pack_int(robot_id))
+
+def handle_progress():
+    robot_id = int(input("\trobot id : "))
+    s.sendall(pack_int(21))
+    s.sendall(pack_int(robot_id))
+    actual, next_id, end_time, age = struct.Struct("4I").unpack(s.recv(16,socket.MSG_WAITALL))
+    print("\tActual bunny:",actual,"next bunny:",next_id,"end time:",end_time,"age (us):",age)
+
+def handle_speed_limits():
+    robot_class = int(input("\trobot class : "))
+    limits = [float(input("\tjoint "+str(j+1)+" limit (rad/s, 0: none) : ")) for j in range(6)]
+    s.sendall(pack_int(22))
+    s.sendall(pack_int(robot_class))
+    s.sendall(struct.Struct("6d").pack(*limits))
+    count = struct.Struct("i").unpack(s.recv(4,socket.MSG_WAITALL))[0]
+    print("\tWritten entries:",count)
+
+def handle_robot_class():
+    robot_id = int(input("\trobot id : "))
+    robot_class = int(input("\trobot class : "))
+    s.sendall(pack_int(23))
+    s.sendall(pack_int(robot_id))
+    s.sendall(pack_int(robot_class))
+
+def handle_compiled_weighting():
+    c_act =  float(input("\tweight of ACTUAL speed> "))
+    c_tar =  float(input("\tweight of TARGET speed> "))
+    c_diff = float(input("\tweight of DIFF   speed> "))
+    precision = int(input("\tprecision (bits, 4: like 8)> "))
+    s.sendall(pack_int(24))
+    s.sendall(struct.Struct("3dI").pack(c_act,c_tar,c_diff,precision))
+    count = struct.Struct("i").unpack(s.recv(4,socket.MSG_WAITALL))[0]
+    print("\tInstalled entries:",count)
+
 # ***** MAIN *****
 
 while True:
@@ -400,12 +486,23 @@ while True:
         "\n\t"+
         "7)  clear weight functions\n\t"+
         "8)  upload weight functions\n\t"+
+        "24) upload weight functions, compiled on the server (cp only)\n\t"+
         "\n\t"+
         "9)  get actual bunny id\n\t"+
         "10) set railway switch\n\t"+
         "11) unset railway switch\n\t"+
         "12) set actual bunny id\n\t"+
         "\n\t"+
+        "22) set the joint speed limits of a robot class\n\t"+
+        "23) set the class of a robot\n\t"+
+        "\n\t"+
+        "13) upload binary traj (cp only)\n\t"+
+        "14) load binary traj on server (cp only)\n\t"+
+        "15) upload csv traj, parsed on the server (cp only)\n\t"+
+        "19) replace traj with a replanned csv, changes only (cp only)\n\t"+
+        "20) clear the entries of one robot (cp only)\n\t"+
+        "21) get actual, next bunny id and end time (cp only)\n\t"+
+        "\n\t"+
         "-1) exit\n\t"+
         "-2) stop server\n\n")
     cmd = int(input("command number> "))
@@ -439,6 +536,24 @@ while True:
         handle_unset_railway()
     elif cmd==12:
         handle_set_actual_bunny_id()
+    elif cmd==13:
+        handle_upload_bin()
+    elif cmd==14:
+        handle_load_bin()
+    elif cmd==15:
+        handle_upload_csv()
+    elif cmd==19:
+        handle_delta_csv()
+    elif cmd==20:
+        handle_clear_robot()
+    elif cmd==21:
+        handle_progress()
+    elif cmd==22:
+        handle_speed_limits()
+    elif cmd==23:
+        handle_robot_class()
+    elif cmd==24:
+        handle_compiled_weighting()
     else:
         print("ERR: Invalid command number: "+str(cmd))
 
@@ -0,0 +1,978 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fixed_point.hpp"
+#include "pipe_map.hpp"
+#include "speed_limit.hpp"
+#include "function_table.hpp"
+#include "table_backend.hpp"
+#include "traj_csv.hpp"
+#include "traj_delta.hpp"
+#include "traj_upload.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+/*******************************************************************************
+ * Benchmark suite of the control plane table operations.
+ *
+ * One operation (op) is one egress (bunny_e) entry, like a record of
+ * run_tests; the op of joint 0 also writes the ingress (bunny) entry, which
+ * is shared by the joints of the point. In the point scenario an op is a
+ * whole trajectory point (the bunny and NUM_JOINTS bunny_e entries). Operations are grouped into batches of
+ * --bench-batch ops (0: the whole run is one batch), a batch ends with
+ * endBatch(true) and completeOperations().
+ ******************************************************************************/
+
+struct BenchConfig {
+  std::vector<std::string> scenarios;
+  uint32_t records = 10000; // ops per run
+  uint32_t repeat = 10;     // measured runs
+  uint32_t warmup = 2;      // runs before the measured ones
+  uint32_t batch = 0;       // ops per batch, 0: one batch per run
+  uint32_t robots = 4;      // robots of the mixed workload
+  std::string format = "text"; // text, json or csv
+  std::string output;          // file name, stdout if empty
+  std::string label;           // free text, e.g. SDE version and switch model
+  std::string backend;
+  std::string csv_file = "../trajs.csv";  // input of the csv scenario
+};
+
+inline uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct LatencySummary {
+  uint64_t count = 0;
+  double mean = 0;
+  uint64_t p50 = 0;
+  uint64_t p99 = 0;
+  uint64_t p999 = 0;
+  uint64_t max = 0;
+};
+
+class LatencyRecorder {
+ public:
+  void add(const uint64_t &ns) { samples_.push_back(ns); }
+
+  LatencySummary summary() {
+    LatencySummary s;
+    s.count = samples_.size();
+    if (samples_.empty()) {
+      return s;
+    }
+    std::sort(samples_.begin(), samples_.end());
+    double sum = 0;
+    for (auto v : samples_) {
+      sum += v;
+    }
+    s.mean = sum / samples_.size();
+    s.p50 = percentile(0.5);
+    s.p99 = percentile(0.99);
+    s.p999 = percentile(0.999);
+    s.max = samples_.back();
+    return s;
+  }
+
+ private:
+  // nearest-rank percentile of the sorted samples
+  uint64_t percentile(const double &p) const {
+    size_t rank = static_cast<size_t>(p * samples_.size() + 0.999999);
+    rank = std::max<size_t>(rank, 1);
+    return samples_[std::min(rank, samples_.size()) - 1];
+  }
+
+  std::vector<uint64_t> samples_;
+};
+
+struct BenchResult {
+  std::string scenario;
+  bf_status_t status = BF_SUCCESS;
+  uint64_t ops = 0;
+  uint64_t batches = 0;
+  uint64_t total_ns = 0;
+  uint64_t bytes = 0;  // parsed input, csv scenario only
+  LatencySummary op;
+  LatencySummary batch;
+};
+
+// Key of the k-th entry of a robot. The ids of a trajectory point are
+// consecutive, so the 6 joints of a bunny are written one after the other.
+inline bunny_key_t bench_key(const uint32_t &robot, const uint64_t &k) {
+  bunny_key_t key;
+  key.jointId = static_cast<joint_id_t>(k % NUM_JOINTS);
+  key.actual_bunny = static_cast<bunny_id_t>((k / NUM_JOINTS) % 65536);
+  key.robot_id = static_cast<robot_id_t>(robot + k / (NUM_JOINTS * 65536));
+  return key;
+}
+
+inline bunny_data_t bench_data(const uint64_t &k, const uint32_t &version) {
+  bunny_data_t data;
+  data.next_id = static_cast<bunny_id_t>(k / NUM_JOINTS + 1);
+  data.duration = 1000 + version;
+  return data;
+}
+
+inline bunny_target_t bench_target(const uint64_t &k, const uint32_t &version) {
+  bunny_target_t target;
+  target.tpos = k + version;
+  target.tspeed = version;
+  return target;
+}
+
+// The k-th point of a robot, same entries as bench_key/bench_data/bench_target
+inline trajectory_point_t bench_point(const uint32_t &robot, const uint64_t &k) {
+  auto key = bench_key(robot, k * NUM_JOINTS);
+  auto data = bench_data(k * NUM_JOINTS, 0);
+  trajectory_point_t point;
+  point.robot_id = key.robot_id;
+  point.bunny_id = key.actual_bunny;
+  point.next_id = data.next_id;
+  point.duration = data.duration;
+  for (int j = 0; j < NUM_JOINTS; j++) {
+    auto target = bench_target(k * NUM_JOINTS + j, 0);
+    point.positions[j] = target.tpos;
+    point.speeds[j] = target.tspeed;
+  }
+  return point;
+}
+
+class BenchRunner {
+ public:
+  BenchRunner(TableBackend *backend, const BenchConfig &config,
+              TrajUploader *uploader = nullptr)
+      : backend_(backend), uploader_(uploader), config_(config), measure_(false) {}
+
+  BenchResult run(const std::string &scenario) {
+    result_ = BenchResult();
+    result_.scenario = scenario;
+    op_latency_ = LatencyRecorder();
+    batch_latency_ = LatencyRecorder();
+
+    bf_status_t status = BF_INVALID_ARG;
+    if (scenario == "insert") {
+      status = insert();
+    } else if (scenario == "delete") {
+      status = remove();
+    } else if (scenario == "range_delete") {
+      status = bulkDelete(false);
+    } else if (scenario == "robot_clear") {
+      status = bulkDelete(true);
+    } else if (scenario == "modify") {
+      status = modify();
+    } else if (scenario == "point") {
+      status = point();
+    } else if (scenario == "pipeline") {
+      status = pipeline();
+    } else if (scenario == "delta") {
+      status = delta();
+    } else if (scenario == "churn") {
+      status = churn();
+    } else if (scenario == "mixed") {
+      status = mixed();
+    } else if (scenario == "readback") {
+      status = readback(false);
+    } else if (scenario == "readback_hw") {
+      status = readback(true);
+    } else if (scenario == "scan") {
+      status = scan(false);
+    } else if (scenario == "scan_hw") {
+      status = scan(true);
+    } else if (scenario == "progress") {
+      status = progress(false);
+    } else if (scenario == "progress_single") {
+      status = progress(true);
+    } else if (scenario == "speed_limit") {
+      status = speedLimit();
+    } else if (scenario == "functions") {
+      status = functions();
+    } else if (scenario == "csv") {
+      status = csv();
+    } else if (scenario == "fixed_point") {
+      status = fixedPoint();
+    } else {
+      std::cout<<"ERROR: unknown benchmark scenario: "<<scenario<<std::endl;
+    }
+
+    result_.status = status;
+    result_.op = op_latency_.summary();
+    result_.batch = batch_latency_.summary();
+    return result_;
+  }
+
+  static std::vector<std::string> allScenarios() {
+    return {"insert", "delete", "range_delete", "robot_clear", "modify", "point",
+            "pipeline", "delta", "churn", "mixed", "readback", "readback_hw", "scan",
+            "scan_hw", "progress", "progress_single", "speed_limit", "functions",
+            "fixed_point"};
+  }
+
+ private:
+  enum OpKind { ADD, MOD, DEL, GET_SW, GET_HW, POINT_ADD, POINT_DEL };
+
+  bf_status_t op(const OpKind &kind, const uint32_t &robot, const uint64_t &k,
+                 const uint32_t &version = 0) {
+    auto key = bench_key(robot, k);
+    bf_status_t status = BF_SUCCESS;
+    switch (kind) {
+      case ADD:
+      case MOD:
+        if (key.jointId == 0) {
+          status = backend_->iBunnyEntryAdd(key, bench_data(k, version), kind == ADD);
+        }
+        if (status == BF_SUCCESS) {
+          status = backend_->eBunnyEntryAdd(key, bench_target(k, version), kind == ADD);
+        }
+        break;
+      case DEL:
+        if (key.jointId == 0) {
+          status = backend_->iBunnyEntryDel(key);
+        }
+        if (status == BF_SUCCESS) {
+          status = backend_->eBunnyEntryDel(key);
+        }
+        break;
+      case GET_SW:
+      case GET_HW: {
+        bunny_data_t data;
+        bunny_target_t target;
+        if (key.jointId == 0) {
+          status = backend_->iBunnyEntryGet(key, kind == GET_HW, &data);
+        }
+        if (status == BF_SUCCESS) {
+          status = backend_->eBunnyEntryGet(key, kind == GET_HW, &target);
+        }
+        break;
+      }
+      case POINT_ADD:
+        status = backend_->bunnyPointAdd(bench_point(robot, k));
+        break;
+      case POINT_DEL: {
+        auto point = bench_point(robot, k);
+        status = backend_->bunnyPointDel(point.robot_id, point.bunny_id);
+        break;
+      }
+    }
+    return status;
+  }
+
+  // A unit of work of a run: an operation on the k-th entry of a robot.
+  struct Step {
+    OpKind kind;
+    uint32_t robot;
+    uint64_t k;
+  };
+
+  // Execute the steps in batches. Latencies are recorded in measured runs.
+  bf_status_t execute(const std::vector<Step> &steps, const uint32_t &version = 0) {
+    size_t batch = config_.batch == 0 ? steps.size() : config_.batch;
+    uint64_t run_start = now_ns();
+    for (size_t first = 0; first < steps.size(); first += batch) {
+      size_t last = std::min(steps.size(), first + batch);
+      uint64_t batch_start = now_ns();
+      auto status = backend_->beginBatch();
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      for (size_t i = first; i < last; i++) {
+        uint64_t start = now_ns();
+        status = op(steps[i].kind, steps[i].robot, steps[i].k, version);
+        if (status != BF_SUCCESS) {
+          backend_->endBatch(true);
+          return status;
+        }
+        if (measure_) {
+          op_latency_.add(now_ns() - start);
+        }
+      }
+      status = backend_->endBatch(true);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      backend_->completeOperations();
+      if (measure_) {
+        batch_latency_.add(now_ns() - batch_start);
+        result_.batches++;
+      }
+    }
+    if (measure_) {
+      result_.ops += steps.size();
+      result_.total_ns += now_ns() - run_start;
+    }
+    return BF_SUCCESS;
+  }
+
+  // Untimed helper run (set up and clean up of a scenario).
+  bf_status_t untimed(const std::vector<Step> &steps, const uint32_t &version = 0) {
+    bool measure = measure_;
+    measure_ = false;
+    auto status = execute(steps, version);
+    measure_ = measure;
+    return status;
+  }
+
+  std::vector<Step> steps(const OpKind &kind, const uint32_t &robot,
+                          const uint64_t &first, const uint64_t &count) {
+    std::vector<Step> result;
+    result.reserve(count);
+    for (uint64_t k = first; k < first + count; k++) {
+      result.push_back(Step{kind, robot, k});
+    }
+    return result;
+  }
+
+  // Runs warmup + repeat times, only the last repeat runs are measured.
+  template <typename F>
+  bf_status_t repeat(F run) {
+    for (uint32_t i = 0; i < config_.warmup + config_.repeat; i++) {
+      measure_ = i >= config_.warmup;
+      auto status = run(i);
+      if (status != BF_SUCCESS) {
+        measure_ = false;
+        return status;
+      }
+    }
+    measure_ = false;
+    return BF_SUCCESS;
+  }
+
+  bf_status_t insert() {
+    return repeat([this](uint32_t) {
+      auto status = execute(steps(ADD, 0, 0, config_.records));
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      return untimed(steps(DEL, 0, 0, config_.records));
+    });
+  }
+
+  bf_status_t remove() {
+    return repeat([this](uint32_t) {
+      auto status = untimed(steps(ADD, 0, 0, config_.records));
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      return execute(steps(DEL, 0, 0, config_.records));
+    });
+  }
+
+  bf_status_t modify() {
+    auto status = untimed(steps(ADD, 0, 0, config_.records));
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    status = repeat([this](uint32_t i) {
+      return execute(steps(MOD, 0, 0, config_.records), i + 1);
+    });
+    auto cleanup = untimed(steps(DEL, 0, 0, config_.records));
+    return status != BF_SUCCESS ? status : cleanup;
+  }
+
+  // Parse a csv of records points, made of the rows of csv_file repeated
+  // one after the other in time. Only the parser is measured, the points
+  // are not installed. One op is one point, one batch is the whole file.
+  bf_status_t csv() {
+    std::string csv;
+    if (!csvInput(&csv)) {
+      return BF_INVALID_ARG;
+    }
+    volatile uint64_t sink = 0;
+    return repeat([&](uint32_t) {
+      TrajCsvParser parser(0, 0);
+      uint64_t start = now_ns();
+      auto points = parser.parse(csv.data(), csv.size(), [&](const trajectory_point_t &point) {
+        sink = sink + point.positions[0];
+      });
+      uint64_t elapsed = now_ns() - start;
+      if (points < 0) {
+        return BF_INVALID_ARG;
+      }
+      if (measure_) {
+        batch_latency_.add(elapsed);
+        result_.batches++;
+        result_.ops += points;
+        result_.bytes += csv.size();
+        result_.total_ns += elapsed;
+      }
+      return BF_SUCCESS;
+    });
+  }
+
+  // Convert records positions and speeds with doubles_to_dec and compare
+  // every result bit for bit with double_to_dec. The values are random
+  // ones, in and beyond the range of the joints, and the edges of the 32 bit
+  // path of SSE2 (a scaled value of +-2^31) next to every other kind of
+  // value, so both lanes see them. One op is a value, one batch all of them.
+  // Fails on the first difference.
+  bf_status_t fixedPoint() {
+    auto values = fixedPointInput();
+    std::vector<dec_t> out(values.size());
+    return repeat([&](uint32_t) {
+      uint64_t start = now_ns();
+      doubles_to_dec(values.data(), out.data(), values.size());
+      uint64_t elapsed = now_ns() - start;
+      for (size_t i = 0; i < values.size(); i++) {
+        if (out[i] != double_to_dec(values[i])) {
+          std::cout<<"ERROR: doubles_to_dec("<<values[i]<<") = "<<out[i]<<", double_to_dec "
+                   <<double_to_dec(values[i])<<std::endl;
+          return BF_INVALID_ARG;
+        }
+      }
+      if (measure_) {
+        batch_latency_.add(elapsed);
+        result_.batches++;
+        result_.ops += values.size();
+        result_.total_ns += elapsed;
+      }
+      return BF_SUCCESS;
+    });
+  }
+
+  std::vector<double> fixedPointInput() {
+    const double edge = 2147483648.0 / DEC_SCALE;
+    std::vector<double> edges;
+    for (double x : {edge, -edge}) {
+      double below = x;
+      double above = x;
+      for (int k = 0; k < 4; k++) {
+        below = std::nextafter(below, 0.0);
+        above = std::nextafter(above, 2 * x);
+        edges.push_back(below);
+        edges.push_back(above);
+      }
+      edges.push_back(x);
+      edges.push_back(x * (1 - 1e-9));
+    }
+    for (double x : {0.0, -0.0, 1e-7, -1e-7, 0.5, -0.5, M_PI, -M_PI, 1e6, -1e6}) {
+      edges.push_back(x);
+    }
+    std::mt19937_64 random(1);
+    std::uniform_real_distribution<double> joint(-2 * M_PI, 2 * M_PI);
+    std::uniform_real_distribution<double> wide(-4 * edge, 4 * edge);
+    std::vector<double> values;
+    // every edge value at an even and an odd index, next to each other one
+    for (size_t i = 0; i < edges.size(); i++) {
+      for (size_t j = 0; j < edges.size(); j++) {
+        values.push_back(edges[i]);
+        values.push_back(edges[j]);
+      }
+    }
+    values.push_back(edges[0]);
+    while (values.size() < config_.records) {
+      values.push_back(values.size() % 3 == 0 ? wide(random) : joint(random));
+    }
+    return values;
+  }
+
+  bool csvInput(std::string *csv) {
+    std::ifstream file(config_.csv_file);
+    std::string header, line;
+    std::vector<std::pair<double, std::string>> rows;
+    if (!std::getline(file, header)) {
+      std::cout<<"ERROR: cannot read "<<config_.csv_file<<std::endl;
+      return false;
+    }
+    while (std::getline(file, line)) {
+      auto comma = line.find(',');
+      if (comma != std::string::npos) {
+        rows.emplace_back(atof(line.substr(0, comma).c_str()), line.substr(comma));
+      }
+    }
+    if (rows.size() < 2) {
+      std::cout<<"ERROR: "<<config_.csv_file<<" has less than 2 points"<<std::endl;
+      return false;
+    }
+    // the copies follow each other with the step of the first two points
+    double period = rows.back().first - rows.front().first + rows[1].first - rows[0].first;
+    *csv = header + "\n";
+    char time[32];
+    for (uint64_t i = 0; i < config_.records; i++) {
+      auto &row = rows[i % rows.size()];
+      snprintf(time, sizeof(time), "%.6f", row.first + period * (i / rows.size()));
+      *csv += time;
+      *csv += row.second;
+      *csv += "\n";
+    }
+    return true;
+  }
+
+  // Insert whole trajectory points, records / NUM_JOINTS points per run.
+  bf_status_t point() {
+    uint64_t points = std::max<uint64_t>(config_.records / NUM_JOINTS, 1);
+    return repeat([&](uint32_t) {
+      auto status = execute(steps(POINT_ADD, 0, 0, points));
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      return untimed(steps(POINT_DEL, 0, 0, points));
+    });
+  }
+
+  // The points of point are deleted with one bunnyRangeDel (range_delete)
+  // or bunnyRobotClear (robot_clear) call in one batch. robot_clear reads
+  // the keys of the robot before the batch, the read is timed with it. One
+  // op is a point, at most 65536 of them (the ids of one robot).
+  bf_status_t bulkDelete(const bool &whole_robot) {
+    uint64_t points = std::min<uint64_t>(std::max<uint64_t>(config_.records / NUM_JOINTS, 1), 65536);
+    return repeat([&](uint32_t) -> bf_status_t {
+      auto status = untimed(steps(POINT_ADD, 0, 0, points));
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      uint64_t start = now_ns();
+      std::vector<bunny_id_t> bunny_ids, from_ids;
+      if (whole_robot) {
+        status = backend_->bunnyRobotKeys(0, &bunny_ids, &from_ids);
+        if (status != BF_SUCCESS) {
+          return status;
+        }
+      }
+      status = backend_->beginBatch();
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      if (whole_robot) {
+        status = backend_->bunnyRobotClear(0, bunny_ids, from_ids);
+      } else {
+        status = backend_->bunnyRangeDel(0, 0, static_cast<bunny_id_t>(points - 1));
+      }
+      auto end_status = backend_->endBatch(true);
+      backend_->completeOperations();
+      uint64_t elapsed = now_ns() - start;
+      if (status != BF_SUCCESS || end_status != BF_SUCCESS) {
+        return status != BF_SUCCESS ? status : end_status;
+      }
+      if (measure_) {
+        batch_latency_.add(elapsed);
+        result_.batches++;
+        result_.ops += points;
+        result_.total_ns += elapsed;
+      }
+      return BF_SUCCESS;
+    });
+  }
+
+  // Same points as point, through the pipelined uploader. One batch is the
+  // whole trajectory, from submit until every batch of it is committed.
+  bf_status_t pipeline() {
+    if (uploader_ == nullptr) {
+      std::cout<<"ERROR: no uploader for the pipeline benchmark"<<std::endl;
+      return BF_INVALID_ARG;
+    }
+    uint64_t points = std::max<uint64_t>(config_.records / NUM_JOINTS, 1);
+    return repeat([&](uint32_t) {
+      uint64_t start = now_ns();
+      auto status = uploader_->submit([&](const TrajUploader::Emit &emit) -> int64_t {
+        for (uint64_t k = 0; k < points; k++) {
+          emit(bench_point(0, k));
+        }
+        return points;
+      }).get();
+      uint64_t elapsed = now_ns() - start;
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      if (measure_) {
+        batch_latency_.add(elapsed);
+        result_.batches++;
+        result_.ops += points;
+        result_.total_ns += elapsed;
+      }
+      return untimed(steps(POINT_DEL, 0, 0, points));
+    });
+  }
+
+  // Replan: the trajectory of point is installed, every run replaces its
+  // last 10% with new values through DeltaUploader. One op is a point of
+  // the trajectory, one batch is the replan.
+  bf_status_t delta() {
+    uint64_t points = std::max<uint64_t>(config_.records / NUM_JOINTS, 1);
+    auto status = untimed(steps(POINT_ADD, 0, 0, points));
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    std::vector<trajectory_point_t> trajectory;
+    for (uint64_t k = 0; k < points; k++) {
+      trajectory.push_back(bench_point(0, k));
+    }
+    DeltaUploader uploader(backend_);
+    status = repeat([&](uint32_t run) {
+      for (uint64_t k = points - std::max<uint64_t>(points / 10, 1); k < points; k++) {
+        trajectory[k].duration = bench_data(k * NUM_JOINTS, run + 1).duration;
+        trajectory[k].positions[0] = bench_target(k * NUM_JOINTS, run + 1).tpos;
+      }
+      DeltaStats stats;
+      uint64_t start = now_ns();
+      auto status = uploader.upload(trajectory, &stats);
+      uint64_t elapsed = now_ns() - start;
+      if (measure_) {
+        batch_latency_.add(elapsed);
+        result_.batches++;
+        result_.ops += points;
+        result_.total_ns += elapsed;
+      }
+      return status;
+    });
+    auto cleanup = untimed(steps(POINT_DEL, 0, 0, points));
+    return status != BF_SUCCESS ? status : cleanup;
+  }
+
+  // Sliding window of run_test_v2: the window holds records entries, every
+  // run removes the oldest records/10 entries and adds as many new ones.
+  bf_status_t churn() {
+    uint64_t window = config_.records;
+    uint64_t step = std::max<uint64_t>(window / 10, 1);
+    auto status = untimed(steps(ADD, 0, 0, window));
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    uint64_t oldest = 0;
+    status = repeat([&](uint32_t) {
+      std::vector<Step> run;
+      run.reserve(2 * step);
+      for (uint64_t i = 0; i < step; i++) {
+        run.push_back(Step{DEL, 0, oldest + i});
+        run.push_back(Step{ADD, 0, oldest + window + i});
+      }
+      oldest += step;
+      return execute(run);
+    });
+    auto cleanup = untimed(steps(DEL, 0, oldest, window));
+    return status != BF_SUCCESS ? status : cleanup;
+  }
+
+  // Several robots upload and remove their trajectories at the same time:
+  // their batches are interleaved round-robin.
+  bf_status_t mixed() {
+    uint32_t robots = std::max<uint32_t>(config_.robots, 1);
+    uint64_t per_robot = std::max<uint64_t>(config_.records / robots, 1);
+    uint64_t batch = config_.batch == 0 ? per_robot : config_.batch;
+    auto interleave = [&](const OpKind &kind) {
+      std::vector<Step> run;
+      run.reserve(per_robot * robots);
+      for (uint64_t first = 0; first < per_robot; first += batch) {
+        for (uint32_t r = 0; r < robots; r++) {
+          for (uint64_t k = first; k < std::min(per_robot, first + batch); k++) {
+            run.push_back(Step{kind, r, k});
+          }
+        }
+      }
+      return run;
+    };
+    return repeat([&](uint32_t) {
+      auto status = execute(interleave(ADD));
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      return execute(interleave(DEL));
+    });
+  }
+
+  bf_status_t readback(const bool &from_hw) {
+    auto status = untimed(steps(ADD, 0, 0, config_.records));
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    status = repeat([&](uint32_t) {
+      return execute(steps(from_hw ? GET_HW : GET_SW, 0, 0, config_.records));
+    });
+    auto cleanup = untimed(steps(DEL, 0, 0, config_.records));
+    return status != BF_SUCCESS ? status : cleanup;
+  }
+
+  // Same entries as readback, read with the table scans in chunks of
+  // --bench-batch entries (0: TABLE_SCAN_CHUNK). One batch is a scan of
+  // both tables.
+  bf_status_t scan(const bool &from_hw) {
+    auto status = untimed(steps(ADD, 0, 0, config_.records));
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    uint32_t chunk = config_.batch == 0 ? TABLE_SCAN_CHUNK : config_.batch;
+    status = repeat([&](uint32_t) -> bf_status_t {
+      uint64_t egress = 0;
+      uint64_t start = now_ns();
+      auto status = backend_->iBunnyScan(from_hw, ALL_PIPES, chunk, [](const bunny_entry_t &) {
+        return true;
+      });
+      if (status == BF_SUCCESS) {
+        status = backend_->eBunnyScan(from_hw, ALL_PIPES, chunk, [&](const bunny_e_entry_t &) {
+          egress++;
+          return true;
+        });
+      }
+      uint64_t elapsed = now_ns() - start;
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      if (measure_) {
+        batch_latency_.add(elapsed);
+        result_.batches++;
+        result_.ops += egress;
+        result_.total_ns += elapsed;
+      }
+      return BF_SUCCESS;
+    });
+    auto cleanup = untimed(steps(DEL, 0, 0, config_.records));
+    return status != BF_SUCCESS ? status : cleanup;
+  }
+
+  // The progress registers of every robot: one batch is a read of all
+  // MAX_ROBOTS robots, with progressRead or (single) one actualBunnyGet per
+  // robot, an op is a robot. A run is --bench-records / MAX_ROBOTS reads.
+  bf_status_t progress(const bool &single) {
+    uint64_t polls = std::max<uint64_t>(config_.records / MAX_ROBOTS, 1);
+    std::vector<robot_progress_t> all(MAX_ROBOTS);
+    return repeat([&](uint32_t) -> bf_status_t {
+      for (uint64_t i = 0; i < polls; i++) {
+        uint64_t start = now_ns();
+        bf_status_t status = BF_SUCCESS;
+        if (single) {
+          for (uint32_t r = 0; status == BF_SUCCESS && r < MAX_ROBOTS; r++) {
+            status = backend_->actualBunnyGet(static_cast<robot_id_t>(r),
+                                              &all[r].actual_bunny);
+          }
+        } else {
+          status = backend_->progressRead(all.data());
+        }
+        uint64_t elapsed = now_ns() - start;
+        if (status != BF_SUCCESS) {
+          return status;
+        }
+        if (measure_) {
+          batch_latency_.add(elapsed);
+          result_.batches++;
+          result_.ops += MAX_ROBOTS;
+          result_.total_ns += elapsed;
+        }
+      }
+      return BF_SUCCESS;
+    });
+  }
+
+  // Replace the joint speed limits of the robot classes in turn, alternating
+  // between two limits. An op is a written speed_limit entry, a batch is the
+  // transaction of one class. The classes are left without limits.
+  bf_status_t speedLimit() {
+    SpeedLimits limits;
+    uint64_t updates = std::max<uint64_t>(config_.records / 500, 1);
+    // counted over the runs, so every update of a class changes its limit,
+    // starting with one that differs from the installed default
+    uint64_t update = 0;
+    auto status = repeat([&](uint32_t) -> bf_status_t {
+      for (uint64_t i = 0; i < updates; i++, update++) {
+        auto robot_class = static_cast<robot_class_t>(update % NUM_ROBOT_CLASSES);
+        double values[NUM_JOINTS];
+        std::fill(values, values + NUM_JOINTS,
+                  (update / NUM_ROBOT_CLASSES) % 2 == 0 ? 3.0 : DEFAULT_SPEED_LIMIT);
+        SpeedLimitStats stats;
+        uint64_t start = now_ns();
+        auto status = limits.set(backend_, robot_class, values, &stats);
+        uint64_t elapsed = now_ns() - start;
+        if (status != BF_SUCCESS) {
+          return status;
+        }
+        if (measure_) {
+          batch_latency_.add(elapsed);
+          result_.batches++;
+          result_.ops += stats.adds + stats.mods + stats.dels;
+          result_.total_ns += elapsed;
+        }
+      }
+      return BF_SUCCESS;
+    });
+    double none[NUM_JOINTS] = {};
+    for (int robot_class = 0; status == BF_SUCCESS && robot_class < NUM_ROBOT_CLASSES;
+         robot_class++) {
+      status = limits.set(backend_, robot_class, none);
+    }
+    return status;
+  }
+
+  // Swap the weighting functions, alternating between two sets of weights.
+  // An op is a written function entry, a batch is a whole swap. The tables
+  // are left empty.
+  bf_status_t functions() {
+    FunctionTables tables;
+    const double weights[2][NUM_FUNCTIONS] = {{1.0, 0.5, 0.25}, {0.75, 1.5, 0.5}};
+    uint64_t updates = std::max<uint64_t>(config_.records / 5000, 1);
+    auto status = repeat([&](uint32_t) -> bf_status_t {
+      for (uint64_t i = 0; i < updates; i++) {
+        FunctionStats stats;
+        uint64_t start = now_ns();
+        auto status = tables.set(backend_, weights[i % 2], FUNCTION_DEFAULT_PRECISION, &stats);
+        uint64_t elapsed = now_ns() - start;
+        if (status != BF_SUCCESS) {
+          return status;
+        }
+        if (measure_) {
+          batch_latency_.add(elapsed);
+          result_.batches++;
+          result_.ops += stats.adds + stats.dels;
+          result_.total_ns += elapsed;
+        }
+      }
+      return BF_SUCCESS;
+    });
+    if (status == BF_SUCCESS) {
+      status = tables.clear(backend_);
+    }
+    return status;
+  }
+
+  TableBackend *backend_;
+  TrajUploader *uploader_;
+  BenchConfig config_;
+  bool measure_;
+  BenchResult result_;
+  LatencyRecorder op_latency_;
+  LatencyRecorder batch_latency_;
+};
+
+inline std::string bench_json_escape(const std::string &s) {
+  std::string out;
+  for (auto c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    }
+    out += c;
+  }
+  return out;
+}
+
+inline void bench_write_text(std::ostream &out, const BenchConfig &config,
+                             const std::vector<BenchResult> &results) {
+  out<<"# backend "<<config.backend<<" records "<<config.records
+     <<" repeat "<<config.repeat<<" warmup "<<config.warmup
+     <<" batch "<<config.batch<<" "<<config.label<<std::endl;
+  out<<"# scenario ops batches ops/s | op p50 p99 p999 max (ns) | batch p50 p99 p999 max (ns)"<<std::endl;
+  for (auto &r : results) {
+    if (r.status != BF_SUCCESS) {
+      out<<r.scenario<<" FAILED status "<<r.status<<std::endl;
+      continue;
+    }
+    double rate = r.total_ns > 0 ? r.ops * 1e9 / r.total_ns : 0;
+    out<<r.scenario<<" "<<r.ops<<" "<<r.batches<<" "<<static_cast<uint64_t>(rate)
+       <<" | "<<r.op.p50<<" "<<r.op.p99<<" "<<r.op.p999<<" "<<r.op.max
+       <<" | "<<r.batch.p50<<" "<<r.batch.p99<<" "<<r.batch.p999<<" "<<r.batch.max;
+    if (r.bytes > 0 && r.total_ns > 0) {
+      out<<" | "<<r.bytes * 1e3 / r.total_ns<<" MB/s";
+    }
+    out<<std::endl;
+  }
+}
+
+inline void bench_write_summary_json(std::ostream &out, const LatencySummary &s) {
+  out<<"{\"count\": "<<s.count<<", \"mean\": "<<s.mean<<", \"p50\": "<<s.p50
+     <<", \"p99\": "<<s.p99<<", \"p999\": "<<s.p999<<", \"max\": "<<s.max<<"}";
+}
+
+inline void bench_write_json(std::ostream &out, const BenchConfig &config,
+                             const std::vector<BenchResult> &results) {
+  out<<"{\n";
+  out<<"  \"label\": \""<<bench_json_escape(config.label)<<"\",\n";
+  out<<"  \"backend\": \""<<bench_json_escape(config.backend)<<"\",\n";
+  out<<"  \"config\": {\"records\": "<<config.records<<", \"repeat\": "<<config.repeat
+     <<", \"warmup\": "<<config.warmup<<", \"batch\": "<<config.batch
+     <<", \"robots\": "<<config.robots<<"},\n";
+  out<<"  \"unit\": \"ns\",\n";
+  out<<"  \"results\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    auto &r = results[i];
+    out<<(i == 0 ? "\n" : ",\n");
+    out<<"    {\"scenario\": \""<<r.scenario<<"\", \"status\": "<<r.status
+       <<", \"ops\": "<<r.ops<<", \"batches\": "<<r.batches
+       <<", \"total\": "<<r.total_ns<<", \"bytes\": "<<r.bytes<<", \"op\": ";
+    bench_write_summary_json(out, r.op);
+    out<<", \"batch\": ";
+    bench_write_summary_json(out, r.batch);
+    out<<"}";
+  }
+  out<<"\n  ]\n}\n";
+}
+
+inline void bench_write_csv(std::ostream &out, const BenchConfig &config,
+                            const std::vector<BenchResult> &results) {
+  out<<"label,backend,scenario,status,records,batch,ops,batches,total_ns,"
+       "op_mean,op_p50,op_p99,op_p999,op_max,"
+       "batch_mean,batch_p50,batch_p99,batch_p999,batch_max,bytes"<<std::endl;
+  for (auto &r : results) {
+    out<<config.label<<","<<config.backend<<","<<r.scenario<<","<<r.status<<","
+       <<config.records<<","<<config.batch<<","<<r.ops<<","<<r.batches<<","
+       <<r.total_ns<<","
+       <<r.op.mean<<","<<r.op.p50<<","<<r.op.p99<<","<<r.op.p999<<","<<r.op.max<<","
+       <<r.batch.mean<<","<<r.batch.p50<<","<<r.batch.p99<<","<<r.batch.p999<<","<<r.batch.max<<","
+       <<r.bytes<<std::endl;
+  }
+}
+
+// Run the configured scenarios and write the report. Returns false if a
+// scenario failed. The pipeline scenario needs an uploader.
+inline bool run_benchmarks(TableBackend *backend, const BenchConfig &config,
+                           TrajUploader *uploader = nullptr) {
+  auto scenarios = config.scenarios;
+  if (scenarios.empty() ||
+      std::find(scenarios.begin(), scenarios.end(), "all") != scenarios.end()) {
+    scenarios = BenchRunner::allScenarios();
+  }
+
+  BenchRunner runner(backend, config, uploader);
+  std::vector<BenchResult> results;
+  bool ok = true;
+  for (auto &scenario : scenarios) {
+    std::cerr<<"INFO: running benchmark "<<scenario<<std::endl;
+    results.push_back(runner.run(scenario));
+    ok = ok && results.back().status == BF_SUCCESS;
+  }
+
+  std::ofstream file;
+  if (!config.output.empty()) {
+    file.open(config.output);
+    if (!file) {
+      std::cout<<"ERROR: cannot open "<<config.output<<std::endl;
+      return false;
+    }
+  }
+  std::ostream &out = config.output.empty() ? std::cout : file;
+
+  if (config.format == "json") {
+    bench_write_json(out, config, results);
+  } else if (config.format == "csv") {
+    bench_write_csv(out, config, results);
+  } else {
+    bench_write_text(out, config, results);
+  }
+  return ok;
+}
+
+// Split a comma separated list of scenario names.
+inline std::vector<std::string> bench_split(const std::string &list) {
+  std::vector<std::string> result;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      result.push_back(item);
+    }
+  }
+  return result;
+}
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
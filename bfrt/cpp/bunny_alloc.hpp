@@ -0,0 +1,91 @@
+#ifndef BUNNY_ALLOC_HPP
+#define BUNNY_ALLOC_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "cp_types.hpp"
+#include "pipe_map.hpp"
+
+// bunny_id_t is bit<16> in ur.p4, next_id of the last id is 0
+#define BUNNY_ID_SPACE (1u << 16)
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Points of the bunny table reserved by the robots. A robot holds its quota
+// on each of its ingress pipes (every pipe without a pipe map), so the
+// quotas of the robots sharing a pipe never add up to more than its table.
+// bunny_e has NUM_JOINTS entries per point and is sized to match.
+class BunnyQuotas {
+ public:
+  explicit BunnyQuotas(const uint32_t &points_per_pipe = BUNNY_POINT_TABLE_SIZE)
+      : points_per_pipe_(points_per_pipe), pipes_(nullptr), quotas_(MAX_ROBOTS, 0) {
+    std::fill(used_, used_ + MAX_PIPES, 0);
+  }
+
+  // The pipes of the robots, before the first reserve. Without a map every
+  // robot is in every pipe.
+  void setPipes(const PipeMap *pipes) { pipes_ = pipes; }
+
+  uint32_t quota(const robot_id_t &robot_id) const {
+    return robot_id < MAX_ROBOTS ? quotas_[robot_id] : 0;
+  }
+
+  // The largest quota the robot could have, its own one included
+  uint32_t available(const robot_id_t &robot_id) const {
+    if (robot_id >= MAX_ROBOTS) {
+      return 0;
+    }
+    uint32_t free = points_per_pipe_;
+    forPipes(robot_id, [&](const uint32_t &pipe) {
+      free = std::min(free, points_per_pipe_ - used_[pipe] + quotas_[robot_id]);
+    });
+    return free;
+  }
+
+  // Replace the quota of the robot. Returns false (and keeps the old one)
+  // if one of its pipes has no room for it.
+  bool reserve(const robot_id_t &robot_id, const uint32_t &points) {
+    if (robot_id >= MAX_ROBOTS || points > available(robot_id)) {
+      return false;
+    }
+    forPipes(robot_id, [&](const uint32_t &pipe) {
+      used_[pipe] = used_[pipe] - quotas_[robot_id] + points;
+    });
+    quotas_[robot_id] = points;
+    return true;
+  }
+
+  void release(const robot_id_t &robot_id) { reserve(robot_id, 0); }
+
+ private:
+  template <typename F>
+  void forPipes(const robot_id_t &robot_id, F f) const {
+    if (pipes_ == nullptr) {
+      f(0);
+      return;
+    }
+    for (auto pipe : pipes_->ingressPipes(robot_id)) {
+      if (pipe == ALL_PIPES) {
+        for (uint32_t p = 0; p < pipes_->numPipes(); p++) {
+          f(p);
+        }
+      } else {
+        f(pipe);
+      }
+    }
+  }
+
+  uint32_t points_per_pipe_;
+  const PipeMap *pipes_;
+  std::vector<uint32_t> quotas_;
+  uint32_t used_[MAX_PIPES];
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
@@ -1,14 +1,34 @@
+#ifndef CP_NO_SDE
 #include <bf_rt/bf_rt_info.hpp>
 #include <bf_rt/bf_rt_init.hpp>
 #include <bf_rt/bf_rt_common.h>
 #include <bf_rt/bf_rt_table_key.hpp>
 #include <bf_rt/bf_rt_table_data.hpp>
 #include <bf_rt/bf_rt_table.hpp>
+#include <bf_rt/bf_rt_learn.hpp>
+#endif
 #include <getopt.h>
+#include <algorithm>
 #include <iostream>
-//#include <chrono>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <chrono>
 #include <sys/time.h>
-
+#include <cassert>
+#include <cmath>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#ifndef CP_NO_SDE
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -16,6 +36,28 @@ extern "C" {
 #ifdef __cplusplus
 }
 #endif
+#endif
+
+#include "cp_types.hpp"
+#include "fixed_point.hpp"
+#include "table_backend.hpp"
+#include "pipe_map.hpp"
+#include "mem_backend.hpp"
+#include "bench.hpp"
+#include "replay.hpp"
+#include "udp_load.hpp"
+#include "writer_pool.hpp"
+#include "traj_file.hpp"
+#include "traj_csv.hpp"
+#include "traj_ring.hpp"
+#include "traj_upload.hpp"
+#include "traj_delta.hpp"
+#include "traj_simplify.hpp"
+#include "shadow_store.hpp"
+#include "progress_poller.hpp"
+#include "progress_stream.hpp"
+#include "speed_limit.hpp"
+#include "function_table.hpp"
 
 /***********************************************************************************
  * This sample cpp application code is based on the P4 program
@@ -26,38 +68,28 @@ extern "C" {
  *fields.
  **********************************************************************************/
 
-#define robot_id_t uint8_t
-#define bunny_id_t uint16_t
-#define joint_id_t uint8_t
-#define p4_time_t uint32_t
-#define dec_t uint64_t
+#define SERVER_PORT 5555
 
 namespace bfrt {
 namespace examples {
 namespace tna_exact_match {
 
-struct bunny_key_t
-{
-    robot_id_t robot_id;
-    bunny_id_t actual_bunny;
-    joint_id_t jointId;
-};
-
-struct bunny_data_t
-{
-    bunny_id_t next_id;
-    p4_time_t duration;
-    /*action set_target(BUNNY_ID_T next_id,
-                      TIME_T duration){...} */
-};
-
-
-struct bunny_target_t
+// Layout of the "add bunny" command (cmd 1) sent by client.py and setup.py.
+// Python packs it as "iiiQ dddddd dddddd" with native alignment. The legacy
+// reset/append mode of proxy.py packs "iiQ ..." without the robot id and
+// does not match this layout.
+struct bunny_add_cmd_t
 {
-    dec_t tpos;
-    dec_t tspeed;
+    int32_t robot_id;
+    int32_t bunny_id;
+    int32_t next_id;
+    uint64_t duration; // ms
+    double positions[NUM_JOINTS];
+    double speeds[NUM_JOINTS];
 };
+static_assert(sizeof(bunny_add_cmd_t) == 120, "bunny add command must be 120 bytes");
 
+#ifndef CP_NO_SDE
 
 // Structure definition to represent the key of the ipRoute table
 struct IpRouteKey {
@@ -98,15 +130,21 @@ const bfrt::BfRtInfo *bfrtInfo = nullptr;
     const bfrt::BfRtTable *ipRouteTable = nullptr;
 const bfrt::BfRtTable *iBunnyTable = nullptr;
 const bfrt::BfRtTable *eBunnyTable = nullptr;
+const bfrt::BfRtTable *railwayTable = nullptr;
+const bfrt::BfRtTable *speedLimitTable = nullptr;
+const bfrt::BfRtTable *robotClassTable = nullptr;
+// by FUNCTION_*
+const bfrt::BfRtTable *functionTables[NUM_FUNCTIONS] = {nullptr, nullptr, nullptr};
+const bfrt::BfRtTable *functionVersionTable = nullptr;
+const bfrt::BfRtTable *actualBunnyRegister = nullptr;
+const bfrt::BfRtTable *nextBunnyRegister = nullptr;
+const bfrt::BfRtTable *endTimeRegister = nullptr;
+const bfrt::BfRtLearn *progressDigest = nullptr;
 std::shared_ptr<bfrt::BfRtSession> session;
 
 std::unique_ptr<bfrt::BfRtTableKey> bfrtTableKey;
 std::unique_ptr<bfrt::BfRtTableData> bfrtTableData;
 
-std::unique_ptr<bfrt::BfRtTableKey> iTableKey;
-std::unique_ptr<bfrt::BfRtTableData> iTableData;
-std::unique_ptr<bfrt::BfRtTableKey> eTableKey;
-std::unique_ptr<bfrt::BfRtTableData> eTableData;
 
 
 // Key field ids
@@ -114,23 +152,55 @@ std::unique_ptr<bfrt::BfRtTableData> eTableData;
     bf_rt_id_t ipRoute_vrf_field_id = 0;
 bf_rt_id_t i_robot_id_field = 0;
 bf_rt_id_t i_actual_bunny_field = 0;
-bf_rt_id_t i_joint_id_field = 0;
 
 bf_rt_id_t e_robot_id_field = 0;
 bf_rt_id_t e_actual_bunny_field = 0;
 bf_rt_id_t e_joint_id_field = 0;
 
+bf_rt_id_t r_robot_id_field = 0;
+bf_rt_id_t r_actual_bunny_field = 0;
+bf_rt_id_t s_robot_class_field = 0;
+bf_rt_id_t s_joint_id_field = 0;
+bf_rt_id_t s_speed_field = 0;
+bf_rt_id_t s_priority_field = 0;
+bf_rt_id_t c_robot_id_field = 0;
+bf_rt_id_t f_version_field[NUM_FUNCTIONS] = {0, 0, 0};
+bf_rt_id_t f_value_field[NUM_FUNCTIONS] = {0, 0, 0};
+bf_rt_id_t f_priority_field[NUM_FUNCTIONS] = {0, 0, 0};
+bf_rt_id_t reg_index_field = 0;
+bf_rt_id_t next_reg_index_field = 0;
+bf_rt_id_t end_reg_index_field = 0;
+
 // Action Ids
     bf_rt_id_t ipRoute_route_action_id = 0;
     bf_rt_id_t ipRoute_nat_action_id = 0;
 bf_rt_id_t ibunny_set_target_id = 0;
 bf_rt_id_t ebunny_set_target_id = 0;
+bf_rt_id_t railway_change_next_bunny_id = 0;
+bf_rt_id_t speed_limit_override_speed_id = 0;
+bf_rt_id_t robot_class_set_robot_class_id = 0;
+bf_rt_id_t function_update_id[NUM_FUNCTIONS] = {0, 0, 0};
+bf_rt_id_t function_version_set_id = 0;
 
 // Data field Ids 
 bf_rt_id_t iBunnyTable_next_id = 0;
 bf_rt_id_t iBunnyTable_duration = 0;
 bf_rt_id_t eBunnyTable_tpos = 0;
 bf_rt_id_t eBunnyTable_tspeed = 0;
+bf_rt_id_t railwayTable_bunny_id = 0;
+bf_rt_id_t speedLimitTable_limit = 0;
+bf_rt_id_t robotClassTable_robot_class = 0;
+bf_rt_id_t functionTable_d[NUM_FUNCTIONS] = {0, 0, 0};
+bf_rt_id_t functionVersionTable_version = 0;
+bf_rt_id_t actualBunnyRegister_f1 = 0;
+bf_rt_id_t nextBunnyRegister_f1 = 0;
+bf_rt_id_t endTimeRegister_f1 = 0;
+
+// Progress digest field ids
+bf_rt_id_t digest_robot_id_field = 0;
+bf_rt_id_t digest_actual_bunny_field = 0;
+bf_rt_id_t digest_next_bunny_field = 0;
+bf_rt_id_t digest_end_time_field = 0;
 
 
 
@@ -144,7 +214,6 @@ bf_rt_id_t eBunnyTable_tspeed = 0;
     bf_rt_id_t ipRoute_nat_action_ip_dst_field_id = 0;
     bf_rt_id_t ipRoute_nat_action_port_field_id = 0;
 
-#define ALL_PIPES 0xffff
 bf_rt_target_t dev_tgt;
 }  // anonymous namespace
 
@@ -181,6 +250,40 @@ void tableSetUp() {
   bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchEgress.bunny_e", &eBunnyTable);
   assert(bf_status == BF_SUCCESS);
 
+  bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchIngress.railway_switch", &railwayTable);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchEgress.speed_limit", &speedLimitTable);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchEgress.robot_class", &robotClassTable);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchEgress.actual_speed_function",
+                                             &functionTables[FUNCTION_ACTUAL]);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchEgress.target_speed_function",
+                                             &functionTables[FUNCTION_TARGET]);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchEgress.diff_speed_function",
+                                             &functionTables[FUNCTION_DIFF]);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchEgress.function_version",
+                                             &functionVersionTable);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchIngress.r_actual_bunny", &actualBunnyRegister);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchIngress.r_next_bunny", &nextBunnyRegister);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = bfrtInfo->bfrtTableFromNameGet("SwitchIngress.end_time", &endTimeRegister);
+  assert(bf_status == BF_SUCCESS);
+
   std::cout<<"got table ids"<<std::endl;
 
   // Get action Ids for route and nat actions
@@ -198,6 +301,33 @@ void tableSetUp() {
   bf_status = eBunnyTable->actionIdGet("SwitchEgress.set_target_e", &ebunny_set_target_id);
   assert(bf_status == BF_SUCCESS);
 
+  bf_status = railwayTable->actionIdGet("SwitchIngress.change_next_bunny", &railway_change_next_bunny_id);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = speedLimitTable->actionIdGet("SwitchEgress.override_speed",
+                                           &speed_limit_override_speed_id);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = robotClassTable->actionIdGet("SwitchEgress.set_robot_class",
+                                           &robot_class_set_robot_class_id);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = functionTables[FUNCTION_ACTUAL]->actionIdGet(
+      "SwitchEgress.update_actual_speed", &function_update_id[FUNCTION_ACTUAL]);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = functionTables[FUNCTION_TARGET]->actionIdGet(
+      "SwitchEgress.update_target_speed", &function_update_id[FUNCTION_TARGET]);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = functionTables[FUNCTION_DIFF]->actionIdGet(
+      "SwitchEgress.update_diff_speed", &function_update_id[FUNCTION_DIFF]);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = functionVersionTable->actionIdGet("SwitchEgress.set_function_version",
+                                                &function_version_set_id);
+  assert(bf_status == BF_SUCCESS);
+
   std::cout<<"got action ids"<<std::endl;
 
   // Get field-ids for key field and data fields
@@ -218,9 +348,6 @@ void tableSetUp() {
     bf_status = iBunnyTable->keyFieldIdGet("ig_md.actual_bunny", &i_actual_bunny_field);
     assert(bf_status == BF_SUCCESS);
 
-    bf_status = iBunnyTable->keyFieldIdGet("hdr.cur.jointId", &i_joint_id_field);
-    assert(bf_status == BF_SUCCESS);
-
     bf_status = eBunnyTable->keyFieldIdGet("eg_md.robot_id", &e_robot_id_field);
     assert(bf_status == BF_SUCCESS);
 
@@ -230,6 +357,53 @@ void tableSetUp() {
     bf_status = eBunnyTable->keyFieldIdGet("hdr.cur.jointId", &e_joint_id_field);
     assert(bf_status == BF_SUCCESS);
 
+    bf_status = railwayTable->keyFieldIdGet("ig_md.robot_id", &r_robot_id_field);
+    assert(bf_status == BF_SUCCESS);
+
+    bf_status = railwayTable->keyFieldIdGet("ig_md.actual_bunny", &r_actual_bunny_field);
+    assert(bf_status == BF_SUCCESS);
+
+    bf_status = speedLimitTable->keyFieldIdGet("eg_md.robot_class", &s_robot_class_field);
+    assert(bf_status == BF_SUCCESS);
+
+    bf_status = speedLimitTable->keyFieldIdGet("hdr.cur.jointId", &s_joint_id_field);
+    assert(bf_status == BF_SUCCESS);
+
+    bf_status = speedLimitTable->keyFieldIdGet("hdr.cur.speed", &s_speed_field);
+    assert(bf_status == BF_SUCCESS);
+
+    bf_status = speedLimitTable->keyFieldIdGet("$MATCH_PRIORITY", &s_priority_field);
+    assert(bf_status == BF_SUCCESS);
+
+    bf_status = robotClassTable->keyFieldIdGet("eg_md.robot_id", &c_robot_id_field);
+    assert(bf_status == BF_SUCCESS);
+
+    {
+      // the input of each function table
+      const char *function_inputs[NUM_FUNCTIONS] = {"hdr.cur.speed", "eg_md.target_speed",
+                                                    "eg_md.target_position"};
+      for (int f = 0; f < NUM_FUNCTIONS; f++) {
+        bf_status = functionTables[f]->keyFieldIdGet("eg_md.function_version",
+                                                     &f_version_field[f]);
+        assert(bf_status == BF_SUCCESS);
+
+        bf_status = functionTables[f]->keyFieldIdGet(function_inputs[f], &f_value_field[f]);
+        assert(bf_status == BF_SUCCESS);
+
+        bf_status = functionTables[f]->keyFieldIdGet("$MATCH_PRIORITY", &f_priority_field[f]);
+        assert(bf_status == BF_SUCCESS);
+      }
+    }
+
+    bf_status = actualBunnyRegister->keyFieldIdGet("$REGISTER_INDEX", &reg_index_field);
+    assert(bf_status == BF_SUCCESS);
+
+    bf_status = nextBunnyRegister->keyFieldIdGet("$REGISTER_INDEX", &next_reg_index_field);
+    assert(bf_status == BF_SUCCESS);
+
+    bf_status = endTimeRegister->keyFieldIdGet("$REGISTER_INDEX", &end_reg_index_field);
+    assert(bf_status == BF_SUCCESS);
+
     std::cout<<"got key field ids"<<std::endl;
 
   /***********************************************************************
@@ -271,8 +445,65 @@ void tableSetUp() {
                                    &eBunnyTable_tspeed);
   assert(bf_status == BF_SUCCESS);
 
+  bf_status = railwayTable->dataFieldIdGet("bunny_id",
+                                   railway_change_next_bunny_id,
+                                   &railwayTable_bunny_id);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = speedLimitTable->dataFieldIdGet("limit",
+                                   speed_limit_override_speed_id,
+                                   &speedLimitTable_limit);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = robotClassTable->dataFieldIdGet("robot_class",
+                                   robot_class_set_robot_class_id,
+                                   &robotClassTable_robot_class);
+  assert(bf_status == BF_SUCCESS);
+
+  for (int f = 0; f < NUM_FUNCTIONS; f++) {
+    bf_status = functionTables[f]->dataFieldIdGet("d",
+                                     function_update_id[f],
+                                     &functionTable_d[f]);
+    assert(bf_status == BF_SUCCESS);
+  }
+
+  bf_status = functionVersionTable->dataFieldIdGet("version",
+                                   function_version_set_id,
+                                   &functionVersionTable_version);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = actualBunnyRegister->dataFieldIdGet("SwitchIngress.r_actual_bunny.f1",
+                                   &actualBunnyRegister_f1);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = nextBunnyRegister->dataFieldIdGet("SwitchIngress.r_next_bunny.f1",
+                                   &nextBunnyRegister_f1);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = endTimeRegister->dataFieldIdGet("SwitchIngress.end_time.f1",
+                                   &endTimeRegister_f1);
+  assert(bf_status == BF_SUCCESS);
+
   std::cout<<"got data field ids"<<std::endl;
 
+  bf_status = bfrtInfo->bfrtLearnFromNameGet("SwitchIngressDeparser.progress_digest",
+                                             &progressDigest);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = progressDigest->learnFieldIdGet("robot_id", &digest_robot_id_field);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = progressDigest->learnFieldIdGet("actual_bunny", &digest_actual_bunny_field);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = progressDigest->learnFieldIdGet("next_bunny", &digest_next_bunny_field);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = progressDigest->learnFieldIdGet("end_time", &digest_end_time_field);
+  assert(bf_status == BF_SUCCESS);
+
+  std::cout<<"got digest field ids"<<std::endl;
+
   /***********************************************************************
    * DATA FIELD ID GET FOR "nat" ACTION
    **********************************************************************/
@@ -295,20 +526,32 @@ void tableSetUp() {
         //  bf_status = ipRouteTable->dataAllocate(&bfrtTableData);
         //  assert(bf_status == BF_SUCCESS);
 
-  bf_status = iBunnyTable->keyAllocate(&iTableKey);
-  assert(bf_status == BF_SUCCESS);
+  // The key and data objects of the bunny tables are allocated by every
+  // BfRtBackend for itself
 
-  bf_status = iBunnyTable->dataAllocate(&iTableData);
-  assert(bf_status == BF_SUCCESS);
+}
 
-  bf_status = eBunnyTable->keyAllocate(&eTableKey);
-  assert(bf_status == BF_SUCCESS);
+// Switch the tables written per robot to asymmetric mode, so their entries
+// can be added to single pipes. The scope of a table can only be changed while
+// it is empty. Register entries can be written per pipe in either mode.
+void tableScopeSetUp() {
+  const bfrt::BfRtTable *tables[] = {iBunnyTable, eBunnyTable, railwayTable};
+  for (auto table : tables) {
+    auto bf_status = table->tableClear(*session, dev_tgt);
+    assert(bf_status == BF_SUCCESS);
 
-  bf_status = eBunnyTable->dataAllocate(&eTableData);
-  assert(bf_status == BF_SUCCESS);
+    std::unique_ptr<bfrt::BfRtTableAttributes> attr;
+    bf_status = table->attributeAllocate(
+        bfrt::TableAttributesType::ENTRY_SCOPE, &attr);
+    assert(bf_status == BF_SUCCESS);
 
-  std::cout<<"helper variables allocated"<<std::endl;
+    bf_status = attr->entryScopeParamsSet(
+        bfrt::TableEntryScope::ENTRY_SCOPE_SINGLE_PIPELINE);
+    assert(bf_status == BF_SUCCESS);
 
+    bf_status = table->tableAttributesSet(*session, dev_tgt, *attr);
+    assert(bf_status == BF_SUCCESS);
+  }
 }
 
 /*******************************************************************************
@@ -376,7 +619,7 @@ void ipRoute_data_setup_for_nat(const IpRoute_natData &ipRoute_data,
 }
 
 
-// ingress
+// ingress, one entry per point: the joint of the key is not used
 
 void iBunny_key_setup(const bunny_key_t &key,
                        bfrt::BfRtTableKey *table_key) {
@@ -386,11 +629,6 @@ void iBunny_key_setup(const bunny_key_t &key,
       static_cast<robot_id_t>(key.robot_id));
   assert(bf_status == BF_SUCCESS);
 
-  bf_status = table_key->setValue(
-      i_joint_id_field, 
-      static_cast<joint_id_t>(key.jointId));
-  assert(bf_status == BF_SUCCESS);
-
   bf_status = table_key->setValue(
       i_actual_bunny_field, 
       static_cast<bunny_id_t>(key.actual_bunny));
@@ -414,43 +652,6 @@ void iBunny_data_setup(const bunny_data_t &data,
   return;
 }
 
-void iBunny_entry_add(const bunny_key_t &key,
-                                         const bunny_data_t &data,
-                                         const bool &add) {
-  // Adding a match entry with below mac Addr to be forwarded to the below port
-  // Reset key and data before use
-  iBunnyTable->keyReset(iTableKey.get());
-  iBunnyTable->dataReset(ibunny_set_target_id, iTableData.get());
-
-  // Fill in the Key and Data object
-  iBunny_key_setup(key, iTableKey.get());
-  iBunny_data_setup(data, iTableData.get());
-
-  // Call table entry add API, if the request is for an add, else call modify
-  bf_status_t status = BF_SUCCESS;
-  if (add) {
-    status = iBunnyTable->tableEntryAdd(
-        *session, dev_tgt, *iTableKey, *iTableData);
-  } else {
-    status = iBunnyTable->tableEntryMod(
-        *session, dev_tgt, *iTableKey, *iTableData);
-  }
-  assert(status == BF_SUCCESS);
-  //session->sessionCompleteOperations();
-}
-
-void iBunny_entry_delete(const bunny_key_t &key) {
-  // Reset key before use
-  iBunnyTable->keyReset(iTableKey.get());
-
-  iBunny_key_setup(key, iTableKey.get());
-
-  auto status = iBunnyTable->tableEntryDel(*session, dev_tgt, *iTableKey);
-  assert(status == BF_SUCCESS);
-  //session->sessionCompleteOperations();
-  return;
-}
-
 // egress
 
 void eBunny_key_setup(const bunny_key_t &key,
@@ -489,153 +690,1279 @@ void eBunny_data_setup(const bunny_target_t &data,
   return;
 }
 
-void eBunny_entry_add(const bunny_key_t &key,
-                                         const bunny_target_t &data,
-                                         const bool &add) {
-  // Adding a match entry with below mac Addr to be forwarded to the below port
-  // Reset key and data before use
-  eBunnyTable->keyReset(eTableKey.get());
-  eBunnyTable->dataReset(ebunny_set_target_id, eTableData.get());
+// speed limit, the entries of a cover are disjoint so they all have the
+// same priority
 
-  // Fill in the Key and Data object
-  eBunny_key_setup(key, eTableKey.get());
-  eBunny_data_setup(data, eTableData.get());
+void speed_limit_key_setup(const speed_limit_key_t &key,
+                           bfrt::BfRtTableKey *table_key) {
+  auto bf_status = table_key->setValue(
+      s_robot_class_field,
+      static_cast<uint64_t>(key.robot_class));
+  assert(bf_status == BF_SUCCESS);
 
-  // Call table entry add API, if the request is for an add, else call modify
-  bf_status_t status = BF_SUCCESS;
-  if (add) {
-    status = eBunnyTable->tableEntryAdd(
-        *session, dev_tgt, *eTableKey, *eTableData);
-  } else {
-    status = eBunnyTable->tableEntryMod(
-        *session, dev_tgt, *eTableKey, *eTableData);
-  }
-  assert(status == BF_SUCCESS);
-  //session->sessionCompleteOperations();
+  bf_status = table_key->setValue(
+      s_joint_id_field,
+      static_cast<uint64_t>(key.jointId));
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = table_key->setValueandMask(
+      s_speed_field,
+      static_cast<uint64_t>(key.value),
+      static_cast<uint64_t>(key.mask));
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = table_key->setValue(s_priority_field, static_cast<uint64_t>(0));
+  assert(bf_status == BF_SUCCESS);
 }
 
-void eBunny_entry_delete(const bunny_key_t &key) {
-  // Reset key before use
-  eBunnyTable->keyReset(eTableKey.get());
+// weighting functions, the entries of a version are disjoint as well
 
-  eBunny_key_setup(key, eTableKey.get());
+void function_key_setup(const uint32_t &function,
+                        const function_key_t &key,
+                        bfrt::BfRtTableKey *table_key) {
+  auto bf_status = table_key->setValue(
+      f_version_field[function],
+      static_cast<uint64_t>(key.version));
+  assert(bf_status == BF_SUCCESS);
 
-  auto status = eBunnyTable->tableEntryDel(*session, dev_tgt, *eTableKey);
-  assert(status == BF_SUCCESS);
-  //session->sessionCompleteOperations();
-  return;
+  bf_status = table_key->setValueandMask(
+      f_value_field[function],
+      static_cast<uint64_t>(key.value),
+      static_cast<uint64_t>(key.mask));
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = table_key->setValue(f_priority_field[function], static_cast<uint64_t>(0));
+  assert(bf_status == BF_SUCCESS);
 }
 
-void run_test_v2(){
-    // insert 100 000 entry
-    int k = 0;
-    for (k=0;k<100000;k++){
-        bunny_key_t key;
-        bunny_data_t data;
-        bunny_target_t target;
-        bool add = true;
+// railway switch
 
-        key.robot_id = 0;
-        key.jointId = k/65536;
-        key.actual_bunny = k%65536;
+void railway_key_setup(const robot_id_t &robot_id,
+                       const bunny_id_t &from_id,
+                       bfrt::BfRtTableKey *table_key) {
+  auto bf_status = table_key->setValue(
+      r_robot_id_field,
+      static_cast<uint64_t>(robot_id));
+  assert(bf_status == BF_SUCCESS);
 
-        iBunny_entry_add(key,data,add);
-        eBunny_entry_add(key,target,add);
-    }
+  bf_status = table_key->setValue(
+      r_actual_bunny_field,
+      static_cast<uint64_t>(from_id));
+  assert(bf_status == BF_SUCCESS);
+}
 
-    // time insert and remove
-    int i=0;
-    for (int _x=0;_x<20;_x++){
-        // start timer
-        timeval start_time, end_time;
-        gettimeofday(&start_time, NULL);
-        auto status = session->beginBatch();
-        assert(status==BF_SUCCESS);
 
-        for (int _y=0;_y<10000;_y++){
-            // remove based on i
-            bunny_key_t key0;
+// Streaming read of a table: tableEntryGetFirst/tableEntryGetNext_n read
+// chunk entries per call into a pool of key and data objects that is
+// allocated once and reused by every scan. The key fields are copied to a
+// cursor key, the next chunk is read after it.
+class BfRtEntryReader {
+ public:
+  BfRtEntryReader(const bfrt::BfRtTable *table, std::vector<bf_rt_id_t> key_fields)
+      : table_(table),
+        key_fields_(std::move(key_fields)),
+        session_(nullptr),
+        flag_(bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_SW),
+        first_(false),
+        done_(true) {
+    auto status = table_->keyAllocate(&cursor_);
+    assert(status == BF_SUCCESS);
+  }
 
-            key0.robot_id = 0;
-            key0.jointId = i/65536;
-            key0.actual_bunny = i%65536;
+  // Start a scan of the target, the pool grows or shrinks to chunk objects
+  void begin(const bfrt::BfRtSession *session, const bf_rt_target_t &target,
+             const bool &from_hw, const uint32_t &chunk) {
+    if (chunk != keys_.size()) {
+      allocate(chunk);
+    }
+    session_ = session;
+    target_ = target;
+    flag_ = from_hw ? bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_HW
+                    : bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_SW;
+    first_ = true;
+    done_ = false;
+  }
+
+  // Read the next chunk into the pool, *count is 0 at the end of the table
+  bf_status_t next(uint32_t *count) {
+    *count = 0;
+    if (done_) {
+      return BF_SUCCESS;
+    }
+    uint32_t returned = 0;
+    bf_status_t status = BF_SUCCESS;
+    if (first_) {
+      first_ = false;
+      status = table_->tableEntryGetFirst(*session_, target_, flag_, keys_[0].get(),
+                                          data_[0].get());
+      if (status == BF_OBJECT_NOT_FOUND) {
+        done_ = true;
+        return BF_SUCCESS;
+      }
+      if (status == BF_SUCCESS && keys_.size() > 1) {
+        status = table_->tableEntryGetNext_n(*session_, target_, *keys_[0],
+                                             keys_.size() - 1, flag_, &rest_, &returned);
+      }
+      returned++;
+    } else {
+      status = table_->tableEntryGetNext_n(*session_, target_, *cursor_, keys_.size(),
+                                           flag_, &pairs_, &returned);
+    }
+    if (status != BF_SUCCESS && status != BF_OBJECT_NOT_FOUND) {
+      done_ = true;
+      return status;
+    }
+    if (returned < keys_.size()) {
+      done_ = true;
+    } else {
+      for (auto field : key_fields_) {
+        uint64_t value = 0;
+        status = keys_[returned - 1]->getValue(field, &value);
+        assert(status == BF_SUCCESS);
+        status = cursor_->setValue(field, value);
+        assert(status == BF_SUCCESS);
+      }
+    }
+    *count = returned;
+    return BF_SUCCESS;
+  }
 
-            iBunny_entry_delete(key0);
-            eBunny_entry_delete(key0);
+  const bfrt::BfRtTableKey &key(const uint32_t &i) const { return *keys_[i]; }
+  const bfrt::BfRtTableData &data(const uint32_t &i) const { return *data_[i]; }
+
+ private:
+  void allocate(const uint32_t &chunk) {
+    keys_.resize(chunk);
+    data_.resize(chunk);
+    pairs_.clear();
+    for (uint32_t i = 0; i < chunk; i++) {
+      if (!keys_[i]) {
+        auto status = table_->keyAllocate(&keys_[i]);
+        assert(status == BF_SUCCESS);
+        status = table_->dataAllocate(&data_[i]);
+        assert(status == BF_SUCCESS);
+      }
+      pairs_.push_back(std::make_pair(keys_[i].get(), data_[i].get()));
+    }
+    // after the first entry
+    rest_.assign(pairs_.begin() + 1, pairs_.end());
+  }
 
-            i++;
+  const bfrt::BfRtTable *table_;
+  std::vector<bf_rt_id_t> key_fields_;
+  std::vector<std::unique_ptr<bfrt::BfRtTableKey>> keys_;
+  std::vector<std::unique_ptr<bfrt::BfRtTableData>> data_;
+  bfrt::BfRtTable::keyDataPairs pairs_;
+  bfrt::BfRtTable::keyDataPairs rest_;
+  std::unique_ptr<bfrt::BfRtTableKey> cursor_;
+  const bfrt::BfRtSession *session_;
+  bf_rt_target_t target_;
+  bfrt::BfRtTable::BfRtTableGetFlag flag_;
+  bool first_;
+  bool done_;
+};
 
-            // add based on k  
-            bunny_key_t key;
-            bunny_data_t data;
-            bunny_target_t target;
-            bool add = true;
+// TableBackend on the BfRt tables of ur.p4. Every backend owns its key and
+// data objects, so different backends (sessions) can be used in parallel.
+class BfRtBackend : public TableBackend {
+ public:
+  BfRtBackend(std::shared_ptr<bfrt::BfRtSession> session,
+              const PipeMap &pipes)
+      : session_(session),
+        pipes_(pipes),
+        iReader(iBunnyTable, {i_robot_id_field, i_actual_bunny_field}),
+        eReader(eBunnyTable, {e_robot_id_field, e_actual_bunny_field, e_joint_id_field}),
+        rReader(railwayTable, {r_robot_id_field, r_actual_bunny_field}),
+        actualReader(actualBunnyRegister, {reg_index_field}),
+        nextReader(nextBunnyRegister, {next_reg_index_field}),
+        endReader(endTimeRegister, {end_reg_index_field}),
+        synced_(0) {
+    auto bf_status = iBunnyTable->keyAllocate(&iTableKey);
+    assert(bf_status == BF_SUCCESS);
 
-            key.robot_id = 0;
-            key.jointId = k/65536;
-            key.actual_bunny = k%65536;
+    bf_status = iBunnyTable->dataAllocate(&iTableData);
+    assert(bf_status == BF_SUCCESS);
 
-            iBunny_entry_add(key,data,add);
-            eBunny_entry_add(key,target,add);
+    bf_status = eBunnyTable->keyAllocate(&eTableKey);
+    assert(bf_status == BF_SUCCESS);
 
-            k++;
+    bf_status = eBunnyTable->dataAllocate(&eTableData);
+    assert(bf_status == BF_SUCCESS);
 
-        }   
+    bf_status = railwayTable->keyAllocate(&rTableKey);
+    assert(bf_status == BF_SUCCESS);
 
-        // stop timer
-        status = session->endBatch(true);
-        assert(status==BF_SUCCESS);
-        session->sessionCompleteOperations();
+    bf_status = railwayTable->dataAllocate(&rTableData);
+    assert(bf_status == BF_SUCCESS);
 
-        gettimeofday(&end_time, NULL);
-        auto diff = ((end_time.tv_sec * 1000000 + end_time.tv_usec) - (start_time.tv_sec * 1000000 + start_time.tv_usec));
-        std::cout<<"removeadd "<<10000<< " "<<_x<<" "<<diff<<std::endl;
+    bf_status = speedLimitTable->keyAllocate(&sTableKey);
+    assert(bf_status == BF_SUCCESS);
 
-    }
+    bf_status = speedLimitTable->dataAllocate(&sTableData);
+    assert(bf_status == BF_SUCCESS);
 
-}
+    bf_status = robotClassTable->keyAllocate(&cTableKey);
+    assert(bf_status == BF_SUCCESS);
 
-void run_tests(const int record_count,const int repeat_count){
-    //std::cout << "### insert " << record_count << " records" <<std::endl;
-    
-    for (int i=0;i<repeat_count;i++){
-        //std::cout<<"test "<<i << std::endl;
-        timeval start_time, end_time;
-        //auto start_time = std::chrono::steady_clock::now();
-        gettimeofday(&start_time, NULL);
+    bf_status = robotClassTable->dataAllocate(&cTableData);
+    assert(bf_status == BF_SUCCESS);
 
-        auto status = session->beginBatch();
-        assert(status==BF_SUCCESS);
-        for (int k=0;k<=record_count;k++){
-            bunny_key_t key;
-            bunny_data_t data;
-            bunny_target_t target;
-            bool add = true;
+    for (int f = 0; f < NUM_FUNCTIONS; f++) {
+      bf_status = functionTables[f]->keyAllocate(&fTableKey[f]);
+      assert(bf_status == BF_SUCCESS);
 
-            key.robot_id = i;
-            key.jointId = k/65536;
-            key.actual_bunny = k%65536;
+      bf_status = functionTables[f]->dataAllocate(&fTableData[f]);
+      assert(bf_status == BF_SUCCESS);
+    }
 
-            //std::cout <<"add " << i << " "<<k<<std::endl;
-            
-            iBunny_entry_add(key,data,add);
-            eBunny_entry_add(key,target,add);
-        }
+    bf_status = functionVersionTable->dataAllocate(&vTableData);
+    assert(bf_status == BF_SUCCESS);
 
-        status = session->endBatch(true);
-        assert(status==BF_SUCCESS);
-        session->sessionCompleteOperations();
+    bf_status = actualBunnyRegister->keyAllocate(&regKey);
+    assert(bf_status == BF_SUCCESS);
 
-        //auto end_time = std::chrono::steady_clock::now();
-        gettimeofday(&end_time, NULL);
-        auto diff = ((end_time.tv_sec * 1000000 + end_time.tv_usec) - (start_time.tv_sec * 1000000 + start_time.tv_usec));
-        //std::chrono::duration<double> diff = end_time-start_time;
-        std::cout<<"add "<<record_count<< " "<<i<<" "<<diff<<std::endl;
-        //std::cout << diff.count() << std::endl;
+    bf_status = actualBunnyRegister->dataAllocate(&regData);
+    assert(bf_status == BF_SUCCESS);
 
+    const bfrt::BfRtTable *registers[] = {actualBunnyRegister, nextBunnyRegister,
+                                          endTimeRegister};
+    for (auto reg : registers) {
+      std::unique_ptr<bfrt::BfRtTableOperations> sync;
+      bf_status = reg->tableOperationsAllocate(
+          bfrt::TableOperationsType::REGISTER_SYNC, &sync);
+      assert(bf_status == BF_SUCCESS);
+      registerSyncs.emplace_back(reg, std::move(sync));
     }
+  }
 
-    session->sessionCompleteOperations();
+  bf_status_t beginBatch() override { return session_->beginBatch(); }
+
+  bf_status_t endBatch(bool hw_synchronous) override {
+    return session_->endBatch(hw_synchronous);
+  }
+
+  bf_status_t completeOperations() override {
+    return session_->sessionCompleteOperations();
+  }
+
+  bf_status_t beginTransaction() override { return session_->beginTransaction(true); }
+
+  bf_status_t commitTransaction() override {
+    return session_->commitTransaction(true);
+  }
+
+  bf_status_t abortTransaction() override { return session_->abortTransaction(); }
+
+  // ingress
+
+  bf_status_t iBunnyEntryAdd(const bunny_key_t &key,
+                             const bunny_data_t &data,
+                             const bool &add) override {
+    // Reset key and data before use
+    iBunnyTable->keyReset(iTableKey.get());
+    iBunnyTable->dataReset(ibunny_set_target_id, iTableData.get());
+
+    // Fill in the Key and Data object
+    iBunny_key_setup(key, iTableKey.get());
+    iBunny_data_setup(data, iTableData.get());
+
+    // Call table entry add API, if the request is for an add, else call modify
+    return forPipes(pipes_.ingressPipes(key.robot_id), [&](const bf_rt_target_t &target) {
+      if (add) {
+        return iBunnyTable->tableEntryAdd(
+            *session_, target, *iTableKey, *iTableData);
+      }
+      return iBunnyTable->tableEntryMod(
+          *session_, target, *iTableKey, *iTableData);
+    });
+  }
+
+  bf_status_t iBunnyEntryDel(const bunny_key_t &key) override {
+    // Reset key before use
+    iBunnyTable->keyReset(iTableKey.get());
+
+    iBunny_key_setup(key, iTableKey.get());
+
+    return forPipes(pipes_.ingressPipes(key.robot_id), [&](const bf_rt_target_t &target) {
+      return iBunnyTable->tableEntryDel(*session_, target, *iTableKey);
+    });
+  }
+
+  bf_status_t iBunnyEntryGet(const bunny_key_t &key,
+                             const bool &from_hw,
+                             bunny_data_t *data) override {
+    iBunnyTable->keyReset(iTableKey.get());
+    // the action id is filled in by the get function
+    iBunnyTable->dataReset(iTableData.get());
+
+    iBunny_key_setup(key, iTableKey.get());
+
+    auto flag = from_hw ? bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_HW
+                        : bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_SW;
+    auto status = iBunnyTable->tableEntryGet(
+        *session_, firstPipe(pipes_.ingressPipes(key.robot_id)), *iTableKey,
+        flag, iTableData.get());
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+
+    uint64_t next_id, duration;
+    status = iTableData->getValue(iBunnyTable_next_id, &next_id);
+    assert(status == BF_SUCCESS);
+    status = iTableData->getValue(iBunnyTable_duration, &duration);
+    assert(status == BF_SUCCESS);
+    data->next_id = static_cast<bunny_id_t>(next_id);
+    data->duration = static_cast<p4_time_t>(duration);
+    return BF_SUCCESS;
+  }
+
+  // egress
+
+  bf_status_t eBunnyEntryAdd(const bunny_key_t &key,
+                             const bunny_target_t &data,
+                             const bool &add) override {
+    // Reset key and data before use
+    eBunnyTable->keyReset(eTableKey.get());
+    eBunnyTable->dataReset(ebunny_set_target_id, eTableData.get());
+
+    // Fill in the Key and Data object
+    eBunny_key_setup(key, eTableKey.get());
+    eBunny_data_setup(data, eTableData.get());
+
+    // Call table entry add API, if the request is for an add, else call modify
+    return forPipes(pipes_.egressPipes(key.robot_id), [&](const bf_rt_target_t &target) {
+      if (add) {
+        return eBunnyTable->tableEntryAdd(
+            *session_, target, *eTableKey, *eTableData);
+      }
+      return eBunnyTable->tableEntryMod(
+          *session_, target, *eTableKey, *eTableData);
+    });
+  }
+
+  bf_status_t eBunnyEntryDel(const bunny_key_t &key) override {
+    // Reset key before use
+    eBunnyTable->keyReset(eTableKey.get());
+
+    eBunny_key_setup(key, eTableKey.get());
+
+    return forPipes(pipes_.egressPipes(key.robot_id), [&](const bf_rt_target_t &target) {
+      return eBunnyTable->tableEntryDel(*session_, target, *eTableKey);
+    });
+  }
+
+  bf_status_t eBunnyEntryGet(const bunny_key_t &key,
+                             const bool &from_hw,
+                             bunny_target_t *data) override {
+    eBunnyTable->keyReset(eTableKey.get());
+    // the action id is filled in by the get function
+    eBunnyTable->dataReset(eTableData.get());
+
+    eBunny_key_setup(key, eTableKey.get());
+
+    auto flag = from_hw ? bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_HW
+                        : bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_SW;
+    auto status = eBunnyTable->tableEntryGet(
+        *session_, firstPipe(pipes_.egressPipes(key.robot_id)), *eTableKey,
+        flag, eTableData.get());
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+
+    uint64_t tpos, tspeed;
+    status = eTableData->getValue(eBunnyTable_tpos, &tpos);
+    assert(status == BF_SUCCESS);
+    status = eTableData->getValue(eBunnyTable_tspeed, &tspeed);
+    assert(status == BF_SUCCESS);
+    data->tpos = tpos;
+    data->tspeed = tspeed;
+    return BF_SUCCESS;
+  }
+
+  // trajectory points
+
+  // The ingress entry is written once, the keys of the 6 egress entries only
+  // differ in the joint id, so the key and data objects are filled in once
+  // and only the joint dependent fields are set in the loop.
+  bf_status_t bunnyPointAdd(const trajectory_point_t &point) override {
+    bunny_key_t key;
+    key.robot_id = point.robot_id;
+    key.actual_bunny = point.bunny_id;
+    key.jointId = 0;
+
+    bunny_data_t data;
+    data.next_id = point.next_id;
+    data.duration = point.duration;
+
+    iBunnyTable->keyReset(iTableKey.get());
+    iBunnyTable->dataReset(ibunny_set_target_id, iTableData.get());
+    iBunny_key_setup(key, iTableKey.get());
+    iBunny_data_setup(data, iTableData.get());
+
+    eBunnyTable->keyReset(eTableKey.get());
+    eBunnyTable->dataReset(ebunny_set_target_id, eTableData.get());
+    eBunny_key_setup(key, eTableKey.get());
+
+    auto status = forPipes(pipes_.ingressPipes(point.robot_id), [&](const bf_rt_target_t &target) {
+      return entryUpsert(iBunnyTable, target, *iTableKey, *iTableData);
+    });
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+
+    auto &egress = pipes_.egressPipes(point.robot_id);
+    for (uint64_t j = 0; j < NUM_JOINTS; j++) {
+      status = eTableKey->setValue(e_joint_id_field, j);
+      assert(status == BF_SUCCESS);
+      status = eTableData->setValue(eBunnyTable_tpos, point.positions[j]);
+      assert(status == BF_SUCCESS);
+      status = eTableData->setValue(eBunnyTable_tspeed, point.speeds[j]);
+      assert(status == BF_SUCCESS);
+      status = forPipes(egress, [&](const bf_rt_target_t &target) {
+        return entryUpsert(eBunnyTable, target, *eTableKey, *eTableData);
+      });
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+    }
+    return BF_SUCCESS;
+  }
+
+  bf_status_t bunnyPointDel(const robot_id_t &robot_id,
+                            const bunny_id_t &bunny_id) override {
+    bunny_key_t key;
+    key.robot_id = robot_id;
+    key.actual_bunny = bunny_id;
+    key.jointId = 0;
+
+    iBunnyTable->keyReset(iTableKey.get());
+    iBunny_key_setup(key, iTableKey.get());
+    eBunnyTable->keyReset(eTableKey.get());
+    eBunny_key_setup(key, eTableKey.get());
+
+    auto status = forPipes(pipes_.ingressPipes(robot_id), [&](const bf_rt_target_t &target) {
+      auto del_status = iBunnyTable->tableEntryDel(*session_, target, *iTableKey);
+      return del_status == BF_OBJECT_NOT_FOUND ? BF_SUCCESS : del_status;
+    });
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+
+    auto &egress = pipes_.egressPipes(robot_id);
+    for (uint64_t j = 0; j < NUM_JOINTS; j++) {
+      status = eTableKey->setValue(e_joint_id_field, j);
+      assert(status == BF_SUCCESS);
+      status = forPipes(egress, [&](const bf_rt_target_t &target) {
+        auto del_status = eBunnyTable->tableEntryDel(*session_, target, *eTableKey);
+        return del_status == BF_OBJECT_NOT_FOUND ? BF_SUCCESS : del_status;
+      });
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+    }
+    return BF_SUCCESS;
+  }
+
+  // The keys of the robot are read from the sw state of its first pipes, one
+  // driver call per TABLE_SCAN_CHUNK entries of the whole tables.
+  bf_status_t bunnyRobotKeys(const robot_id_t &robot_id, std::vector<bunny_id_t> *bunny_ids,
+                             std::vector<bunny_id_t> *from_ids) override {
+    bunny_ids->clear();
+    from_ids->clear();
+    auto status = iBunnyScan(
+        false, firstPipe(pipes_.ingressPipes(robot_id)).pipe_id, TABLE_SCAN_CHUNK,
+        [&](const bunny_entry_t &entry) {
+          if (entry.key.robot_id == robot_id) {
+            bunny_ids->push_back(entry.key.actual_bunny);
+          }
+          return true;
+        });
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+
+    status = eBunnyScan(
+        false, firstPipe(pipes_.egressPipes(robot_id)).pipe_id, TABLE_SCAN_CHUNK,
+        [&](const bunny_e_entry_t &entry) {
+          if (entry.key.robot_id == robot_id) {
+            bunny_ids->push_back(entry.key.actual_bunny);
+          }
+          return true;
+        });
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    std::sort(bunny_ids->begin(), bunny_ids->end());
+    bunny_ids->erase(std::unique(bunny_ids->begin(), bunny_ids->end()), bunny_ids->end());
+
+    return railwayScan(
+        false, firstPipe(pipes_.ingressPipes(robot_id)).pipe_id, TABLE_SCAN_CHUNK,
+        [&](const railway_entry_t &entry) {
+          if (entry.robot_id == robot_id) {
+            from_ids->push_back(entry.from_id);
+          }
+          return true;
+        });
+  }
+
+  // railway switch
+
+  // If the robot reaches from_id, its next bunny is overridden with to_id.
+  bf_status_t railwayEntryAdd(const robot_id_t &robot_id,
+                              const bunny_id_t &from_id,
+                              const bunny_id_t &to_id) override {
+    railwayTable->keyReset(rTableKey.get());
+    railwayTable->dataReset(railway_change_next_bunny_id, rTableData.get());
+
+    railway_key_setup(robot_id, from_id, rTableKey.get());
+    auto status = rTableData->setValue(railwayTable_bunny_id,
+                                       static_cast<uint64_t>(to_id));
+    assert(status == BF_SUCCESS);
+
+    return forPipes(pipes_.ingressPipes(robot_id), [&](const bf_rt_target_t &target) {
+      return railwayTable->tableEntryAdd(
+          *session_, target, *rTableKey, *rTableData);
+    });
+  }
+
+  bf_status_t railwayEntryMod(const robot_id_t &robot_id,
+                              const bunny_id_t &from_id,
+                              const bunny_id_t &to_id) override {
+    railwayTable->keyReset(rTableKey.get());
+    railwayTable->dataReset(railway_change_next_bunny_id, rTableData.get());
+
+    railway_key_setup(robot_id, from_id, rTableKey.get());
+    auto status = rTableData->setValue(railwayTable_bunny_id,
+                                       static_cast<uint64_t>(to_id));
+    assert(status == BF_SUCCESS);
+
+    return forPipes(pipes_.ingressPipes(robot_id), [&](const bf_rt_target_t &target) {
+      return railwayTable->tableEntryMod(
+          *session_, target, *rTableKey, *rTableData);
+    });
+  }
+
+  bf_status_t railwayEntryDel(const robot_id_t &robot_id,
+                              const bunny_id_t &from_id) override {
+    railwayTable->keyReset(rTableKey.get());
+    railway_key_setup(robot_id, from_id, rTableKey.get());
+    return forPipes(pipes_.ingressPipes(robot_id), [&](const bf_rt_target_t &target) {
+      return railwayTable->tableEntryDel(*session_, target, *rTableKey);
+    });
+  }
+
+  // speed limit, the table is symmetric in every mode
+
+  bf_status_t speedLimitEntryAdd(const speed_limit_entry_t &entry,
+                                 const bool &add) override {
+    speedLimitTable->keyReset(sTableKey.get());
+    speedLimitTable->dataReset(speed_limit_override_speed_id, sTableData.get());
+
+    speed_limit_key_setup(entry.key, sTableKey.get());
+    auto status = sTableData->setValue(speedLimitTable_limit,
+                                       static_cast<uint64_t>(entry.speed));
+    assert(status == BF_SUCCESS);
+
+    if (add) {
+      return speedLimitTable->tableEntryAdd(*session_, dev_tgt, *sTableKey, *sTableData);
+    }
+    return speedLimitTable->tableEntryMod(*session_, dev_tgt, *sTableKey, *sTableData);
+  }
+
+  bf_status_t speedLimitEntryDel(const speed_limit_key_t &key) override {
+    speedLimitTable->keyReset(sTableKey.get());
+    speed_limit_key_setup(key, sTableKey.get());
+    return speedLimitTable->tableEntryDel(*session_, dev_tgt, *sTableKey);
+  }
+
+  bf_status_t robotClassSet(const robot_id_t &robot_id,
+                            const robot_class_t &robot_class) override {
+    robotClassTable->keyReset(cTableKey.get());
+    robotClassTable->dataReset(robot_class_set_robot_class_id, cTableData.get());
+
+    auto status = cTableKey->setValue(c_robot_id_field, static_cast<uint64_t>(robot_id));
+    assert(status == BF_SUCCESS);
+    status = cTableData->setValue(robotClassTable_robot_class,
+                                  static_cast<uint64_t>(robot_class));
+    assert(status == BF_SUCCESS);
+
+    status = robotClassTable->tableEntryAdd(*session_, dev_tgt, *cTableKey, *cTableData);
+    if (status == BF_ALREADY_EXISTS) {
+      status = robotClassTable->tableEntryMod(*session_, dev_tgt, *cTableKey, *cTableData);
+    }
+    return status;
+  }
+
+  // weighting functions, symmetric like the speed limit
+
+  bf_status_t functionEntryAdd(const uint32_t &function,
+                               const function_entry_t &entry) override {
+    if (function >= NUM_FUNCTIONS) {
+      return BF_INVALID_ARG;
+    }
+    auto table = functionTables[function];
+    table->keyReset(fTableKey[function].get());
+    table->dataReset(function_update_id[function], fTableData[function].get());
+
+    function_key_setup(function, entry.key, fTableKey[function].get());
+    auto status = fTableData[function]->setValue(functionTable_d[function],
+                                                 static_cast<uint64_t>(entry.d));
+    assert(status == BF_SUCCESS);
+
+    return table->tableEntryAdd(*session_, dev_tgt, *fTableKey[function],
+                                *fTableData[function]);
+  }
+
+  bf_status_t functionEntryDel(const uint32_t &function,
+                               const function_key_t &key) override {
+    if (function >= NUM_FUNCTIONS) {
+      return BF_INVALID_ARG;
+    }
+    auto table = functionTables[function];
+    table->keyReset(fTableKey[function].get());
+    function_key_setup(function, key, fTableKey[function].get());
+    return table->tableEntryDel(*session_, dev_tgt, *fTableKey[function]);
+  }
+
+  bf_status_t functionVersionSet(const uint8_t &version) override {
+    functionVersionTable->dataReset(function_version_set_id, vTableData.get());
+    auto status = vTableData->setValue(functionVersionTable_version,
+                                       static_cast<uint64_t>(version));
+    assert(status == BF_SUCCESS);
+    return functionVersionTable->tableDefaultEntrySet(*session_, dev_tgt, *vTableData);
+  }
+
+  // Delete the content of the bunny, bunny_e and railway_switch tables.
+  bf_status_t bunnyClear() override {
+    return forPipes(pipes_.allPipes(), [&](const bf_rt_target_t &target) {
+      auto status = iBunnyTable->tableClear(*session_, target);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+
+      status = eBunnyTable->tableClear(*session_, target);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+
+      return railwayTable->tableClear(*session_, target);
+    });
+  }
+
+  // read back
+
+  bf_status_t iBunnyScan(const bool &from_hw, const uint32_t &pipe,
+                         const uint32_t &chunk,
+                         const std::function<bool(const bunny_entry_t &)> &f) override {
+    return scan(&iReader, from_hw, pipe, chunk,
+                [&](const bfrt::BfRtTableKey &key, const bfrt::BfRtTableData &data) {
+                  bunny_entry_t entry;
+                  entry.key.robot_id = static_cast<robot_id_t>(keyValue(key, i_robot_id_field));
+                  entry.key.actual_bunny = static_cast<bunny_id_t>(keyValue(key, i_actual_bunny_field));
+                  entry.key.jointId = 0;
+                  entry.data.next_id = static_cast<bunny_id_t>(dataValue(data, iBunnyTable_next_id));
+                  entry.data.duration = static_cast<p4_time_t>(dataValue(data, iBunnyTable_duration));
+                  return f(entry);
+                });
+  }
+
+  bf_status_t eBunnyScan(const bool &from_hw, const uint32_t &pipe,
+                         const uint32_t &chunk,
+                         const std::function<bool(const bunny_e_entry_t &)> &f) override {
+    return scan(&eReader, from_hw, pipe, chunk,
+                [&](const bfrt::BfRtTableKey &key, const bfrt::BfRtTableData &data) {
+                  bunny_e_entry_t entry;
+                  entry.key.robot_id = static_cast<robot_id_t>(keyValue(key, e_robot_id_field));
+                  entry.key.actual_bunny = static_cast<bunny_id_t>(keyValue(key, e_actual_bunny_field));
+                  entry.key.jointId = static_cast<joint_id_t>(keyValue(key, e_joint_id_field));
+                  entry.target.tpos = dataValue(data, eBunnyTable_tpos);
+                  entry.target.tspeed = dataValue(data, eBunnyTable_tspeed);
+                  return f(entry);
+                });
+  }
+
+  bf_status_t railwayScan(const bool &from_hw, const uint32_t &pipe,
+                          const uint32_t &chunk,
+                          const std::function<bool(const railway_entry_t &)> &f) override {
+    return scan(&rReader, from_hw, pipe, chunk,
+                [&](const bfrt::BfRtTableKey &key, const bfrt::BfRtTableData &data) {
+                  railway_entry_t entry;
+                  entry.robot_id = static_cast<robot_id_t>(keyValue(key, r_robot_id_field));
+                  entry.from_id = static_cast<bunny_id_t>(keyValue(key, r_actual_bunny_field));
+                  entry.to_id = static_cast<bunny_id_t>(dataValue(data, railwayTable_bunny_id));
+                  return f(entry);
+                });
+  }
+
+  // registers
+
+  bf_status_t actualBunnyGet(const robot_id_t &robot_id,
+                             bunny_id_t *bunny_id) override {
+    actualBunnyRegister->keyReset(regKey.get());
+    actualBunnyRegister->dataReset(regData.get());
+
+    auto status = regKey->setValue(reg_index_field,
+                                   static_cast<uint64_t>(robot_id));
+    assert(status == BF_SUCCESS);
+
+    // A single index is read straight from the hardware, there is no need to
+    // sync the whole register like setup.py does.
+    auto flag = bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_HW;
+    auto target = firstPipe(pipes_.ingressPipes(robot_id));
+    status = actualBunnyRegister->tableEntryGet(
+        *session_, target, *regKey, flag, regData.get());
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+
+    // one value per target pipe, take the one of the robot's pipe
+    std::vector<uint64_t> values;
+    status = regData->getValue(actualBunnyRegister_f1, &values);
+    assert(status == BF_SUCCESS);
+    size_t index = target.pipe_id == ALL_PIPES ? pipes_.registerPipe(robot_id) : 0;
+    *bunny_id = index < values.size() ? static_cast<bunny_id_t>(values[index]) : 0;
+    return BF_SUCCESS;
+  }
+
+  // The three registers are synced from the hardware for every index at
+  // once, the syncs run in parallel. The synced sw copies are then read in
+  // chunks, one value per pipe, the one of the robot's pipe is taken.
+  bf_status_t progressRead(robot_progress_t *progress) override {
+    auto status = registersSync();
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    status = registerScan(&actualReader, reg_index_field, actualBunnyRegister_f1,
+                          [&](const robot_id_t &robot_id, const uint64_t &value) {
+                            progress[robot_id].actual_bunny = static_cast<bunny_id_t>(value);
+                          });
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    status = registerScan(&nextReader, next_reg_index_field, nextBunnyRegister_f1,
+                          [&](const robot_id_t &robot_id, const uint64_t &value) {
+                            progress[robot_id].next_bunny = static_cast<bunny_id_t>(value);
+                          });
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    return registerScan(&endReader, end_reg_index_field, endTimeRegister_f1,
+                        [&](const robot_id_t &robot_id, const uint64_t &value) {
+                          progress[robot_id].end_time = static_cast<p4_time_t>(value);
+                        });
+  }
+
+  // The digests of a learn message are passed on one by one, the message is
+  // acknowledged right away so the driver can reuse its buffer.
+  bf_status_t progressListen(ProgressListener *listener) override {
+    if (listener == nullptr) {
+      return progressDigest->bfRtLearnCallbackDeregister(session_, dev_tgt);
+    }
+    return progressDigest->bfRtLearnCallbackRegister(
+        session_, dev_tgt,
+        [](const bf_rt_target_t &, const std::shared_ptr<bfrt::BfRtSession> session,
+           std::vector<std::unique_ptr<bfrt::BfRtLearnData>> learnData,
+           bf_rt_learn_msg_hdl *const learn_msg_hdl, const void *cookie) {
+          auto listener = static_cast<ProgressListener *>(const_cast<void *>(cookie));
+          for (auto &digest : learnData) {
+            uint64_t robot_id = 0, actual = 0, next = 0, end = 0;
+            digest->getValue(digest_robot_id_field, &robot_id);
+            digest->getValue(digest_actual_bunny_field, &actual);
+            digest->getValue(digest_next_bunny_field, &next);
+            digest->getValue(digest_end_time_field, &end);
+            robot_progress_t progress;
+            progress.actual_bunny = static_cast<bunny_id_t>(actual);
+            progress.next_bunny = static_cast<bunny_id_t>(next);
+            progress.end_time = static_cast<p4_time_t>(end);
+            listener->progress(static_cast<robot_id_t>(robot_id), progress);
+          }
+          return progressDigest->bfRtLearnNotifyAck(session, learn_msg_hdl);
+        },
+        listener);
+  }
+
+  bf_status_t actualBunnySet(const robot_id_t &robot_id,
+                             const bunny_id_t &bunny_id) override {
+    actualBunnyRegister->keyReset(regKey.get());
+    actualBunnyRegister->dataReset(regData.get());
+
+    auto status = regKey->setValue(reg_index_field,
+                                   static_cast<uint64_t>(robot_id));
+    assert(status == BF_SUCCESS);
+
+    status = regData->setValue(actualBunnyRegister_f1,
+                               static_cast<uint64_t>(bunny_id));
+    assert(status == BF_SUCCESS);
+
+    return forPipes(pipes_.ingressPipes(robot_id), [&](const bf_rt_target_t &target) {
+      return actualBunnyRegister->tableEntryMod(
+          *session_, target, *regKey, *regData);
+    });
+  }
+
+ private:
+  bf_rt_target_t firstPipe(const std::vector<uint32_t> &pipes) const {
+    bf_rt_target_t target = dev_tgt;
+    target.pipe_id = pipes[0];
+    return target;
+  }
+
+  // Add the entry, modify it if it is already installed.
+  bf_status_t entryUpsert(const bfrt::BfRtTable *table,
+                          const bf_rt_target_t &target,
+                          const bfrt::BfRtTableKey &key,
+                          const bfrt::BfRtTableData &data) {
+    auto status = table->tableEntryAdd(*session_, target, key, data);
+    if (status == BF_ALREADY_EXISTS) {
+      status = table->tableEntryMod(*session_, target, key, data);
+    }
+    return status;
+  }
+
+  // Read the entries of the target with the pooled reader of the table and
+  // call f(key, data) for each of them, until it returns false.
+  template <typename F>
+  bf_status_t scan(BfRtEntryReader *reader, const bool &from_hw,
+                   const uint32_t &pipe, const uint32_t &chunk, F f) {
+    if (chunk == 0) {
+      return BF_INVALID_ARG;
+    }
+    bf_rt_target_t target = dev_tgt;
+    target.pipe_id = pipe;
+    reader->begin(session_.get(), target, from_hw, chunk);
+    uint32_t count = 0;
+    do {
+      auto status = reader->next(&count);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      for (uint32_t i = 0; i < count; i++) {
+        if (!f(reader->key(i), reader->data(i))) {
+          return BF_SUCCESS;
+        }
+      }
+    } while (count > 0);
+    return BF_SUCCESS;
+  }
+
+  // Start the sync of every progress register and wait for all of them.
+  bf_status_t registersSync() {
+    {
+      std::lock_guard<std::mutex> guard(sync_lock_);
+      synced_ = 0;
+    }
+    auto done = [this](const bf_rt_target_t &, void *) {
+      std::lock_guard<std::mutex> guard(sync_lock_);
+      synced_++;
+      sync_done_.notify_all();
+    };
+    for (auto &sync : registerSyncs) {
+      auto status = sync.second->registerSyncSet(*session_, dev_tgt, done, nullptr);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      status = sync.first->tableOperationsExecute(*sync.second);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+    }
+    std::unique_lock<std::mutex> guard(sync_lock_);
+    if (!sync_done_.wait_for(guard, std::chrono::seconds(1),
+                             [this] { return synced_ == registerSyncs.size(); })) {
+      return BF_NO_SYS_RESOURCES;
+    }
+    return BF_SUCCESS;
+  }
+
+  // Call f(robot_id, value) for every index of a synced register
+  template <typename F>
+  bf_status_t registerScan(BfRtEntryReader *reader, const bf_rt_id_t &index_field,
+                           const bf_rt_id_t &value_field, F f) {
+    std::vector<uint64_t> values;
+    return scan(reader, false, ALL_PIPES, TABLE_SCAN_CHUNK,
+                [&](const bfrt::BfRtTableKey &key, const bfrt::BfRtTableData &data) {
+                  auto index = keyValue(key, index_field);
+                  if (index >= MAX_ROBOTS) {
+                    return true;
+                  }
+                  auto robot_id = static_cast<robot_id_t>(index);
+                  auto status = data.getValue(value_field, &values);
+                  assert(status == BF_SUCCESS);
+                  size_t pipe = pipes_.registerPipe(robot_id);
+                  f(robot_id, pipe < values.size() ? values[pipe] : 0);
+                  return true;
+                });
+  }
+
+  static uint64_t keyValue(const bfrt::BfRtTableKey &key, const bf_rt_id_t &field) {
+    uint64_t value = 0;
+    auto status = key.getValue(field, &value);
+    assert(status == BF_SUCCESS);
+    return value;
+  }
+
+  static uint64_t dataValue(const bfrt::BfRtTableData &data, const bf_rt_id_t &field) {
+    uint64_t value = 0;
+    auto status = data.getValue(field, &value);
+    assert(status == BF_SUCCESS);
+    return value;
+  }
+
+  // Call f with the target of every pipe, stop at the first error.
+  template <typename F>
+  bf_status_t forPipes(const std::vector<uint32_t> &pipes, F f) {
+    bf_rt_target_t target = dev_tgt;
+    for (auto pipe : pipes) {
+      target.pipe_id = pipe;
+      auto status = f(target);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+    }
+    return BF_SUCCESS;
+  }
+
+  std::shared_ptr<bfrt::BfRtSession> session_;
+  const PipeMap &pipes_;
+
+  std::unique_ptr<bfrt::BfRtTableKey> iTableKey;
+  std::unique_ptr<bfrt::BfRtTableData> iTableData;
+  std::unique_ptr<bfrt::BfRtTableKey> eTableKey;
+  std::unique_ptr<bfrt::BfRtTableData> eTableData;
+  std::unique_ptr<bfrt::BfRtTableKey> rTableKey;
+  std::unique_ptr<bfrt::BfRtTableData> rTableData;
+  std::unique_ptr<bfrt::BfRtTableKey> sTableKey;
+  std::unique_ptr<bfrt::BfRtTableData> sTableData;
+  std::unique_ptr<bfrt::BfRtTableKey> cTableKey;
+  std::unique_ptr<bfrt::BfRtTableData> cTableData;
+  std::unique_ptr<bfrt::BfRtTableKey> fTableKey[NUM_FUNCTIONS];
+  std::unique_ptr<bfrt::BfRtTableData> fTableData[NUM_FUNCTIONS];
+  std::unique_ptr<bfrt::BfRtTableData> vTableData;
+  std::unique_ptr<bfrt::BfRtTableKey> regKey;
+  std::unique_ptr<bfrt::BfRtTableData> regData;
+  BfRtEntryReader iReader;
+  BfRtEntryReader eReader;
+  BfRtEntryReader rReader;
+  BfRtEntryReader actualReader;
+  BfRtEntryReader nextReader;
+  BfRtEntryReader endReader;
+
+  // register syncs of progressRead and their completion callbacks
+  std::vector<std::pair<const bfrt::BfRtTable *,
+                        std::unique_ptr<bfrt::BfRtTableOperations>>> registerSyncs;
+  std::mutex sync_lock_;
+  std::condition_variable sync_done_;
+  uint32_t synced_;
+};
+#endif  // CP_NO_SDE
+
+namespace {
+// The backend used by the functions below, selected in main()
+std::unique_ptr<TableBackend> backend;
+}  // anonymous namespace
+
+bf_status_t iBunny_entry_add(const bunny_key_t &key,
+                             const bunny_data_t &data,
+                             const bool &add) {
+  return backend->iBunnyEntryAdd(key, data, add);
+}
+
+bf_status_t iBunny_entry_delete(const bunny_key_t &key) {
+  return backend->iBunnyEntryDel(key);
+}
+
+bf_status_t eBunny_entry_add(const bunny_key_t &key,
+                             const bunny_target_t &data,
+                             const bool &add) {
+  return backend->eBunnyEntryAdd(key, data, add);
+}
+
+bf_status_t eBunny_entry_delete(const bunny_key_t &key) {
+  return backend->eBunnyEntryDel(key);
+}
+
+// trajectory helpers
+
+// Convert a trajectory point of the protocol to the units of the switch.
+trajectory_point_t bunny_point(const bunny_add_cmd_t &cmd) {
+  trajectory_point_t point;
+  point.robot_id = static_cast<robot_id_t>(cmd.robot_id);
+  point.bunny_id = static_cast<bunny_id_t>(cmd.bunny_id);
+  point.next_id = static_cast<bunny_id_t>(cmd.next_id);
+  point.duration = msec_to_int(cmd.duration);
+  doubles_to_dec(cmd.positions, point.positions, NUM_JOINTS);
+  doubles_to_dec(cmd.speeds, point.speeds, NUM_JOINTS);
+  return point;
+}
+
+// Delete the trajectory points of the robot within [first, last]. Missing
+// entries are skipped like in setup.py:remove_range.
+bf_status_t bunny_range_delete(TableBackend *tables,
+                               const robot_id_t &robot_id,
+                               const bunny_id_t &first,
+                               const bunny_id_t &last) {
+  return tables->bunnyRangeDel(robot_id, first, last);
+}
+
+// Print the installed bunny, bunny_e and railway_switch entries (sw state),
+// like setup.py:dump_bunny_tables. The tables are read in chunks, so a big
+// dump does not hold a single huge driver read.
+bf_status_t bunny_dump(TableBackend *tables, std::ostream &out) {
+  uint64_t count = 0;
+  out<<"bunny: robot bunny -> next_id duration"<<std::endl;
+  auto status = tables->iBunnyScan(false, ALL_PIPES, TABLE_SCAN_CHUNK, [&](const bunny_entry_t &entry) {
+    out<<static_cast<int>(entry.key.robot_id)<<" "<<entry.key.actual_bunny<<" -> "<<entry.data.next_id<<" "
+       <<entry.data.duration<<"\n";
+    count++;
+    return true;
+  });
+  out<<count<<" entries"<<std::endl;
+  if (status != BF_SUCCESS) {
+    return status;
+  }
+
+  count = 0;
+  out<<"bunny_e: robot bunny joint -> tpos tspeed"<<std::endl;
+  status = tables->eBunnyScan(false, ALL_PIPES, TABLE_SCAN_CHUNK, [&](const bunny_e_entry_t &entry) {
+    out<<static_cast<int>(entry.key.robot_id)<<" "<<entry.key.actual_bunny<<" "
+       <<static_cast<int>(entry.key.jointId)<<" -> "<<entry.target.tpos<<" "
+       <<entry.target.tspeed<<"\n";
+    count++;
+    return true;
+  });
+  out<<count<<" entries"<<std::endl;
+  if (status != BF_SUCCESS) {
+    return status;
+  }
+
+  count = 0;
+  out<<"railway_switch: robot from -> to"<<std::endl;
+  status = tables->railwayScan(false, ALL_PIPES, TABLE_SCAN_CHUNK, [&](const railway_entry_t &entry) {
+    out<<static_cast<int>(entry.robot_id)<<" "<<entry.from_id<<" -> "<<entry.to_id<<"\n";
+    count++;
+    return true;
+  });
+  out<<count<<" entries"<<std::endl;
+  return status;
+}
+
+// Trajectory changes of the server (commands 1, 2, 13-17, 20), executed
+// either directly or by the writer pool. An add installs the bunny entry and
+// the 6 bunny_e entries of the point, an already installed point is
+// overwritten. The railway kinds are the stop and switch entries of the
+// rings (first -> last).
+struct write_cmd_t {
+  enum { ADD, RANGE_DELETE, RAILWAY_ADD, RAILWAY_MOD, RAILWAY_DELETE } kind;
+  trajectory_point_t point;
+  robot_id_t robot_id;
+  bunny_id_t first;
+  bunny_id_t last;
+};
+
+bf_status_t write_cmd_execute(TableBackend *tables, const write_cmd_t &cmd) {
+  if (cmd.kind == write_cmd_t::ADD) {
+    auto status = tables->bunnyPointAdd(cmd.point);
+    if (status != BF_SUCCESS) {
+      std::cout<<"ERROR DURING BUNNY ADD: "<<static_cast<int>(cmd.point.robot_id)<<" "<<cmd.point.bunny_id<<" status "<<status<<std::endl;
+    }
+    return status;
+  }
+  if (cmd.kind == write_cmd_t::RAILWAY_ADD) {
+    auto status = tables->railwayEntryAdd(cmd.robot_id, cmd.first, cmd.last);
+    if (status != BF_SUCCESS) {
+      std::cout<<"ERROR DURING RAILWAY SWITCH ADD: status "<<status<<std::endl;
+    }
+    return status;
+  }
+  if (cmd.kind == write_cmd_t::RAILWAY_MOD) {
+    auto status = tables->railwayEntryMod(cmd.robot_id, cmd.first, cmd.last);
+    if (status != BF_SUCCESS) {
+      std::cout<<"ERROR DURING RAILWAY SWITCH MOD: status "<<status<<std::endl;
+    }
+    return status;
+  }
+  if (cmd.kind == write_cmd_t::RAILWAY_DELETE) {
+    auto status = tables->railwayEntryDel(cmd.robot_id, cmd.first);
+    if (status != BF_SUCCESS) {
+      std::cout<<"ERROR DURING RAILWAY SWITCH DELETE: status "<<status<<std::endl;
+    }
+    return status;
+  }
+  auto status = bunny_range_delete(tables, cmd.robot_id, cmd.first, cmd.last);
+  if (status != BF_SUCCESS) {
+    std::cout<<"ERROR DURING RANGE DELETE: status "<<status<<std::endl;
+  }
+  return status;
+}
+
+namespace {
+// Parallel writers of the server, commands 1 and 2 go through the backend of
+// the server thread when not set (--writers 1).
+std::unique_ptr<WriterPool<write_cmd_t>> writers;
+
+// Pipelined uploader of commands 14 and 15 (--pipeline), not set otherwise
+std::unique_ptr<TrajUploader> uploader;
+
+// Register snapshot of commands 16-18 and 21 (--poll-period), not set
+// otherwise
+std::unique_ptr<ProgressPoller> poller;
+
+// Progress digests of the robots (--progress-digest), not set otherwise
+std::unique_ptr<ProgressStream> progress_stream;
+
+// Joint speed limits of the robot classes (command 22), every class starts
+// with --speed-limit on every joint
+SpeedLimits speed_limits;
+double default_speed_limit = DEFAULT_SPEED_LIMIT;
+
+// Weighting functions of the egress (commands 7 and 24)
+FunctionTables function_tables;
+
+// Trajectory windows of the robots (commands 16-18)
+TrajRingManager rings;
+uint32_t ring_size = TRAJ_RING_DEFAULT_SIZE;
+// Taken by the server thread and the progress stream for the rings. Progress
+// older than the last reset of a ring (now_ns) belongs to the previous ring.
+std::mutex rings_lock;
+uint64_t ring_reset_ns[MAX_ROBOTS];
+
+// Simplification of the csv uploads (--simplify)
+SimplifyConfig simplify_config;
+}  // anonymous namespace
+
+void run_test_v2(){
+    // insert 100 000 entry
+    int k = 0;
+    for (k=0;k<100000;k++){
+        bunny_key_t key;
+        bunny_data_t data;
+        bunny_target_t target;
+        bool add = true;
+
+        key.robot_id = 0;
+        key.jointId = k%NUM_JOINTS;
+        key.actual_bunny = k/NUM_JOINTS;
+
+        auto op_status = eBunny_entry_add(key,target,add);
+        assert(op_status==BF_SUCCESS);
+        // one bunny entry per point
+        if (key.jointId == 0) {
+            op_status = iBunny_entry_add(key,data,add);
+            assert(op_status==BF_SUCCESS);
+        }
+    }
+
+    // time insert and remove
+    int i=0;
+    for (int _x=0;_x<20;_x++){
+        // start timer
+        timeval start_time, end_time;
+        gettimeofday(&start_time, NULL);
+        auto status = backend->beginBatch();
+        assert(status==BF_SUCCESS);
+
+        for (int _y=0;_y<10000;_y++){
+            // remove based on i
+            bunny_key_t key0;
+
+            key0.robot_id = 0;
+            key0.jointId = i%NUM_JOINTS;
+            key0.actual_bunny = i/NUM_JOINTS;
+
+            auto op_status = eBunny_entry_delete(key0);
+            assert(op_status==BF_SUCCESS);
+            if (key0.jointId == 0) {
+                op_status = iBunny_entry_delete(key0);
+                assert(op_status==BF_SUCCESS);
+            }
+
+            i++;
+
+            // add based on k  
+            bunny_key_t key;
+            bunny_data_t data;
+            bunny_target_t target;
+            bool add = true;
+
+            key.robot_id = 0;
+            key.jointId = k%NUM_JOINTS;
+            key.actual_bunny = k/NUM_JOINTS;
+
+            op_status = eBunny_entry_add(key,target,add);
+            assert(op_status==BF_SUCCESS);
+            if (key.jointId == 0) {
+                op_status = iBunny_entry_add(key,data,add);
+                assert(op_status==BF_SUCCESS);
+            }
+
+            k++;
+
+        }   
+
+        // stop timer
+        status = backend->endBatch(true);
+        assert(status==BF_SUCCESS);
+        backend->completeOperations();
+
+        gettimeofday(&end_time, NULL);
+        auto diff = ((end_time.tv_sec * 1000000 + end_time.tv_usec) - (start_time.tv_sec * 1000000 + start_time.tv_usec));
+        std::cout<<"removeadd "<<10000<< " "<<_x<<" "<<diff<<std::endl;
+
+    }
+
+}
+
+void run_tests(const int record_count,const int repeat_count){
+    //std::cout << "### insert " << record_count << " records" <<std::endl;
+    
+    for (int i=0;i<repeat_count;i++){
+        //std::cout<<"test "<<i << std::endl;
+        timeval start_time, end_time;
+        //auto start_time = std::chrono::steady_clock::now();
+        gettimeofday(&start_time, NULL);
+
+        auto status = backend->beginBatch();
+        assert(status==BF_SUCCESS);
+        for (int k=0;k<=record_count;k++){
+            bunny_key_t key;
+            bunny_data_t data;
+            bunny_target_t target;
+            bool add = true;
+
+            key.robot_id = i;
+            key.jointId = k%NUM_JOINTS;
+            key.actual_bunny = k/NUM_JOINTS;
+
+            //std::cout <<"add " << i << " "<<k<<std::endl;
+            
+            auto op_status = eBunny_entry_add(key,target,add);
+            
+            assert(op_status==BF_SUCCESS);
+            
+            
+            if (key.jointId == 0) {
+            
+                op_status = iBunny_entry_add(key,data,add);
+            
+                assert(op_status==BF_SUCCESS);
+            
+            }
+        }
+
+        status = backend->endBatch(true);
+        assert(status==BF_SUCCESS);
+        backend->completeOperations();
+
+        //auto end_time = std::chrono::steady_clock::now();
+        gettimeofday(&end_time, NULL);
+        auto diff = ((end_time.tv_sec * 1000000 + end_time.tv_usec) - (start_time.tv_sec * 1000000 + start_time.tv_usec));
+        //std::chrono::duration<double> diff = end_time-start_time;
+        std::cout<<"add "<<record_count<< " "<<i<<" "<<diff<<std::endl;
+        //std::cout << diff.count() << std::endl;
+
+    }
+
+    backend->completeOperations();
 
 
     //std::cout << "### remove  " << record_count << "  records" <<std::endl;
@@ -647,25 +1974,29 @@ void run_tests(const int record_count,const int repeat_count){
         //auto start_time = std::chrono::steady_clock::now();
         gettimeofday(&start_time, NULL);
 
-        auto status = session->beginBatch();
+        auto status = backend->beginBatch();
         assert(status==BF_SUCCESS);
 
         for (int k=0;k<=record_count;k++){
             bunny_key_t key;
 
             key.robot_id = i;
-            key.jointId = k/65536;
-            key.actual_bunny = k%65536;
+            key.jointId = k%NUM_JOINTS;
+            key.actual_bunny = k/NUM_JOINTS;
 
             //std::cout <<"remove " << i << " "<<k<<std::endl;
 
-            iBunny_entry_delete(key);
-            eBunny_entry_delete(key);
+            auto op_status = eBunny_entry_delete(key);
+            assert(op_status==BF_SUCCESS);
+            if (key.jointId == 0) {
+                op_status = iBunny_entry_delete(key);
+                assert(op_status==BF_SUCCESS);
+            }
         }
 
-        status = session->endBatch(true);
+        status = backend->endBatch(true);
         assert(status==BF_SUCCESS);
-        session->sessionCompleteOperations();
+        backend->completeOperations();
 
         //auto end_time = std::chrono::steady_clock::now();
         gettimeofday(&end_time, NULL);
@@ -676,7 +2007,55 @@ void run_tests(const int record_count,const int repeat_count){
 
     }
 
-    session->sessionCompleteOperations();
+    backend->completeOperations();
+
+
+    // same entries again, removed with one bunnyRobotClear per robot
+    for (int i=0;i<repeat_count;i++){
+        auto status = backend->beginBatch();
+        assert(status==BF_SUCCESS);
+        for (int k=0;k<=record_count;k++){
+            bunny_key_t key;
+            bunny_data_t data;
+            bunny_target_t target;
+
+            key.robot_id = i;
+            key.jointId = k%NUM_JOINTS;
+            key.actual_bunny = k/NUM_JOINTS;
+
+            auto op_status = eBunny_entry_add(key,target,true);
+            assert(op_status==BF_SUCCESS);
+            if (key.jointId == 0) {
+                op_status = iBunny_entry_add(key,data,true);
+                assert(op_status==BF_SUCCESS);
+            }
+        }
+        status = backend->endBatch(true);
+        assert(status==BF_SUCCESS);
+        backend->completeOperations();
+    }
+
+    for (int i=0;i<repeat_count;i++){
+        timeval start_time, end_time;
+        gettimeofday(&start_time, NULL);
+
+        std::vector<bunny_id_t> bunny_ids, from_ids;
+        auto op_status = backend->bunnyRobotKeys(i, &bunny_ids, &from_ids);
+        assert(op_status==BF_SUCCESS);
+        auto status = backend->beginBatch();
+        assert(status==BF_SUCCESS);
+        op_status = backend->bunnyRobotClear(i, bunny_ids, from_ids);
+        assert(op_status==BF_SUCCESS);
+        status = backend->endBatch(true);
+        assert(status==BF_SUCCESS);
+        backend->completeOperations();
+
+        gettimeofday(&end_time, NULL);
+        auto diff = ((end_time.tv_sec * 1000000 + end_time.tv_usec) - (start_time.tv_sec * 1000000 + start_time.tv_usec));
+        std::cout<<"clearrobot "<<record_count<< " "<<i<<" "<<diff<<std::endl;
+    }
+
+    backend->completeOperations();
 
 
 }
@@ -687,6 +2066,7 @@ void run_tests(const int record_count,const int repeat_count){
 
 
 
+#ifndef CP_NO_SDE
 // This function adds or modifies an entry in the ipRoute table with "route"
 // action. The workflow is similar for either table entry add or modify
 void ipRoute_entry_add_modify_with_route(const IpRouteKey &ipRoute_key,
@@ -842,7 +2222,8 @@ void ipRoute_entry_delete(const IpRouteKey &ipRoute_key) {
   return;
 }
 
-// Function to iterate over all the entries in the table
+// Function to iterate over all the entries in the table. Reads the whole
+// table at once, BfRtEntryReader reads the bunny tables in chunks.
 void table_iterate() {
   // Table iteration involves the following
   //    1. Use the getFirst API to get the first entry
@@ -914,24 +2295,1011 @@ void table_iterate() {
   }
   return;
 }
+#endif  // CP_NO_SDE
+
+/*******************************************************************************
+ * Trajectory server. Speaks the TCP protocol of setup.py (port 5555), see
+ * client.py and proxy.py for the client side.
+ ******************************************************************************/
+
+// Receive exactly len bytes. Returns false if the client disconnected.
+bool recv_all(int sock, void *buff, size_t len) {
+  auto p = static_cast<char *>(buff);
+  while (len > 0) {
+    auto n = recv(sock, p, len, MSG_WAITALL);
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool recv_int(int sock, int32_t *value) {
+  return recv_all(sock, value, sizeof(*value));
+}
+
+bool recv_uint(int sock, uint32_t *value) {
+  return recv_all(sock, value, sizeof(*value));
+}
+
+// True if the next command is already waiting in the socket buffer.
+bool data_pending(int sock) {
+  pollfd pfd;
+  pfd.fd = sock;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return poll(&pfd, 1, 0) > 0;
+}
+
+// Consecutive add and delete commands are collected into a single batch. The
+// batch is committed when the client stops sending (nothing left in the socket
+// buffer) or when a command arrives that has to see the committed state.
+class CommandBatch {
+ public:
+  CommandBatch() : open_(false), count_(0), status_(BF_SUCCESS) {}
+
+  void begin() {
+    if (!open_) {
+      auto status = backend->beginBatch();
+      assert(status == BF_SUCCESS);
+      gettimeofday(&start_time_, NULL);
+      open_ = true;
+      count_ = 0;
+      status_ = BF_SUCCESS;
+    }
+    count_++;
+  }
+
+  // A command of the open batch failed
+  void fail(const bf_status_t &status) {
+    if (status_ == BF_SUCCESS) {
+      status_ = status;
+    }
+  }
+
+  // Returns the first error of the commands or of the commit
+  bf_status_t end() {
+    if (!open_) {
+      return BF_SUCCESS;
+    }
+    auto status = backend->endBatch(true);
+    if (status == BF_SUCCESS) {
+      status = backend->completeOperations();
+    }
+    if (status != BF_SUCCESS) {
+      std::cout<<"ERROR DURING COMMIT: status "<<status<<std::endl;
+      fail(status);
+    }
+    open_ = false;
+
+    timeval end_time;
+    gettimeofday(&end_time, NULL);
+    auto diff = ((end_time.tv_sec * 1000000 + end_time.tv_usec) - (start_time_.tv_sec * 1000000 + start_time_.tv_usec));
+    std::cout<<"INFO: committed "<<count_<<" commands in "<<diff<<" usec"<<std::endl;
+    return status_;
+  }
+
+ private:
+  bool open_;
+  int count_;
+  bf_status_t status_;
+  timeval start_time_;
+};
+
+// Hand a trajectory change to the writer of its robot, or execute it in the
+// batch of the server thread.
+void write_cmd_submit(CommandBatch *batch, const write_cmd_t &cmd) {
+  if (writers) {
+    writers->submit(cmd.kind == write_cmd_t::ADD ? cmd.point.robot_id : cmd.robot_id, cmd);
+  } else {
+    batch->begin();
+    auto status = write_cmd_execute(backend.get(), cmd);
+    if (status != BF_SUCCESS) {
+      batch->fail(status);
+    }
+  }
+}
+
+// Table changes of the rings, in the same order as the other commands of
+// the robot.
+class ServerRingSink : public TrajRingSink {
+ public:
+  explicit ServerRingSink(CommandBatch *batch) : batch_(batch) {}
+
+  void pointAdd(const trajectory_point_t &point) override {
+    write_cmd_t cmd;
+    cmd.kind = write_cmd_t::ADD;
+    cmd.point = point;
+    write_cmd_submit(batch_, cmd);
+  }
+
+  void rangeDel(const robot_id_t &robot_id, const bunny_id_t &first,
+                const bunny_id_t &last) override {
+    submit(write_cmd_t::RANGE_DELETE, robot_id, first, last);
+  }
+
+  void railwayAdd(const robot_id_t &robot_id, const bunny_id_t &from_id,
+                  const bunny_id_t &to_id) override {
+    submit(write_cmd_t::RAILWAY_ADD, robot_id, from_id, to_id);
+  }
+
+  void railwayMod(const robot_id_t &robot_id, const bunny_id_t &from_id,
+                  const bunny_id_t &to_id) override {
+    submit(write_cmd_t::RAILWAY_MOD, robot_id, from_id, to_id);
+  }
+
+  void railwayDel(const robot_id_t &robot_id, const bunny_id_t &from_id) override {
+    submit(write_cmd_t::RAILWAY_DELETE, robot_id, from_id, from_id);
+  }
+
+ private:
+  void submit(const decltype(write_cmd_t::kind) &kind, const robot_id_t &robot_id,
+              const bunny_id_t &first, const bunny_id_t &last) {
+    write_cmd_t cmd;
+    cmd.kind = kind;
+    cmd.robot_id = robot_id;
+    cmd.first = first;
+    cmd.last = last;
+    write_cmd_submit(batch_, cmd);
+  }
+
+  CommandBatch *batch_;
+};
+
+// The actual bunny of the robot without reading the register: from its last
+// progress digest or the poller snapshot, if newer than the reset of its
+// ring. Within a ring a stale value only reclaims less, the robot never moves
+// back. rings_lock must be held.
+bool ring_actual(const robot_id_t &robot_id, bunny_id_t *actual_id) {
+  robot_progress_t progress;
+  uint64_t stamp = 0;
+  if (progress_stream && progress_stream->get(robot_id, &progress, &stamp) &&
+      stamp > ring_reset_ns[robot_id]) {
+    *actual_id = progress.actual_bunny;
+    return true;
+  }
+  uint64_t age = 0;
+  if (poller && poller->get(robot_id, &progress, &age) &&
+      now_ns() - age > ring_reset_ns[robot_id]) {
+    *actual_id = progress.actual_bunny;
+    return true;
+  }
+  return false;
+}
+
+// Delete the passed points of a managed robot. Returns the number of
+// deleted points. rings_lock must be held.
+uint32_t ring_reclaim(const robot_id_t &robot_id, TrajRingSink *sink) {
+  if (rings.ring(robot_id).capacity == 0) {
+    return 0;
+  }
+  bunny_id_t actual_id = 0;
+  if (ring_actual(robot_id, &actual_id)) {
+    return rings.reclaim(robot_id, actual_id, sink);
+  }
+  auto status = backend->actualBunnyGet(robot_id, &actual_id);
+  if (status != BF_SUCCESS) {
+    std::cout<<"ERROR DURING REGISTER READ: status "<<status<<std::endl;
+    return 0;
+  }
+  return rings.reclaim(robot_id, actual_id, sink);
+}
+
+// Replace the points of the ring after at (-1: the point the robot is on)
+// without stopping the robot: the points are staged, the switch entry is
+// written, then the actual bunny is read again to see whether the robot
+// took it. Every step is committed before the next one, a step that fails
+// to commit before the switch entry rolls the switch back; once the switch
+// entry is committed the switch is always finished. Returns false if the
+// robot stays on its old points. rings_lock must be held.
+bool ring_switch(const robot_id_t &robot_id, int32_t at,
+                 std::vector<trajectory_point_t> *points, CommandBatch *batch) {
+  ServerRingSink sink(batch);
+  // failed commands of the robot's writer since the last commit
+  uint64_t errors = 0;
+  if (writers) {
+    writers->flush(robot_id);
+    errors = writers->errors(robot_id);
+  }
+  auto commit = [&]() -> bool {
+    bool ok = batch->end() == BF_SUCCESS;
+    if (writers) {
+      writers->flush(robot_id);
+      uint64_t now = writers->errors(robot_id);
+      ok = ok && now == errors;
+      errors = now;
+    }
+    return ok;
+  };
+  auto rollback = [&]() {
+    rings.abort(robot_id, &sink);
+    commit();
+    return false;
+  };
+  bunny_id_t actual_id = 0;
+  if (at < 0) {
+    auto status = backend->actualBunnyGet(robot_id, &actual_id);
+    if (status != BF_SUCCESS) {
+      std::cout<<"ERROR DURING REGISTER READ: status "<<status<<std::endl;
+      return false;
+    }
+    at = actual_id;
+  }
+  if (!rings.stage(robot_id, points, &sink)) {
+    return false;
+  }
+  if (!commit()) {
+    std::cout<<"ERROR: staging the points of robot "<<static_cast<int>(robot_id)<<" failed"<<std::endl;
+    return rollback();
+  }
+  if (!rings.switchTo(robot_id, static_cast<bunny_id_t>(at), &sink)) {
+    return rollback();
+  }
+  if (!commit()) {
+    std::cout<<"ERROR: the switch entry of robot "<<static_cast<int>(robot_id)<<" failed"<<std::endl;
+    return rollback();
+  }
+  // The switch entry is live, the switch is always finished: with the
+  // register, else with the last known progress, else as if the robot were
+  // still at the switch point, so the ring never stays half switched.
+  bf_status_t status = BF_SUCCESS;
+  for (int attempt = 0; attempt < 3; attempt++) {
+    status = backend->actualBunnyGet(robot_id, &actual_id);
+    if (status == BF_SUCCESS) {
+      break;
+    }
+    std::cout<<"ERROR DURING REGISTER READ: status "<<status<<std::endl;
+  }
+  if (status != BF_SUCCESS && !ring_actual(robot_id, &actual_id)) {
+    std::cout<<"WARN: no actual bunny of robot "<<static_cast<int>(robot_id)
+             <<", switching at "<<at<<std::endl;
+    actual_id = static_cast<bunny_id_t>(at);
+  }
+  bool switched = rings.finish(robot_id, actual_id, &sink);
+  commit();
+  return switched;
+}
+
+// Handler of the progress stream. With writer threads the passed points of
+// a ring are deleted as soon as the robot moves on, without a command. The
+// register is not read here, the backend belongs to the server thread.
+void ring_progress(const robot_id_t &robot_id, const robot_progress_t &) {
+  if (!writers) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(rings_lock);
+  bunny_id_t actual_id = 0;
+  if (rings.ring(robot_id).capacity > 0 && ring_actual(robot_id, &actual_id)) {
+    ServerRingSink sink(nullptr);
+    rings.reclaim(robot_id, actual_id, &sink);
+  }
+}
+
+// Parse the csv of an upload, through the simplifier with --simplify.
+// Returns the number of emitted points, -1 if the csv is malformed.
+template <typename F>
+int64_t parse_upload(TrajCsvParser *parser, const std::string &csv, const int32_t &rid,
+                     F emit) {
+  if (!simplify_config.enabled) {
+    return parser->parse(csv.data(), csv.size(), emit);
+  }
+  TrajSimplifier simplifier(simplify_config);
+  int64_t points = parser->parse(csv.data(), csv.size(), [&](const trajectory_point_t &point) {
+    simplifier.push(point, emit);
+  });
+  if (points < 0) {
+    return points;
+  }
+  simplifier.finish(emit);
+  auto &stats = simplifier.stats();
+  std::cout<<"INFO: simplified the trajectory of robot "<<rid<<" from "<<stats.points<<" to "
+           <<stats.kept<<" points ("<<stats.ratio()<<"x), max error "<<stats.max_position_error
+           <<" rad, "<<stats.max_speed_error<<" rad/s"<<std::endl;
+  return stats.kept;
+}
+
+// Records of command 13 are received in chunks of this size
+#define TRAJ_RECV_CHUNK 1024
+
+// Serve one client. Returns the closing command (-1: bye, -2: stop server).
+int32_t handle_client(int sock) {
+  CommandBatch batch;
+  int32_t cmd = -1;
+  std::vector<traj_record_t> records;
+  std::string csv;
+  std::vector<trajectory_point_t> points;
+  ServerRingSink ring_sink(&batch);
+
+  // Execute a trajectory change or hand it to its writer.
+  auto write_point = [&](const trajectory_point_t &point) {
+    ring_sink.pointAdd(point);
+  };
+
+  while (recv_int(sock, &cmd) && cmd > 0) {
+    if (cmd != 1 && cmd != 2 && cmd != 13 && cmd != 15 && cmd != 20) {
+      batch.end();
+    }
+
+    if (cmd == 1) {
+      bunny_add_cmd_t bunny;
+      if (!recv_all(sock, &bunny, sizeof(bunny))) {
+        break;
+      }
+      write_point(bunny_point(bunny));
+    } else if (cmd == 13) {
+      // binary trajectory records (traj_file.hpp) of a robot
+      int32_t rid, shift;
+      uint32_t count;
+      if (!recv_int(sock, &rid) || !recv_int(sock, &shift) || !recv_uint(sock, &count)) {
+        break;
+      }
+      records.resize(TRAJ_RECV_CHUNK);
+      bool ok = true;
+      trajectory_point_t point;
+      for (uint32_t done = 0; ok && done < count;) {
+        uint32_t n = std::min<uint32_t>(count - done, TRAJ_RECV_CHUNK);
+        ok = recv_all(sock, records.data(), n * sizeof(traj_record_t));
+        for (uint32_t i = 0; ok && i < n; i++) {
+          traj_record_point(records[i], rid, shift, &point);
+          write_point(point);
+        }
+        done += n;
+      }
+      if (!ok) {
+        break;
+      }
+      std::cout<<"INFO: received "<<count<<" points of robot "<<rid<<std::endl;
+    } else if (cmd == 14) {
+      // install a binary trajectory file of the server host, replies the
+      // number of installed points or -1
+      int32_t rid, shift;
+      uint32_t len;
+      if (!recv_int(sock, &rid) || !recv_int(sock, &shift) || !recv_uint(sock, &len) || len > 4096) {
+        break;
+      }
+      std::string path(len, '\0');
+      if (!recv_all(sock, &path[0], len)) {
+        break;
+      }
+      int32_t reply = -1;
+      TrajFile file;
+      if (file.open(path)) {
+        auto install = [&](const TrajUploader::Emit &emit) -> int64_t {
+          trajectory_point_t point;
+          for (uint32_t i = 0; i < file.count(); i++) {
+            traj_record_point(file.records()[i], rid, shift, &point);
+            emit(point);
+          }
+          return file.count();
+        };
+        if (uploader) {
+          if (writers) {
+            writers->flush(rid);
+          }
+          auto status = uploader->submit(install).get();
+          if (status != BF_SUCCESS) {
+            std::cout<<"ERROR DURING UPLOAD: status "<<status<<std::endl;
+          }
+        } else {
+          install(write_point);
+          batch.end();
+          if (writers) {
+            writers->flush(rid);
+          }
+        }
+        reply = file.count();
+        std::cout<<"INFO: loaded "<<reply<<" points of robot "<<rid<<" from "<<path<<std::endl;
+      }
+      if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        break;
+      }
+    } else if (cmd == 15) {
+      // trajectory csv of a robot (trajs.csv layout, with header line)
+      int32_t rid, shift;
+      uint32_t len;
+      if (!recv_int(sock, &rid) || !recv_int(sock, &shift) || !recv_uint(sock, &len)) {
+        break;
+      }
+      csv.resize(len);
+      if (!recv_all(sock, &csv[0], len)) {
+        break;
+      }
+      TrajCsvParser parser(rid, shift);
+      int64_t points = 0;
+      if (uploader) {
+        // keep the order with the earlier commands of the robot
+        batch.end();
+        if (writers) {
+          writers->flush(rid);
+        }
+        auto status = uploader->submit([&](const TrajUploader::Emit &emit) {
+          points = parse_upload(&parser, csv, rid, emit);
+          return points;
+        }).get();
+        if (status != BF_SUCCESS && points >= 0) {
+          std::cout<<"ERROR DURING UPLOAD: status "<<status<<std::endl;
+        }
+      } else {
+        points = parse_upload(&parser, csv, rid, write_point);
+      }
+      if (points < 0) {
+        std::cout<<"ERROR: malformed trajectory csv of robot "<<rid<<std::endl;
+      } else {
+        std::cout<<"INFO: parsed "<<points<<" points of robot "<<rid<<std::endl;
+      }
+    } else if (cmd == 19) {
+      // replace the trajectory of a robot with a replanned csv (like command
+      // 15), only the changed entries are written. Replies the number of
+      // written entries or -1.
+      int32_t rid, shift;
+      uint32_t len;
+      if (!recv_int(sock, &rid) || !recv_int(sock, &shift) || !recv_uint(sock, &len)) {
+        break;
+      }
+      csv.resize(len);
+      if (!recv_all(sock, &csv[0], len)) {
+        break;
+      }
+      points.clear();
+      TrajCsvParser parser(rid, shift);
+      int32_t reply = parse_upload(&parser, csv, rid, [&](const trajectory_point_t &point) {
+        points.push_back(point);
+      });
+      if (reply < 0 || rid < 0 || rid >= MAX_ROBOTS) {
+        std::cout<<"ERROR: malformed trajectory csv of robot "<<rid<<std::endl;
+        reply = -1;
+      } else {
+        if (writers) {
+          writers->flush(rid);
+        }
+        DeltaStats stats;
+        auto status = DeltaUploader(backend.get()).upload(points, &stats);
+        if (status != BF_SUCCESS) {
+          std::cout<<"ERROR DURING DELTA UPLOAD: status "<<status<<std::endl;
+          reply = -1;
+        } else {
+          reply = stats.adds + stats.mods + stats.dels;
+          std::cout<<"INFO: delta upload of robot "<<rid<<": "<<stats.adds<<" added, "<<stats.mods
+                   <<" modified, "<<stats.dels<<" deleted, "<<stats.unchanged<<" unchanged entries"<<std::endl;
+        }
+      }
+      if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        break;
+      }
+    } else if (cmd == 16) {
+      // reset the ring of a robot to a quota of points (0: --ring-size),
+      // the robot is set to the first id
+      int32_t rid;
+      uint32_t quota;
+      if (!recv_int(sock, &rid) || !recv_uint(sock, &quota)) {
+        break;
+      }
+      if (quota == 0) {
+        quota = ring_size;
+      }
+      std::lock_guard<std::mutex> guard(rings_lock);
+      if (rid < 0 || rid >= MAX_ROBOTS || !rings.reset(rid, quota, &ring_sink)) {
+        std::cout<<"WARN: invalid ring "<<rid<<" of "<<quota<<" points, "
+                 <<(rid >= 0 && rid < MAX_ROBOTS ? rings.quotas().available(rid) : 0)
+                 <<" available in the tables"<<std::endl;
+      } else {
+        batch.end();
+        if (writers) {
+          writers->flush(rid);
+        }
+        auto status = backend->actualBunnySet(rid, 0);
+        if (status != BF_SUCCESS) {
+          std::cout<<"ERROR DURING REGISTER WRITE: status "<<status<<std::endl;
+        }
+        ring_reset_ns[rid] = now_ns();
+        std::cout<<"INFO: ring of robot "<<rid<<" reset to "<<quota<<" points"<<std::endl;
+      }
+    } else if (cmd == 17) {
+      // append a trajectory csv (like command 15) to the ring of a robot,
+      // replies the number of appended points or -1 if the ring is full
+      int32_t rid;
+      uint32_t len;
+      if (!recv_int(sock, &rid) || !recv_uint(sock, &len)) {
+        break;
+      }
+      csv.resize(len);
+      if (!recv_all(sock, &csv[0], len)) {
+        break;
+      }
+      points.clear();
+      TrajCsvParser parser(rid, 0);
+      int32_t reply = parse_upload(&parser, csv, rid, [&](const trajectory_point_t &point) {
+        points.push_back(point);
+      });
+      if (reply < 0) {
+        std::cout<<"ERROR: malformed trajectory csv of robot "<<rid<<std::endl;
+      } else if (rid < 0 || rid >= MAX_ROBOTS || rings.ring(rid).capacity == 0) {
+        std::cout<<"WARN: robot "<<rid<<" has no ring"<<std::endl;
+        reply = -1;
+      } else {
+        std::lock_guard<std::mutex> guard(rings_lock);
+        auto reclaimed = ring_reclaim(rid, &ring_sink);
+        if (rings.append(rid, &points, &ring_sink)) {
+          auto &ring = rings.ring(rid);
+          std::cout<<"INFO: ring of robot "<<rid<<": reclaimed "<<reclaimed<<", appended "<<reply
+                   <<", window ["<<ring.start<<","<<ring.end<<") of "<<ring.size<<" points"<<std::endl;
+        } else {
+          std::cout<<"WARN: ring of robot "<<rid<<" is full, "<<reply<<" points rejected"<<std::endl;
+          reply = -1;
+        }
+      }
+      if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        break;
+      }
+    } else if (cmd == 25) {
+      // replace the points of the ring of a robot after a point (-1: the
+      // point the robot is on) with a trajectory csv while the robot keeps
+      // moving, replies the number of new points or -1 if the robot stays
+      // on the old ones
+      int32_t rid, at;
+      uint32_t len;
+      if (!recv_int(sock, &rid) || !recv_int(sock, &at) || !recv_uint(sock, &len)) {
+        break;
+      }
+      csv.resize(len);
+      if (!recv_all(sock, &csv[0], len)) {
+        break;
+      }
+      points.clear();
+      TrajCsvParser parser(rid, 0);
+      int32_t reply = parse_upload(&parser, csv, rid, [&](const trajectory_point_t &point) {
+        points.push_back(point);
+      });
+      if (reply < 0) {
+        std::cout<<"ERROR: malformed trajectory csv of robot "<<rid<<std::endl;
+      } else if (rid < 0 || rid >= MAX_ROBOTS || rings.ring(rid).capacity == 0) {
+        std::cout<<"WARN: robot "<<rid<<" has no ring"<<std::endl;
+        reply = -1;
+      } else {
+        std::lock_guard<std::mutex> guard(rings_lock);
+        auto reclaimed = ring_reclaim(rid, &ring_sink);
+        if (ring_switch(rid, at, &points, &batch)) {
+          auto &ring = rings.ring(rid);
+          std::cout<<"INFO: ring of robot "<<rid<<": reclaimed "<<reclaimed<<", switched to "
+                   <<reply<<" points, window ["<<ring.start<<","<<ring.end<<")"<<std::endl;
+        } else {
+          std::cout<<"WARN: ring of robot "<<rid<<" not switched, "<<reply<<" points rejected"
+                   <<std::endl;
+          reply = -1;
+        }
+      }
+      if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        break;
+      }
+    } else if (cmd == 18) {
+      // reclaim the passed points of every ring, replies the number of
+      // deleted points
+      int32_t reply = 0;
+      std::lock_guard<std::mutex> guard(rings_lock);
+      for (int rid = 0; rid < MAX_ROBOTS; rid++) {
+        reply += ring_reclaim(rid, &ring_sink);
+      }
+      if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        break;
+      }
+    } else if (cmd == 2) {
+      int32_t rid, first, last;
+      if (!recv_int(sock, &rid) || !recv_int(sock, &first) || !recv_int(sock, &last)) {
+        break;
+      }
+      std::cout<<"INFO: Delete bunny range. "<<rid<<"["<<first<<","<<last<<"]"<<std::endl;
+      if (first < 0 || last < first) {
+        std::cout<<"WARN: invalid range"<<std::endl;
+      } else {
+        ring_sink.rangeDel(rid, first, last);
+      }
+    } else if (cmd == 20) {
+      // every entry of one robot, its ring is dropped as well
+      int32_t rid;
+      if (!recv_int(sock, &rid)) {
+        break;
+      }
+      std::cout<<"INFO: Clear robot "<<rid<<std::endl;
+      if (rid < 0 || rid >= MAX_ROBOTS) {
+        std::cout<<"WARN: invalid robot"<<std::endl;
+      } else {
+        bool managed = false;
+        {
+          // a ring knows the entries of its robot, its window is deleted
+          std::lock_guard<std::mutex> guard(rings_lock);
+          managed = rings.ring(rid).capacity > 0;
+          rings.remove(rid, &ring_sink);
+        }
+        if (!managed) {
+          // the keys are read before the batch that deletes them
+          batch.end();
+          if (writers) {
+            writers->flush(rid);
+          }
+          std::vector<bunny_id_t> bunny_ids, from_ids;
+          auto status = backend->bunnyRobotKeys(rid, &bunny_ids, &from_ids);
+          if (status != BF_SUCCESS) {
+            std::cout<<"ERROR DURING ROBOT CLEAR: "<<rid<<" status "<<status<<std::endl;
+          } else {
+            bunny_id_runs(bunny_ids, [&](const bunny_id_t &first, const bunny_id_t &last) {
+              ring_sink.rangeDel(rid, first, last);
+            });
+            for (auto from_id : from_ids) {
+              ring_sink.railwayDel(rid, from_id);
+            }
+          }
+        }
+      }
+    } else if (cmd == 3) {
+      std::cout<<"INFO: Clear every bunny."<<std::endl;
+      if (writers) {
+        writers->flush();
+      }
+      auto status = backend->bunnyClear();
+      if (status != BF_SUCCESS) {
+        std::cout<<"ERROR DURING CLEAR: status "<<status<<std::endl;
+      }
+    } else if (cmd == 5) {
+      std::cout<<"INFO: Dump bunny data."<<std::endl;
+      if (writers) {
+        writers->flush();
+      }
+      auto status = bunny_dump(backend.get(), std::cout);
+      if (status != BF_SUCCESS) {
+        std::cout<<"ERROR DURING DUMP: status "<<status<<std::endl;
+      }
+    } else if (cmd == 7) {
+      // every input of the weighting functions passes unchanged
+      batch.end();
+      auto status = function_tables.clear(backend.get());
+      if (status != BF_SUCCESS) {
+        std::cout<<"ERROR DURING FUNCTION CLEAR: status "<<status<<std::endl;
+      } else {
+        std::cout<<"INFO: functions cleared"<<std::endl;
+      }
+    } else if (cmd == 8) {
+      // single entries of client.py, cp compiles the functions itself
+      // (command 24), only keep the stream in sync
+      char buff[32];
+      if (!recv_all(sock, buff, sizeof(buff))) {
+        break;
+      }
+      std::cout<<"WARN: command 8 is not supported by cp, use 24"<<std::endl;
+    } else if (cmd == 9) {
+      int32_t rid;
+      if (!recv_int(sock, &rid)) {
+        break;
+      }
+      if (writers) {
+        writers->flush(rid);
+      }
+      bunny_id_t bunny_id = 0;
+      auto status = backend->actualBunnyGet(rid, &bunny_id);
+      if (status != BF_SUCCESS) {
+        std::cout<<"ERROR DURING REGISTER READ: status "<<status<<std::endl;
+      }
+      uint32_t reply = bunny_id;
+      if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        break;
+      }
+    } else if (cmd == 21) {
+      // actual_bunny, next_bunny, end_time and the age of the values in us,
+      // from the last digest, the snapshot of the poller or read on demand
+      int32_t rid;
+      if (!recv_int(sock, &rid)) {
+        break;
+      }
+      uint32_t reply[4] = {0, 0, 0, 0};
+      if (rid < 0 || rid >= MAX_ROBOTS) {
+        std::cout<<"WARN: invalid robot"<<std::endl;
+      } else {
+        robot_progress_t progress;
+        uint64_t age_ns = 0;
+        uint64_t stamp = 0;
+        if (progress_stream && progress_stream->get(rid, &progress, &stamp)) {
+          age_ns = now_ns() - stamp;
+        } else if (!poller || !poller->get(rid, &progress, &age_ns)) {
+          batch.end();
+          std::vector<robot_progress_t> all(MAX_ROBOTS);
+          auto status = backend->progressRead(all.data());
+          if (status != BF_SUCCESS) {
+            std::cout<<"ERROR DURING REGISTER READ: status "<<status<<std::endl;
+          }
+          progress = all[rid];
+        }
+        reply[0] = progress.actual_bunny;
+        reply[1] = progress.next_bunny;
+        reply[2] = progress.end_time;
+        reply[3] = static_cast<uint32_t>(std::min<uint64_t>(age_ns / 1000, UINT32_MAX));
+      }
+      if (send(sock, reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        break;
+      }
+    } else if (cmd == 22) {
+      // replace the joint speed limits (rad/s, 0: no limit) of a robot class,
+      // replies the number of written speed_limit entries, -1 on an error
+      int32_t robot_class;
+      double limits[NUM_JOINTS];
+      if (!recv_int(sock, &robot_class) || !recv_all(sock, limits, sizeof(limits))) {
+        break;
+      }
+      int32_t reply = -1;
+      if (robot_class < 0 || robot_class >= NUM_ROBOT_CLASSES) {
+        std::cout<<"WARN: invalid robot class "<<robot_class<<std::endl;
+      } else {
+        batch.end();
+        SpeedLimitStats stats;
+        auto start = now_ns();
+        auto status = speed_limits.set(backend.get(), robot_class, limits, &stats);
+        if (status != BF_SUCCESS) {
+          std::cout<<"ERROR DURING SPEED LIMIT UPDATE: status "<<status<<std::endl;
+        } else {
+          reply = stats.adds + stats.mods + stats.dels;
+          std::cout<<"INFO: speed limits of class "<<robot_class<<" set in "
+                   <<(now_ns() - start) / 1000<<" us: "<<stats.adds<<" added, "<<stats.mods
+                   <<" modified, "<<stats.dels<<" deleted, "<<stats.unchanged
+                   <<" unchanged entries"<<std::endl;
+        }
+      }
+      if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        break;
+      }
+    } else if (cmd == 23) {
+      // the speed limits of a robot come from its class (default 0)
+      int32_t rid, robot_class;
+      if (!recv_int(sock, &rid) || !recv_int(sock, &robot_class)) {
+        break;
+      }
+      if (rid < 0 || rid >= MAX_ROBOTS || robot_class < 0 || robot_class >= NUM_ROBOT_CLASSES) {
+        std::cout<<"WARN: invalid robot "<<rid<<" or class "<<robot_class<<std::endl;
+      } else {
+        batch.end();
+        auto status = backend->robotClassSet(rid, robot_class);
+        if (status != BF_SUCCESS) {
+          std::cout<<"ERROR DURING ROBOT CLASS SET: status "<<status<<std::endl;
+        } else {
+          std::cout<<"INFO: robot "<<rid<<" is of class "<<robot_class<<std::endl;
+        }
+      }
+    } else if (cmd == 24) {
+      // weights of the actual speed, target speed and position difference
+      // functions and the precision of the inputs, replies the number of
+      // installed entries, -1 on an error
+      double weights[NUM_FUNCTIONS];
+      uint32_t precision;
+      if (!recv_all(sock, weights, sizeof(weights)) || !recv_uint(sock, &precision)) {
+        break;
+      }
+      // the order of the protocol is the order of FUNCTION_*
+      batch.end();
+      FunctionStats stats;
+      auto start = now_ns();
+      int32_t reply = -1;
+      auto status = function_tables.set(backend.get(), weights, precision, &stats);
+      if (status != BF_SUCCESS) {
+        std::cout<<"ERROR DURING FUNCTION UPDATE: status "<<status<<std::endl;
+      } else {
+        reply = stats.adds;
+        std::cout<<"INFO: functions of version "<<static_cast<int>(function_tables.version())
+                 <<" set in "<<(now_ns() - start) / 1000<<" us: "<<stats.prefixes
+                 <<" prefixes, "<<stats.adds<<" added, "<<stats.dels<<" deleted entries"
+                 <<std::endl;
+      }
+      if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        break;
+      }
+    } else if (cmd == 10) {
+      int32_t rid;
+      uint32_t from_id, to_id;
+      if (!recv_int(sock, &rid) || !recv_uint(sock, &from_id) || !recv_uint(sock, &to_id)) {
+        break;
+      }
+      if (writers) {
+        writers->flush(rid);
+      }
+      std::cout<<"INFO: set railway switch "<<rid<<" "<<from_id<<" -> "<<to_id<<std::endl;
+      auto status = backend->railwayEntryAdd(rid, from_id, to_id);
+      if (status != BF_SUCCESS) {
+        std::cout<<"ERROR DURING RAILWAY SWITCH ADD: status "<<status<<std::endl;
+      }
+    } else if (cmd == 11) {
+      int32_t rid;
+      uint32_t from_id;
+      if (!recv_int(sock, &rid) || !recv_uint(sock, &from_id)) {
+        break;
+      }
+      if (writers) {
+        writers->flush(rid);
+      }
+      std::cout<<"INFO: unset railway switch "<<rid<<" "<<from_id<<std::endl;
+      auto status = backend->railwayEntryDel(rid, from_id);
+      if (status != BF_SUCCESS) {
+        std::cout<<"ERROR DURING RAILWAY SWITCH DELETE: status "<<status<<std::endl;
+      }
+    } else if (cmd == 12) {
+      int32_t rid;
+      uint32_t bunny_id;
+      if (!recv_int(sock, &rid) || !recv_uint(sock, &bunny_id)) {
+        break;
+      }
+      if (writers) {
+        writers->flush(rid);
+      }
+      auto status = backend->actualBunnySet(rid, bunny_id);
+      if (status != BF_SUCCESS) {
+        std::cout<<"ERROR DURING REGISTER WRITE: status "<<status<<std::endl;
+      }
+      std::cout<<"New actual bunny id: "<<bunny_id<<std::endl;
+    } else {
+      std::cout<<"WARN: invalid command: "<<cmd<<std::endl;
+    }
+
+    // do not keep entries in an open batch while the client is idle
+    if (!data_pending(sock)) {
+      batch.end();
+    }
+  }
+
+  batch.end();
+  if (writers) {
+    writers->flush();
+  }
+  return cmd;
+}
+
+void run_server(const int port) {
+  int server_sock = socket(AF_INET, SOCK_STREAM, 0);
+  assert(server_sock >= 0);
+
+  int yes = 1;
+  setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(server_sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(server_sock, 1) != 0) {
+    perror("ERROR: cannot listen");
+    close(server_sock);
+    return;
+  }
+
+  std::cout<<"READY!"<<std::endl;
+
+  while (true) {
+    int client_sock = accept(server_sock, NULL, NULL);
+    if (client_sock < 0) {
+      perror("ERROR: accept");
+      continue;
+    }
+    std::cout<<"Client connected"<<std::endl;
+
+    auto cmd = handle_client(client_sock);
+
+    close(client_sock);
+    std::cout<<"BYE"<<std::endl;
+    if (cmd == -2) {
+      std::cout<<"STOP SERVER"<<std::endl;
+      break;
+    }
+  }
+
+  close(server_sock);
+}
 
 
 }  // tna_exact_match
 }  // examples
 }  // bfrt
 
-static void parse_options(bf_switchd_context_t *switchd_ctx,
-                          int argc,
-                          char **argv) {
+static char *install_dir = NULL;
+static char *conf_file = NULL;
+static bool server_mode = false;
+static int server_port = SERVER_PORT;
+#ifdef CP_NO_SDE
+static std::string backend_name = "mem";
+#else
+static std::string backend_name = "bfrt";
+#endif
+static bfrt::examples::tna_exact_match::MemLatency mem_latency;
+static uint32_t num_writers = 1;
+static uint32_t writer_batch = 512;
+static bool pipeline = false;
+static bool shadow = false;
+static uint32_t poll_period_us = 0;
+static bool progress_digest = false;
+static uint32_t digest_interval_us = 0;
+static char *pipe_map_file = NULL;
+static uint32_t num_pipes = MAX_PIPES;
+static bool bench_mode = false;
+static bfrt::examples::tna_exact_match::BenchConfig bench_config;
+static bool replay_mode = false;
+static bfrt::examples::tna_exact_match::ReplayConfig replay_config;
+static int udp_port = 0;
+
+static void parse_options(int argc, char **argv) {
   int option_index = 0;
   enum opts {
     OPT_INSTALLDIR = 1,
     OPT_CONFFILE,
+    OPT_SERVER,
+    OPT_PORT,
+    OPT_BACKEND,
+    OPT_MEM_OP_LATENCY,
+    OPT_MEM_COMMIT_LATENCY,
+    OPT_MEM_COMMIT_OP_LATENCY,
+    OPT_WRITERS,
+    OPT_WRITER_BATCH,
+    OPT_RING_SIZE,
+    OPT_PIPELINE,
+    OPT_SHADOW,
+    OPT_POLL_PERIOD,
+    OPT_PROGRESS_DIGEST,
+    OPT_SPEED_LIMIT,
+    OPT_PIPE_MAP,
+    OPT_PIPES,
+    OPT_BENCH,
+    OPT_BENCH_RECORDS,
+    OPT_BENCH_REPEAT,
+    OPT_BENCH_WARMUP,
+    OPT_BENCH_BATCH,
+    OPT_BENCH_ROBOTS,
+    OPT_BENCH_FORMAT,
+    OPT_BENCH_OUTPUT,
+    OPT_BENCH_LABEL,
+    OPT_BENCH_CSV,
+    OPT_REPLAY,
+    OPT_REPLAY_ROBOTS,
+    OPT_REPLAY_RATE,
+    OPT_REPLAY_WEIGHTS,
+    OPT_REPLAY_TIME,
+    OPT_REPLAY_OUTPUT,
+    OPT_UDP_PORT,
+    OPT_SIMPLIFY,
   };
   static struct option options[] = {
       {"help", no_argument, 0, 'h'},
       {"install-dir", required_argument, 0, OPT_INSTALLDIR},
-      {"conf-file", required_argument, 0, OPT_CONFFILE}};
+      {"conf-file", required_argument, 0, OPT_CONFFILE},
+      {"server", no_argument, 0, OPT_SERVER},
+      {"port", required_argument, 0, OPT_PORT},
+      {"backend", required_argument, 0, OPT_BACKEND},
+      {"mem-op-latency", required_argument, 0, OPT_MEM_OP_LATENCY},
+      {"mem-commit-latency", required_argument, 0, OPT_MEM_COMMIT_LATENCY},
+      {"mem-commit-op-latency", required_argument, 0, OPT_MEM_COMMIT_OP_LATENCY},
+      {"writers", required_argument, 0, OPT_WRITERS},
+      {"writer-batch", required_argument, 0, OPT_WRITER_BATCH},
+      {"ring-size", required_argument, 0, OPT_RING_SIZE},
+      {"pipeline", no_argument, 0, OPT_PIPELINE},
+      {"shadow", no_argument, 0, OPT_SHADOW},
+      {"poll-period", required_argument, 0, OPT_POLL_PERIOD},
+      {"progress-digest", required_argument, 0, OPT_PROGRESS_DIGEST},
+      {"speed-limit", required_argument, 0, OPT_SPEED_LIMIT},
+      {"pipe-map", required_argument, 0, OPT_PIPE_MAP},
+      {"pipes", required_argument, 0, OPT_PIPES},
+      {"bench", required_argument, 0, OPT_BENCH},
+      {"bench-records", required_argument, 0, OPT_BENCH_RECORDS},
+      {"bench-repeat", required_argument, 0, OPT_BENCH_REPEAT},
+      {"bench-warmup", required_argument, 0, OPT_BENCH_WARMUP},
+      {"bench-batch", required_argument, 0, OPT_BENCH_BATCH},
+      {"bench-robots", required_argument, 0, OPT_BENCH_ROBOTS},
+      {"bench-format", required_argument, 0, OPT_BENCH_FORMAT},
+      {"bench-output", required_argument, 0, OPT_BENCH_OUTPUT},
+      {"bench-label", required_argument, 0, OPT_BENCH_LABEL},
+      {"bench-csv", required_argument, 0, OPT_BENCH_CSV},
+      {"replay", required_argument, 0, OPT_REPLAY},
+      {"replay-robots", required_argument, 0, OPT_REPLAY_ROBOTS},
+      {"replay-rate", required_argument, 0, OPT_REPLAY_RATE},
+      {"replay-weights", required_argument, 0, OPT_REPLAY_WEIGHTS},
+      {"replay-time", required_argument, 0, OPT_REPLAY_TIME},
+      {"replay-output", required_argument, 0, OPT_REPLAY_OUTPUT},
+      {"udp-port", required_argument, 0, OPT_UDP_PORT},
+      {"simplify", required_argument, 0, OPT_SIMPLIFY},
+      {0, 0, 0, 0}};
 
   while (1) {
     int c = getopt_long(argc, argv, "h", options, &option_index);
@@ -941,12 +3309,175 @@ static void parse_options(bf_switchd_context_t *switchd_ctx,
     }
     switch (c) {
       case OPT_INSTALLDIR:
-        switchd_ctx->install_dir = strdup(optarg);
-        printf("Install Dir: %s\n", switchd_ctx->install_dir);
+        install_dir = strdup(optarg);
+        printf("Install Dir: %s\n", install_dir);
         break;
       case OPT_CONFFILE:
-        switchd_ctx->conf_file = strdup(optarg);
-        printf("Conf-file : %s\n", switchd_ctx->conf_file);
+        conf_file = strdup(optarg);
+        printf("Conf-file : %s\n", conf_file);
+        break;
+      case OPT_SERVER:
+        server_mode = true;
+        break;
+      case OPT_PORT:
+        server_port = atoi(optarg);
+        break;
+      case OPT_BACKEND:
+        backend_name = optarg;
+        break;
+      case OPT_MEM_OP_LATENCY:
+        mem_latency.op_ns = strtoull(optarg, NULL, 10);
+        break;
+      case OPT_MEM_COMMIT_LATENCY:
+        mem_latency.commit_ns = strtoull(optarg, NULL, 10);
+        break;
+      case OPT_MEM_COMMIT_OP_LATENCY:
+        mem_latency.commit_op_ns = strtoull(optarg, NULL, 10);
+        break;
+      case OPT_WRITERS:
+        num_writers = strtoul(optarg, NULL, 10);
+        if (num_writers == 0) {
+          printf("ERROR : invalid number of writers: %s\n", optarg);
+          exit(0);
+        }
+        break;
+      case OPT_WRITER_BATCH:
+        writer_batch = strtoul(optarg, NULL, 10);
+        if (writer_batch == 0) {
+          printf("ERROR : invalid writer batch size: %s\n", optarg);
+          exit(0);
+        }
+        break;
+      case OPT_RING_SIZE:
+        bfrt::examples::tna_exact_match::ring_size = strtoul(optarg, NULL, 10);
+        if (bfrt::examples::tna_exact_match::ring_size < 2 ||
+            bfrt::examples::tna_exact_match::ring_size > BUNNY_POINT_TABLE_SIZE) {
+          printf("ERROR : invalid ring size: %s\n", optarg);
+          exit(0);
+        }
+        break;
+      case OPT_PIPELINE:
+        pipeline = true;
+        break;
+      case OPT_SHADOW:
+        shadow = true;
+        break;
+      case OPT_POLL_PERIOD:
+        poll_period_us = strtoul(optarg, NULL, 10);
+        break;
+      case OPT_PROGRESS_DIGEST:
+        progress_digest = true;
+        digest_interval_us = strtoul(optarg, NULL, 10);
+        break;
+      case OPT_SPEED_LIMIT:
+        bfrt::examples::tna_exact_match::default_speed_limit = strtod(optarg, NULL);
+        if (!(bfrt::examples::tna_exact_match::default_speed_limit >= 0 &&
+              bfrt::examples::tna_exact_match::default_speed_limit < 1e6)) {
+          printf("ERROR : invalid speed limit: %s\n", optarg);
+          exit(0);
+        }
+        break;
+      case OPT_PIPE_MAP:
+        pipe_map_file = strdup(optarg);
+        break;
+      case OPT_PIPES:
+        num_pipes = strtoul(optarg, NULL, 10);
+        if (num_pipes == 0 || num_pipes > MAX_PIPES) {
+          printf("ERROR : invalid number of pipes: %s\n", optarg);
+          exit(0);
+        }
+        break;
+      case OPT_BENCH:
+        bench_mode = true;
+        bench_config.scenarios = bfrt::examples::tna_exact_match::bench_split(optarg);
+        if (bench_config.scenarios.size() > 1 &&
+            std::find(bench_config.scenarios.begin(), bench_config.scenarios.end(),
+                      "legacy") != bench_config.scenarios.end()) {
+          printf("ERROR : legacy runs the old tests alone, it can not be combined: %s\n", optarg);
+          exit(0);
+        }
+        break;
+      case OPT_BENCH_RECORDS:
+        bench_config.records = strtoul(optarg, NULL, 10);
+        break;
+      case OPT_BENCH_REPEAT:
+        bench_config.repeat = strtoul(optarg, NULL, 10);
+        break;
+      case OPT_BENCH_WARMUP:
+        bench_config.warmup = strtoul(optarg, NULL, 10);
+        break;
+      case OPT_BENCH_BATCH:
+        bench_config.batch = strtoul(optarg, NULL, 10);
+        break;
+      case OPT_BENCH_ROBOTS:
+        bench_config.robots = strtoul(optarg, NULL, 10);
+        break;
+      case OPT_BENCH_FORMAT:
+        bench_config.format = optarg;
+        if (bench_config.format != "text" && bench_config.format != "json" &&
+            bench_config.format != "csv") {
+          printf("ERROR : invalid benchmark format: %s\n", optarg);
+          exit(0);
+        }
+        break;
+      case OPT_BENCH_OUTPUT:
+        bench_config.output = optarg;
+        break;
+      case OPT_BENCH_LABEL:
+        bench_config.label = optarg;
+        break;
+      case OPT_BENCH_CSV:
+        bench_config.csv_file = optarg;
+        break;
+      case OPT_REPLAY:
+        replay_mode = true;
+        replay_config.csv_file = optarg;
+        break;
+      case OPT_REPLAY_ROBOTS:
+        replay_config.robots = strtoul(optarg, NULL, 10);
+        if (replay_config.robots == 0 || replay_config.robots > MAX_ROBOTS) {
+          printf("ERROR : invalid number of replay robots: %s\n", optarg);
+          exit(0);
+        }
+        break;
+      case OPT_REPLAY_RATE:
+        replay_config.rate = strtoul(optarg, NULL, 10);
+        if (replay_config.rate == 0) {
+          printf("ERROR : invalid replay rate: %s\n", optarg);
+          exit(0);
+        }
+        break;
+      case OPT_REPLAY_WEIGHTS:
+        if (sscanf(optarg, "%lf,%lf,%lf", &replay_config.weights[FUNCTION_ACTUAL],
+                   &replay_config.weights[FUNCTION_TARGET],
+                   &replay_config.weights[FUNCTION_DIFF]) != 3) {
+          printf("ERROR : invalid replay weights: %s\n", optarg);
+          exit(0);
+        }
+        break;
+      case OPT_REPLAY_TIME:
+        replay_config.max_time = strtod(optarg, NULL);
+        break;
+      case OPT_REPLAY_OUTPUT:
+        replay_config.output = optarg;
+        break;
+      case OPT_SIMPLIFY: {
+        auto &simplify = bfrt::examples::tna_exact_match::simplify_config;
+        if (sscanf(optarg, "%lf,%lf", &simplify.position, &simplify.speed) != 2 ||
+            !(simplify.position >= 0) || !(simplify.speed >= 0)) {
+          printf("ERROR : invalid simplify tolerances: %s\n", optarg);
+          exit(0);
+        }
+        simplify.enabled = true;
+        replay_config.simplify = simplify;
+        break;
+      }
+      case OPT_UDP_PORT:
+        udp_port = atoi(optarg);
+        if (udp_port <= 0 || udp_port > 65535) {
+          printf("ERROR : invalid udp port: %s\n", optarg);
+          exit(0);
+        }
         break;
       case 'h':
       case '?':
@@ -954,7 +3485,38 @@ static void parse_options(bf_switchd_context_t *switchd_ctx,
         printf(
             "Usage : tna_exact_match --install-dir <path to where the SDE is "
             "installed> --conf-file <full path to the conf file "
-            "(tna_exact_match.conf)\n");
+            "(tna_exact_match.conf)\n"
+            "        [--server [--port <tcp port, default 5555>] "
+            "[--writers <n, default 1>] [--writer-batch <commands, default 512>]\n"
+            "         [--ring-size <points per robot, default 1000>] [--pipeline]\n"
+            "         [--poll-period <us, default 0: no register polling>]\n"
+            "         [--progress-digest <min us between the deliveries of a robot>]\n"
+            "         [--speed-limit <rad/s of every joint of every robot class, "
+            "default 3.5, 0: none>]\n"
+            "         [--udp-port <port of the cur_t packets answered by the model of "
+            "ur.p4, mem backend>]\n"
+            "         [--simplify <max position (rad),speed (rad/s) deviation of the "
+            "dropped points of csv uploads>]]\n"
+            "        [--backend <bfrt|mem>] [--shadow]\n"
+            "        [--mem-op-latency <ns>] [--mem-commit-latency <ns>] "
+            "[--mem-commit-op-latency <ns>]\n"
+            "        [--pipe-map <robot to pipe map file>] "
+            "[--pipes <number of pipes, default 4>]\n"
+            "        [--bench <all|insert,delete,range_delete,robot_clear,modify,point,"
+            "pipeline,delta,churn,mixed,readback,readback_hw,scan,scan_hw,\n"
+            "                 progress,progress_single,speed_limit,functions,fixed_point,csv>] "
+            "[--bench legacy]\n"
+            "        [--bench-records <n>] [--bench-repeat <n>] "
+            "[--bench-warmup <n>] [--bench-batch <n, 0: one batch per run>]\n"
+            "        [--bench-robots <n>] [--bench-format <text|json|csv>] "
+            "[--bench-output <file>] [--bench-label <text>]\n"
+            "        [--bench-csv <trajectory csv of the csv scenario, "
+            "default ../trajs.csv>]\n"
+            "        [--replay <trajectory csv> [--replay-robots <n, default 1>] "
+            "[--replay-rate <packets per joint per s, default 500>]\n"
+            "         [--replay-weights <actual,target,diff, default 0,1,1>] "
+            "[--replay-time <max simulated s>] [--replay-output <csv>]]\n"
+            "         (--simplify applies to the replay too)\n");
         exit(c == 'h' ? 0 : 1);
         break;
       default:
@@ -963,12 +3525,35 @@ static void parse_options(bf_switchd_context_t *switchd_ctx,
         break;
     }
   }
-  if (switchd_ctx->install_dir == NULL) {
+
+  bench_config.backend = backend_name + (shadow ? "+shadow" : "");
+  if (backend_name == "mem") {
+    return;
+  }
+  if (replay_mode) {
+    printf("ERROR : --replay runs on the in-memory switch, use --backend mem\n");
+    exit(0);
+  }
+  if (udp_port > 0) {
+    printf("ERROR : --udp-port runs on the in-memory switch, use --backend mem\n");
+    exit(0);
+  }
+#ifdef CP_NO_SDE
+  printf("ERROR : this build only supports --backend mem\n");
+  exit(0);
+#else
+  if (backend_name != "bfrt") {
+    printf("ERROR : invalid backend: %s\n", backend_name.c_str());
+    exit(0);
+  }
+#endif
+
+  if (install_dir == NULL) {
     printf("ERROR : --install-dir must be specified\n");
     exit(0);
   }
 
-  if (switchd_ctx->conf_file == NULL) {
+  if (conf_file == NULL) {
     printf("ERROR : --conf-file must be specified\n");
     exit(0);
   }
@@ -977,39 +3562,241 @@ static void parse_options(bf_switchd_context_t *switchd_ctx,
 
 
 int main(int argc, char **argv) {
-  bf_switchd_context_t *switchd_ctx;
-  if ((switchd_ctx = (bf_switchd_context_t *)calloc(
-           1, sizeof(bf_switchd_context_t))) == NULL) {
-    printf("Cannot Allocate switchd context\n");
+  parse_options(argc, argv);
+  int status = 0;
+
+  static bfrt::examples::tna_exact_match::PipeMap pipe_map(num_pipes);
+  if (pipe_map_file != NULL && !pipe_map.load(pipe_map_file)) {
     exit(1);
   }
-  parse_options(switchd_ctx, argc, argv);
-  switchd_ctx->running_in_background = true;
-  bf_status_t status = bf_switchd_lib_init(switchd_ctx);
-
-  // Do initial set up
-  std::cout<<"################################################## SET UP STARTED"<<std::endl;
-  bfrt::examples::tna_exact_match::setUp();
-  std::cout<<"################################################## SET UP FINISHED"<<std::endl;
-  // Do table level set up
-  std::cout<<"################################################## TABLE SET UP STARTED"<<std::endl;
-  bfrt::examples::tna_exact_match::tableSetUp();
-  std::cout<<"################################################## TABLE SET UP FINISHED"<<std::endl;
-  
-  std::cout<<"################################################## TESTS STARTED"<<std::endl;
-  
-  bfrt::examples::tna_exact_match::run_test_v2();
-
-  for (int i=0;i<50;i++){
-      bfrt::examples::tna_exact_match::run_tests(100,20);
-      bfrt::examples::tna_exact_match::run_tests(1000,20);
-  }
-  for (int i=0;i<100;i++)
-      bfrt::examples::tna_exact_match::run_tests(10000,10);
-  for (int i=0;i<500;i++)  
-      bfrt::examples::tna_exact_match::run_tests(100000,2);
-  std::cout<<"################################################## TESTS FINISHED"<<std::endl;
-  
+  // the ring quotas are reserved in the bunny tables of the pipes of a robot
+  if (pipe_map.asymmetric()) {
+    bfrt::examples::tna_exact_match::rings.setPipes(&pipe_map);
+  }
+
+  // one backend (session) per writer thread
+  std::vector<std::unique_ptr<bfrt::examples::tna_exact_match::TableBackend>> writer_backends;
+  // the two sessions of the pipelined uploader, used by turns
+  std::vector<std::unique_ptr<bfrt::examples::tna_exact_match::TableBackend>> upload_backends;
+  uint32_t num_upload_backends = (!server_mode || pipeline) ? 2 : 0;
+  // the session of the register poller
+  std::unique_ptr<bfrt::examples::tna_exact_match::TableBackend> poller_backend;
+  bool polling = server_mode && poll_period_us > 0;
+  // the session of the progress digest callback
+  std::unique_ptr<bfrt::examples::tna_exact_match::TableBackend> digest_backend;
+
+  // the switch of --replay and --udp-port
+  bfrt::examples::tna_exact_match::MemDevice *mem_device = nullptr;
+
+  if (backend_name == "mem") {
+    std::cout<<"################################################## IN-MEMORY SWITCH"<<std::endl;
+    static bfrt::examples::tna_exact_match::MemDevice device(
+        BUNNY_TABLE_SIZE, RAILWAY_TABLE_SIZE, mem_latency,
+        pipe_map.asymmetric() ? num_pipes : 1);
+    mem_device = &device;
+    bfrt::examples::tna_exact_match::backend.reset(
+        new bfrt::examples::tna_exact_match::MemBackend(&device, pipe_map));
+    for (uint32_t i = 0; num_writers > 1 && i < num_writers; i++) {
+      writer_backends.emplace_back(
+          new bfrt::examples::tna_exact_match::MemBackend(&device, pipe_map));
+    }
+    for (uint32_t i = 0; i < num_upload_backends; i++) {
+      upload_backends.emplace_back(
+          new bfrt::examples::tna_exact_match::MemBackend(&device, pipe_map));
+    }
+    if (polling) {
+      poller_backend.reset(
+          new bfrt::examples::tna_exact_match::MemBackend(&device, pipe_map));
+    }
+    if (server_mode && progress_digest) {
+      digest_backend.reset(
+          new bfrt::examples::tna_exact_match::MemBackend(&device, pipe_map));
+    }
+  }
+#ifndef CP_NO_SDE
+  else {
+    bf_switchd_context_t *switchd_ctx;
+    if ((switchd_ctx = (bf_switchd_context_t *)calloc(
+             1, sizeof(bf_switchd_context_t))) == NULL) {
+      printf("Cannot Allocate switchd context\n");
+      exit(1);
+    }
+    switchd_ctx->install_dir = install_dir;
+    switchd_ctx->conf_file = conf_file;
+    switchd_ctx->running_in_background = true;
+    status = bf_switchd_lib_init(switchd_ctx);
+
+    // Do initial set up
+    std::cout<<"################################################## SET UP STARTED"<<std::endl;
+    bfrt::examples::tna_exact_match::setUp();
+    std::cout<<"################################################## SET UP FINISHED"<<std::endl;
+    // Do table level set up
+    std::cout<<"################################################## TABLE SET UP STARTED"<<std::endl;
+    bfrt::examples::tna_exact_match::tableSetUp();
+    if (pipe_map.asymmetric()) {
+      bfrt::examples::tna_exact_match::tableScopeSetUp();
+    }
+    std::cout<<"################################################## TABLE SET UP FINISHED"<<std::endl;
+
+    bfrt::examples::tna_exact_match::backend.reset(
+        new bfrt::examples::tna_exact_match::BfRtBackend(
+            bfrt::examples::tna_exact_match::session, pipe_map));
+    for (uint32_t i = 0; num_writers > 1 && i < num_writers; i++) {
+      writer_backends.emplace_back(
+          new bfrt::examples::tna_exact_match::BfRtBackend(
+              bfrt::BfRtSession::sessionCreate(), pipe_map));
+    }
+    for (uint32_t i = 0; i < num_upload_backends; i++) {
+      upload_backends.emplace_back(
+          new bfrt::examples::tna_exact_match::BfRtBackend(
+              bfrt::BfRtSession::sessionCreate(), pipe_map));
+    }
+    if (polling) {
+      poller_backend.reset(
+          new bfrt::examples::tna_exact_match::BfRtBackend(
+              bfrt::BfRtSession::sessionCreate(), pipe_map));
+    }
+    if (server_mode && progress_digest) {
+      digest_backend.reset(
+          new bfrt::examples::tna_exact_match::BfRtBackend(
+              bfrt::BfRtSession::sessionCreate(), pipe_map));
+    }
+  }
+#endif
+
+  if (shadow) {
+    // every session writes through the same shadow, which starts empty like
+    // the tables after the clear
+    static bfrt::examples::tna_exact_match::ShadowStore shadow_store;
+    auto wrap = [](std::unique_ptr<bfrt::examples::tna_exact_match::TableBackend> *tables) {
+      tables->reset(new bfrt::examples::tna_exact_match::ShadowBackend(
+          std::move(*tables), &shadow_store));
+    };
+    wrap(&bfrt::examples::tna_exact_match::backend);
+    for (auto &tables : writer_backends) {
+      wrap(&tables);
+    }
+    for (auto &tables : upload_backends) {
+      wrap(&tables);
+    }
+    auto clear_status = bfrt::examples::tna_exact_match::backend->bunnyClear();
+    assert(clear_status == BF_SUCCESS);
+    std::cout<<"INFO: shadow copy of the tables enabled, tables cleared"<<std::endl;
+  }
+
+  if (server_mode || replay_mode) {
+    // speed_limit is empty after the start of the driver
+    double limits[NUM_JOINTS];
+    std::fill(limits, limits + NUM_JOINTS, bfrt::examples::tna_exact_match::default_speed_limit);
+    for (int robot_class = 0; robot_class < NUM_ROBOT_CLASSES; robot_class++) {
+      auto limit_status = bfrt::examples::tna_exact_match::speed_limits.set(
+          bfrt::examples::tna_exact_match::backend.get(), robot_class, limits);
+      assert(limit_status == BF_SUCCESS);
+    }
+    std::cout<<"INFO: joint speed limit "<<bfrt::examples::tna_exact_match::default_speed_limit
+             <<" rad/s, "<<NUM_ROBOT_CLASSES<<" robot classes"<<std::endl;
+  }
+
+  if (replay_mode) {
+    std::cout<<"################################################## REPLAY STARTED"<<std::endl;
+    bfrt::examples::tna_exact_match::UrModel model(mem_device, pipe_map);
+    bfrt::examples::tna_exact_match::Replay replay(
+        bfrt::examples::tna_exact_match::backend.get(), &model, replay_config);
+    if (!replay.run(std::cout)) {
+      status = 1;
+    }
+    std::cout<<"################################################## REPLAY FINISHED"<<std::endl;
+    return status;
+  }
+
+  if (server_mode) {
+    if (!writer_backends.empty()) {
+      bfrt::examples::tna_exact_match::writers.reset(
+          new bfrt::examples::tna_exact_match::WriterPool<bfrt::examples::tna_exact_match::write_cmd_t>(
+              std::move(writer_backends), pipe_map,
+              bfrt::examples::tna_exact_match::write_cmd_execute, 4096, writer_batch));
+      std::cout<<"INFO: "<<num_writers<<" writer threads"<<std::endl;
+    }
+    if (!upload_backends.empty()) {
+      bfrt::examples::tna_exact_match::uploader.reset(
+          new bfrt::examples::tna_exact_match::TrajUploader(
+              std::move(upload_backends), writer_batch));
+      std::cout<<"INFO: pipelined uploads"<<std::endl;
+    }
+    if (poller_backend) {
+      bfrt::examples::tna_exact_match::poller.reset(
+          new bfrt::examples::tna_exact_match::ProgressPoller(
+              std::move(poller_backend), poll_period_us));
+      std::cout<<"INFO: register polling every "<<poll_period_us<<" us"<<std::endl;
+    }
+    if (digest_backend) {
+      bfrt::examples::tna_exact_match::progress_stream.reset(
+          new bfrt::examples::tna_exact_match::ProgressStream(
+              digest_interval_us, bfrt::examples::tna_exact_match::ring_progress));
+      auto listen_status = digest_backend->progressListen(
+          bfrt::examples::tna_exact_match::progress_stream.get());
+      assert(listen_status == BF_SUCCESS);
+      std::cout<<"INFO: progress digests, at most one per robot every "
+               <<digest_interval_us<<" us"<<std::endl;
+    }
+    // the packets of the robots through the tables installed by the clients
+    std::unique_ptr<bfrt::examples::tna_exact_match::UrModel> udp_model;
+    std::unique_ptr<bfrt::examples::tna_exact_match::UdpResponder> udp_responder;
+    if (udp_port > 0) {
+      udp_model.reset(new bfrt::examples::tna_exact_match::UrModel(mem_device, pipe_map));
+      auto model = udp_model.get();
+      udp_responder.reset(new bfrt::examples::tna_exact_match::UdpResponder(
+          static_cast<uint16_t>(udp_port),
+          [model](const bfrt::examples::tna_exact_match::ur_packet_t &packet,
+                  const uint64_t &now_ns) { return model->cur(packet, now_ns).speed; }));
+      if (!udp_responder->ok()) {
+        exit(1);
+      }
+      std::cout<<"INFO: cur_t packets of udp port "<<udp_port<<" answered by the model of ur.p4"
+               <<std::endl;
+    }
+    std::cout<<"################################################## SERVER STARTED"<<std::endl;
+    bfrt::examples::tna_exact_match::run_server(server_port);
+    udp_responder.reset();
+    if (digest_backend) {
+      digest_backend->progressListen(nullptr);
+      bfrt::examples::tna_exact_match::progress_stream.reset();
+    }
+    bfrt::examples::tna_exact_match::poller.reset();
+    bfrt::examples::tna_exact_match::uploader.reset();
+    bfrt::examples::tna_exact_match::writers.reset();
+    std::cout<<"################################################## SERVER STOPPED"<<std::endl;
+    return status;
+  }
+
+  bool legacy = bench_mode && bench_config.scenarios.size() == 1 &&
+                bench_config.scenarios[0] == "legacy";
+  if (legacy) {
+    std::cout<<"################################################## TESTS STARTED"<<std::endl;
+
+    bfrt::examples::tna_exact_match::run_test_v2();
+
+    for (int i=0;i<50;i++){
+        bfrt::examples::tna_exact_match::run_tests(100,20);
+        bfrt::examples::tna_exact_match::run_tests(1000,20);
+    }
+    for (int i=0;i<100;i++)
+        bfrt::examples::tna_exact_match::run_tests(10000,10);
+    for (int i=0;i<500;i++)
+        bfrt::examples::tna_exact_match::run_tests(100000,2);
+    std::cout<<"################################################## TESTS FINISHED"<<std::endl;
+    return status;
+  }
+
+  std::cerr<<"################################################## BENCHMARK STARTED"<<std::endl;
+  bfrt::examples::tna_exact_match::TrajUploader bench_uploader(
+      std::move(upload_backends), bench_config.batch == 0 ? 1024 : bench_config.batch);
+  if (!bfrt::examples::tna_exact_match::run_benchmarks(
+          bfrt::examples::tna_exact_match::backend.get(), bench_config,
+          &bench_uploader)) {
+    status = 1;
+  }
+  std::cerr<<"################################################## BENCHMARK FINISHED"<<std::endl;
+
   return status;
 }
-
@@ -0,0 +1,185 @@
+#ifndef CP_TYPES_HPP
+#define CP_TYPES_HPP
+
+#include <stdint.h>
+
+#ifdef CP_NO_SDE
+// Subset of bf_types/bf_types.h, used when cp is built without the SDE
+typedef int bf_status_t;
+enum {
+  BF_SUCCESS = 0,
+  BF_NO_SYS_RESOURCES = 2,
+  BF_INVALID_ARG = 3,
+  BF_ALREADY_EXISTS = 4,
+  BF_OBJECT_NOT_FOUND = 6,
+  BF_NO_SPACE = 9,
+};
+#else
+#include <bf_types/bf_types.h>
+#endif
+
+#define robot_id_t uint8_t
+#define bunny_id_t uint16_t
+#define joint_id_t uint8_t
+#define p4_time_t uint32_t
+#define dec_t uint64_t
+#define robot_class_t uint8_t
+
+// Keep in sync with params.p4 and the table sizes in ur.p4
+#define MAX_ROBOTS 255
+#define BUNNY_TABLE_SIZE 300000
+#define BUNNY_POINT_TABLE_SIZE (BUNNY_TABLE_SIZE / NUM_JOINTS)
+#define RAILWAY_TABLE_SIZE 1024
+#define NUM_ROBOT_CLASSES 4
+#define SPEED_LIMIT_SIZE 3072
+#define FUNCTION_SIZE 4000
+
+#define NUM_JOINTS 6
+
+// The weighting function tables of SwitchEgress, the order of the weights
+// of command 24
+#define FUNCTION_ACTUAL 0  // actual_speed_function, on hdr.cur.speed
+#define FUNCTION_TARGET 1  // target_speed_function, on eg_md.target_speed
+#define FUNCTION_DIFF 2    // diff_speed_function, on the position difference
+#define NUM_FUNCTIONS 3
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+struct bunny_key_t
+{
+    robot_id_t robot_id;
+    bunny_id_t actual_bunny;
+    joint_id_t jointId;
+};
+
+struct bunny_data_t
+{
+    bunny_id_t next_id;
+    p4_time_t duration;
+    /*action set_target(BUNNY_ID_T next_id,
+                      TIME_T duration){...} */
+};
+
+
+struct bunny_target_t
+{
+    dec_t tpos;
+    dec_t tspeed;
+};
+
+// One point of a trajectory: the bunny and the 6 bunny_e entries of bunny_id,
+// already converted to the units of the switch.
+struct trajectory_point_t
+{
+    robot_id_t robot_id;
+    bunny_id_t bunny_id;
+    bunny_id_t next_id;
+    p4_time_t duration;
+    dec_t positions[NUM_JOINTS];
+    dec_t speeds[NUM_JOINTS];
+};
+
+// The cur_t header of a robot packet and the robot id of its UDP port
+struct ur_packet_t
+{
+    robot_id_t robot_id;
+    joint_id_t jointId;
+    dec_t position;
+    dec_t speed;
+};
+
+// Installed entries as read back by the table scans
+struct bunny_entry_t
+{
+    bunny_key_t key;
+    bunny_data_t data;
+};
+
+struct bunny_e_entry_t
+{
+    bunny_key_t key;
+    bunny_target_t target;
+};
+
+struct railway_entry_t
+{
+    robot_id_t robot_id;
+    bunny_id_t from_id;
+    bunny_id_t to_id;
+};
+
+// Progress registers of a robot: r_actual_bunny, r_next_bunny, end_time
+struct robot_progress_t
+{
+    bunny_id_t actual_bunny;
+    bunny_id_t next_bunny;
+    p4_time_t end_time;
+};
+
+// SwitchEgress.speed_limit: speeds of the joint matching value &&& mask are
+// replaced by speed for the robots of robot_class
+struct speed_limit_key_t
+{
+    robot_class_t robot_class;
+    joint_id_t jointId;
+    dec_t value;
+    dec_t mask;
+};
+
+inline bool operator==(const speed_limit_key_t &a, const speed_limit_key_t &b) {
+  return a.robot_class == b.robot_class && a.jointId == b.jointId &&
+         a.value == b.value && a.mask == b.mask;
+}
+
+// class, joint, value, mask
+inline bool operator<(const speed_limit_key_t &a, const speed_limit_key_t &b) {
+  if (a.robot_class != b.robot_class) {
+    return a.robot_class < b.robot_class;
+  }
+  if (a.jointId != b.jointId) {
+    return a.jointId < b.jointId;
+  }
+  if (a.value != b.value) {
+    return a.value < b.value;
+  }
+  return a.mask < b.mask;
+}
+
+struct speed_limit_entry_t
+{
+    speed_limit_key_t key;
+    dec_t speed;
+};
+
+// Entry of a weighting function table: inputs matching value &&& mask are
+// replaced by d while version is the active one
+struct function_key_t
+{
+    uint8_t version;
+    dec_t value;
+    dec_t mask;
+};
+
+struct function_entry_t
+{
+    function_key_t key;
+    dec_t d;
+};
+
+inline bool operator<(const function_key_t &a, const function_key_t &b) {
+  if (a.version != b.version) {
+    return a.version < b.version;
+  }
+  if (a.value != b.value) {
+    return a.value < b.value;
+  }
+  return a.mask < b.mask;
+}
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef EXACT_MATCH_TABLE_HPP
+#define EXACT_MATCH_TABLE_HPP
+
+#include <stdint.h>
+#include <vector>
+
+#include "cp_types.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Open-addressing hash table with linear probing and backward shift deletion.
+// Keys are packed into 64 bits, ~0 marks an empty slot. The number of entries
+// is limited to the table size given to the constructor, like a P4 table with
+// "size = ..." (add returns BF_NO_SPACE when it is full).
+template <typename V>
+class ExactMatchTable {
+ public:
+  static const uint64_t EMPTY = ~0ULL;
+
+  explicit ExactMatchTable(uint32_t size) : size_(size), count_(0) {
+    // keep the load factor below ~0.66
+    uint64_t slots = 16;
+    shift_ = 60;
+    while (slots < static_cast<uint64_t>(size) * 3 / 2) {
+      slots <<= 1;
+      shift_--;
+    }
+    mask_ = slots - 1;
+    keys_.assign(slots, EMPTY);
+    values_.resize(slots);
+  }
+
+  bf_status_t add(const uint64_t &key, const V &value) {
+    uint64_t i = slot(key);
+    if (keys_[i] == key) {
+      return BF_ALREADY_EXISTS;
+    }
+    if (count_ >= size_) {
+      return BF_NO_SPACE;
+    }
+    keys_[i] = key;
+    values_[i] = value;
+    count_++;
+    return BF_SUCCESS;
+  }
+
+  bf_status_t mod(const uint64_t &key, const V &value) {
+    uint64_t i = slot(key);
+    if (keys_[i] != key) {
+      return BF_OBJECT_NOT_FOUND;
+    }
+    values_[i] = value;
+    return BF_SUCCESS;
+  }
+
+  // add or modify
+  bf_status_t set(const uint64_t &key, const V &value) {
+    auto status = mod(key, value);
+    return status == BF_OBJECT_NOT_FOUND ? add(key, value) : status;
+  }
+
+  bf_status_t del(const uint64_t &key) {
+    uint64_t i = slot(key);
+    if (keys_[i] != key) {
+      return BF_OBJECT_NOT_FOUND;
+    }
+    // shift back the following entries of the probe sequence
+    uint64_t j = i;
+    while (true) {
+      j = (j + 1) & mask_;
+      if (keys_[j] == EMPTY) {
+        break;
+      }
+      uint64_t home = hash(keys_[j]);
+      if (((j - home) & mask_) >= ((j - i) & mask_)) {
+        keys_[i] = keys_[j];
+        values_[i] = values_[j];
+        i = j;
+      }
+    }
+    keys_[i] = EMPTY;
+    count_--;
+    return BF_SUCCESS;
+  }
+
+  const V *find(const uint64_t &key) const {
+    uint64_t i = slot(key);
+    return keys_[i] == key ? &values_[i] : nullptr;
+  }
+
+  void clear() {
+    if (count_ > 0) {
+      keys_.assign(keys_.size(), EMPTY);
+      count_ = 0;
+    }
+  }
+
+  // Call f(key, value) for every entry.
+  template <typename F>
+  void forEach(F f) const {
+    for (uint64_t i = 0; i < keys_.size(); i++) {
+      if (keys_[i] != EMPTY) {
+        f(keys_[i], values_[i]);
+      }
+    }
+  }
+
+  // Call f(key, value) for at most count entries, starting at slot first.
+  // Returns the slot to continue from, a scan is done when f was called
+  // less than count times.
+  template <typename F>
+  uint64_t forEachFrom(const uint64_t &first, const uint32_t &count, F f) const {
+    uint64_t i = first;
+    for (uint32_t n = 0; i < keys_.size() && n < count; i++) {
+      if (keys_[i] != EMPTY) {
+        f(keys_[i], values_[i]);
+        n++;
+      }
+    }
+    return i;
+  }
+
+  uint32_t size() const { return size_; }
+  uint32_t count() const { return count_; }
+
+ private:
+  uint64_t hash(const uint64_t &key) const {
+    return (key * 0x9E3779B97F4A7C15ULL) >> shift_;
+  }
+
+  // the slot holding the key or the empty slot where it would be inserted
+  uint64_t slot(const uint64_t &key) const {
+    uint64_t i = hash(key);
+    while (keys_[i] != key && keys_[i] != EMPTY) {
+      i = (i + 1) & mask_;
+    }
+    return i;
+  }
+
+  uint32_t size_;
+  uint32_t count_;
+  uint64_t mask_;
+  int shift_;
+  std::vector<uint64_t> keys_;
+  std::vector<V> values_;
+};
+
+template <typename V>
+const uint64_t ExactMatchTable<V>::EMPTY;
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
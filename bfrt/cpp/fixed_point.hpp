@@ -0,0 +1,108 @@
+#ifndef FIXED_POINT_HPP
+#define FIXED_POINT_HPP
+
+#include <stddef.h>
+#include <climits>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "cp_types.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+/*******************************************************************************
+ * Number formats of the switch, the conversions of setup.py, traj_bin.py and
+ * gen_speed_limit_entries.py:
+ *
+ *   - positions and speeds (dec_t): int(INT_MAX / (16 * 4 * pi) * x), stored
+ *     as the 64 bit two's complement
+ *   - durations and times (p4_time_t): 2^16 ns units, ms * 1000000 // 65536
+ *
+ * Every C++ path that writes these values converts with the functions here.
+ * The static_asserts below hold the results of the Python formulas.
+ ******************************************************************************/
+
+// dec_t units per radian (or radian/s)
+constexpr double DEC_SCALE = INT_MAX / (16 * 4 * M_PI);
+
+// Convert speed and position values to the fixed-point representation of
+// the switch. Same as double_to_dec in setup.py.
+constexpr dec_t double_to_dec(const double &db) {
+  return static_cast<dec_t>(static_cast<int64_t>(DEC_SCALE * db));
+}
+
+// The value of a dec_t, exact up to the truncation of double_to_dec
+constexpr double dec_to_double(const dec_t &dec) {
+  return static_cast<int64_t>(dec) / DEC_SCALE;
+}
+
+// Convert the duration in ms to the switch time unit (2^16 ns).
+constexpr p4_time_t msec_to_int(const uint64_t &m) {
+  return static_cast<p4_time_t>(m * 1000000 / 65536);
+}
+
+// The whole ms of a duration in switch time units
+constexpr uint64_t int_to_msec(const p4_time_t &t) {
+  return static_cast<uint64_t>(t) * 65536 / 1000000;
+}
+
+static_assert(double_to_dec(0.0) == 0, "double_to_dec(0)");
+static_assert(double_to_dec(1.0) == 10680707ULL, "double_to_dec(1)");
+static_assert(double_to_dec(-1.0) == 18446744073698870909ULL, "double_to_dec(-1)");
+static_assert(double_to_dec(0.5) == 5340353ULL, "double_to_dec(0.5)");
+static_assert(double_to_dec(3.0) == 32042122ULL, "double_to_dec(3)");
+static_assert(double_to_dec(M_PI) == 33554431ULL, "double_to_dec(pi)");
+static_assert(double_to_dec(-2.75) == 18446744073680179671ULL, "double_to_dec(-2.75)");
+static_assert(double_to_dec(-0.1234567) == 18446744073708233012ULL, "double_to_dec(-0.1234567)");
+static_assert(double_to_dec(1e-7) == 1, "double_to_dec(1e-7)");
+static_assert(msec_to_int(1) == 15, "msec_to_int(1)");
+static_assert(msec_to_int(1000) == 15258, "msec_to_int(1000)");
+static_assert(msec_to_int(2000) == 30517, "msec_to_int(2000)");
+static_assert(msec_to_int(123456) == 1883789, "msec_to_int(123456)");
+static_assert(int_to_msec(msec_to_int(2000)) == 1999, "int_to_msec");
+
+// out[i] = double_to_dec(in[i]). Two values per step with SSE2: the product
+// is the same double as in the scalar version and pairs within the 32 bit
+// range are truncated with one instruction, the others go through the
+// scalar conversion, so the results are bit-exact.
+inline void doubles_to_dec(const double *in, dec_t *out, const size_t &n) {
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128d scale = _mm_set1_pd(DEC_SCALE);
+  const __m128d limit = _mm_set1_pd(2147483648.0);
+  const __m128d sign = _mm_set1_pd(-0.0);
+  for (; i + 2 <= n; i += 2) {
+    __m128d value = _mm_mul_pd(_mm_loadu_pd(in + i), scale);
+    if (_mm_movemask_pd(_mm_cmplt_pd(_mm_andnot_pd(sign, value), limit)) != 3) {
+      out[i] = double_to_dec(in[i]);
+      out[i + 1] = double_to_dec(in[i + 1]);
+      continue;
+    }
+    __m128i low = _mm_cvttpd_epi32(value);
+    __m128i wide = _mm_unpacklo_epi32(low, _mm_srai_epi32(low, 31));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), wide);
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = double_to_dec(in[i]);
+  }
+}
+
+// out[i] = msec_to_int(in[i]), plain integer arithmetic the compiler can
+// vectorize
+inline void msecs_to_int(const uint64_t *in, p4_time_t *out, const size_t &n) {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = msec_to_int(in[i]);
+  }
+}
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
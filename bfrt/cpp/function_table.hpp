@@ -0,0 +1,260 @@
+#ifndef FUNCTION_TABLE_HPP
+#define FUNCTION_TABLE_HPP
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include "table_backend.hpp"
+
+// Significant bits of the function inputs, get_ternary_entries(..., 4) of
+// client.py
+#define FUNCTION_DEFAULT_PRECISION 4
+#define FUNCTION_MAX_PRECISION 10
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// x * weight of a dec_t, like get_multiplicator of client.py: the product
+// of the doubles truncated toward zero. Saturates where client.py would wrap
+// around (beyond 2^63), and the prefix of INT64_MIN has its true minimum.
+inline dec_t function_weigh(const dec_t &x, const double &weight) {
+  double product = static_cast<double>(static_cast<int64_t>(x)) * weight;
+  if (product >= 9223372036854775807.0) {
+    return static_cast<dec_t>(INT64_MAX);
+  }
+  if (product <= -9223372036854775808.0) {
+    return static_cast<dec_t>(INT64_MIN);
+  }
+  return static_cast<dec_t>(static_cast<int64_t>(product));
+}
+
+// The entries of get_ternary_entries(get_multiplicator(weight), precision)
+// of client.py, in the same order: for every position of the leading 1 of a
+// positive (0 of a negative) input, every value of the next precision bits
+// is a prefix, its output is the weighted minimum of the prefix. Inputs too
+// small for a whole prefix (and 0) match nothing and pass unchanged.
+inline void function_prefix_entries(const double &weight, const uint32_t &precision,
+                                    std::vector<function_entry_t> *entries) {
+  function_entry_t entry;
+  entry.key.version = 0;
+  for (int negative = 0; negative < 2; negative++) {
+    for (uint32_t i = 1; i + precision + 1 < 64; i++) {
+      uint32_t shift = 63 - i - precision;
+      dec_t lead = negative ? ~0ULL << (64 - i) : 1ULL << (63 - i);
+      for (dec_t v = 0; v < (1ULL << precision); v++) {
+        entry.key.value = lead | v << shift;
+        entry.key.mask = ~0ULL << shift;
+        // the minimum of the prefix, trailing 0s in both signs
+        entry.d = function_weigh(entry.key.value, weight);
+        entries->push_back(entry);
+      }
+    }
+  }
+}
+
+// Merge entries with the same output whose keys differ in one bit into one
+// entry not caring about that bit, until no two entries can be merged. The
+// entries must be disjoint; they stay disjoint and match the same inputs
+// with the same outputs, so their priority does not matter.
+inline void function_cover_reduce(std::vector<function_entry_t> *entries) {
+  auto by_group = [](const function_entry_t &a, const function_entry_t &b) {
+    if (a.key.mask != b.key.mask) {
+      return a.key.mask < b.key.mask;
+    }
+    if (a.d != b.d) {
+      return a.d < b.d;
+    }
+    return a.key.value < b.key.value;
+  };
+  std::vector<function_entry_t> merged;
+  std::vector<bool> used;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    std::sort(entries->begin(), entries->end(), by_group);
+    used.assign(entries->size(), false);
+    merged.clear();
+    for (size_t i = 0; i < entries->size(); i++) {
+      if (used[i]) {
+        continue;
+      }
+      const auto &entry = (*entries)[i];
+      // the partner is in the same (mask, d) group, after entry
+      for (int b = 0; b < 64 && !used[i]; b++) {
+        dec_t bit = 1ULL << b;
+        if ((entry.key.mask & bit) == 0 || (entry.key.value & bit) != 0) {
+          continue;
+        }
+        function_entry_t partner = entry;
+        partner.key.value |= bit;
+        auto found = std::lower_bound(entries->begin() + i + 1, entries->end(), partner, by_group);
+        size_t k = found - entries->begin();
+        if (found == entries->end() || used[k] || found->key.mask != entry.key.mask ||
+            found->d != entry.d || found->key.value != partner.key.value) {
+          continue;
+        }
+        used[i] = true;
+        used[k] = true;
+        function_entry_t both = entry;
+        both.key.mask &= ~bit;
+        merged.push_back(both);
+        changed = true;
+      }
+      if (!used[i]) {
+        merged.push_back(entry);
+      }
+    }
+    entries->swap(merged);
+  }
+}
+
+// Entry counts of one FunctionTables::set, summed over the tables
+struct FunctionStats {
+  uint32_t prefixes = 0;  // entries before the reduction
+  uint32_t adds = 0;
+  uint32_t dels = 0;
+};
+
+// The weighting functions of the egress (actual_speed_function,
+// target_speed_function, diff_speed_function). Every entry has a version
+// bit and SwitchEgress.function_version selects the one in use, so new
+// weights are installed in the other version while the old ones work, then
+// a single default action write flips all three tables at once and the old
+// entries are deleted. There is no moment without a function.
+//
+// Not thread-safe, used with the backend of one thread.
+class FunctionTables {
+ public:
+  FunctionTables() : active_(0) {}
+
+  // x -> x * weights[f] for the FUNCTION_* tables with precision significant
+  // bits of the inputs. A version holds at most FUNCTION_SIZE / 2 entries
+  // per table. On an error the active version stays in use.
+  bf_status_t set(TableBackend *tables, const double weights[NUM_FUNCTIONS],
+                  const uint32_t &precision, FunctionStats *stats = nullptr) {
+    if (precision == 0 || precision > FUNCTION_MAX_PRECISION) {
+      return BF_INVALID_ARG;
+    }
+    std::vector<function_entry_t> entries[NUM_FUNCTIONS];
+    FunctionStats counts;
+    for (int f = 0; f < NUM_FUNCTIONS; f++) {
+      if (weights[f] != weights[f]) {
+        return BF_INVALID_ARG;
+      }
+      function_prefix_entries(weights[f], precision, &entries[f]);
+      counts.prefixes += entries[f].size();
+      function_cover_reduce(&entries[f]);
+    }
+    auto status = swap(tables, entries, &counts);
+    if (status == BF_SUCCESS && stats != nullptr) {
+      *stats = counts;
+    }
+    return status;
+  }
+
+  // Swap in empty tables: every input passes unchanged (command 7)
+  bf_status_t clear(TableBackend *tables) {
+    std::vector<function_entry_t> entries[NUM_FUNCTIONS];
+    FunctionStats counts;
+    return swap(tables, entries, &counts);
+  }
+
+  uint8_t version() const { return active_; }
+
+  // Installed entries of the active version of a table
+  size_t size(const uint32_t &function) const {
+    return function < NUM_FUNCTIONS ? installed_[active_][function].size() : 0;
+  }
+
+ private:
+  bf_status_t swap(TableBackend *tables, std::vector<function_entry_t> entries[NUM_FUNCTIONS],
+                   FunctionStats *counts) {
+    uint8_t next = active_ ^ 1;
+    for (int f = 0; f < NUM_FUNCTIONS; f++) {
+      if (entries[f].size() > FUNCTION_SIZE / 2) {
+        return BF_NO_SPACE;
+      }
+    }
+    // left over by a failed swap
+    auto status = remove(tables, next, counts);
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+
+    status = tables->beginBatch();
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    for (int f = 0; f < NUM_FUNCTIONS && status == BF_SUCCESS; f++) {
+      for (auto &entry : entries[f]) {
+        entry.key.version = next;
+        status = tables->functionEntryAdd(f, entry);
+        if (status != BF_SUCCESS) {
+          break;
+        }
+        installed_[next][f].push_back(entry);
+        counts->adds++;
+      }
+    }
+    auto end_status = tables->endBatch(true);
+    if (status == BF_SUCCESS) {
+      status = end_status;
+    }
+    if (status == BF_SUCCESS) {
+      status = tables->functionVersionSet(next);
+    }
+    if (status != BF_SUCCESS) {
+      // the new version was never used
+      remove(tables, next, counts);
+      return status;
+    }
+
+    uint8_t old = active_;
+    active_ = next;
+    // a failure only leaves unused entries, deleted by the next swap
+    remove(tables, old, counts);
+    return BF_SUCCESS;
+  }
+
+  // Delete the installed entries of a version, in one batch
+  bf_status_t remove(TableBackend *tables, const uint8_t &version, FunctionStats *counts) {
+    bool empty = true;
+    for (int f = 0; f < NUM_FUNCTIONS; f++) {
+      empty = empty && installed_[version][f].empty();
+    }
+    if (empty) {
+      return BF_SUCCESS;
+    }
+    auto status = tables->beginBatch();
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    for (int f = 0; f < NUM_FUNCTIONS; f++) {
+      auto &installed = installed_[version][f];
+      while (status == BF_SUCCESS && !installed.empty()) {
+        status = tables->functionEntryDel(f, installed.back().key);
+        if (status == BF_OBJECT_NOT_FOUND) {
+          status = BF_SUCCESS;
+        }
+        if (status == BF_SUCCESS) {
+          installed.pop_back();
+          counts->dels++;
+        }
+      }
+    }
+    auto end_status = tables->endBatch(true);
+    return status != BF_SUCCESS ? status : end_status;
+  }
+
+  uint8_t active_;
+  // by version and table
+  std::vector<function_entry_t> installed_[2][NUM_FUNCTIONS];
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
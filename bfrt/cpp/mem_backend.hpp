@@ -0,0 +1,848 @@
+#ifndef MEM_BACKEND_HPP
+#define MEM_BACKEND_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "exact_match_table.hpp"
+#include "pipe_map.hpp"
+#include "table_backend.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Injected per-operation costs of the in-memory switch. All zero by default.
+struct MemLatency {
+  uint64_t op_ns = 0;        // driver cost of every table operation
+  uint64_t commit_ns = 0;    // fixed cost of pushing a batch to the hardware
+  uint64_t commit_op_ns = 0; // per-operation cost of pushing a batch
+};
+
+inline void busy_wait_ns(const uint64_t &ns) {
+  if (ns == 0) {
+    return;
+  }
+  auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+  while (std::chrono::steady_clock::now() < until) {
+  }
+}
+
+inline uint64_t bunny_key_pack(const bunny_key_t &key) {
+  return (static_cast<uint64_t>(key.robot_id) << 24) |
+         (static_cast<uint64_t>(key.actual_bunny) << 8) |
+         static_cast<uint64_t>(key.jointId);
+}
+
+// The key of SwitchEgress.bunny_e. SwitchIngress.bunny has one entry per
+// point, its keys are packed with joint 0.
+inline uint64_t bunny_point_pack(const bunny_key_t &key) {
+  return (static_cast<uint64_t>(key.robot_id) << 24) |
+         (static_cast<uint64_t>(key.actual_bunny) << 8);
+}
+
+inline bunny_key_t bunny_key_unpack(const uint64_t &packed) {
+  bunny_key_t key;
+  key.robot_id = static_cast<robot_id_t>(packed >> 24);
+  key.actual_bunny = static_cast<bunny_id_t>(packed >> 8);
+  key.jointId = static_cast<joint_id_t>(packed);
+  return key;
+}
+
+inline uint64_t railway_key_pack(const robot_id_t &robot_id,
+                                 const bunny_id_t &from_id) {
+  return (static_cast<uint64_t>(robot_id) << 16) | from_id;
+}
+
+// The tables and registers of ur.p4 that the control plane manages.
+struct MemTables {
+  ExactMatchTable<bunny_data_t> bunny;
+  ExactMatchTable<bunny_target_t> bunny_e;
+  ExactMatchTable<bunny_id_t> railway_switch;
+  // ternary, entry key -> limit
+  std::map<speed_limit_key_t, dec_t> speed_limit;
+  robot_class_t robot_class[MAX_ROBOTS];
+  // ternary, by FUNCTION_*, entry key -> d
+  std::map<function_key_t, dec_t> functions[NUM_FUNCTIONS];
+  uint8_t function_version;
+  // counts the writes of the functions and of their version
+  uint64_t function_generation;
+  bunny_id_t r_actual_bunny[MAX_ROBOTS];
+  // only written by the data plane, stay 0 here
+  bunny_id_t r_next_bunny[MAX_ROBOTS];
+  p4_time_t end_time[MAX_ROBOTS];
+
+  // bunny_table_size is the size of bunny_e, bunny holds a point in one entry
+  MemTables(uint32_t bunny_table_size, uint32_t railway_table_size)
+      : bunny(bunny_table_size / NUM_JOINTS),
+        bunny_e(bunny_table_size),
+        railway_switch(railway_table_size),
+        function_version(0),
+        function_generation(0) {
+    for (int i = 0; i < MAX_ROBOTS; i++) {
+      robot_class[i] = 0;
+      r_actual_bunny[i] = 0;
+      r_next_bunny[i] = 0;
+      end_time[i] = 0;
+    }
+  }
+
+  // The speed egress sends to the robot after SwitchEgress.speed_limit,
+  // the entries of the class and joint are tried one by one
+  dec_t limitSpeed(const robot_id_t &robot_id, const joint_id_t &joint_id,
+                   const dec_t &speed) const {
+    speed_limit_key_t first = {robot_class[robot_id], joint_id, 0, 0};
+    for (auto it = speed_limit.lower_bound(first);
+         it != speed_limit.end() && it->first.robot_class == first.robot_class &&
+         it->first.jointId == joint_id;
+         ++it) {
+      if ((speed & it->first.mask) == it->first.value) {
+        return it->second;
+      }
+    }
+    return speed;
+  }
+
+  // The value of a weighting function for x, the entries of the active
+  // version are tried one by one; no match leaves x unchanged
+  dec_t weigh(const uint32_t &function, const dec_t &x) const {
+    const auto &entries = functions[function];
+    function_key_t first = {function_version, 0, 0};
+    for (auto it = entries.lower_bound(first);
+         it != entries.end() && it->first.version == function_version; ++it) {
+      if ((x & it->first.mask) == it->first.value) {
+        return it->second;
+      }
+    }
+    return x;
+  }
+};
+
+// In-memory stand-in of one switch. Like the driver, it keeps two copies of
+// the state: "sw" is updated (and validated) by every operation immediately,
+// "hw" is what the data plane would see and it only changes when a batch is
+// pushed. Shared by every MemBackend (session) created on it.
+//
+// With one pipe the tables are symmetric, every entry is in every pipe. With
+// more pipes each pipe has its own tables of the full size (asymmetric mode).
+class MemDevice {
+ public:
+  explicit MemDevice(uint32_t bunny_table_size = BUNNY_TABLE_SIZE,
+                     uint32_t railway_table_size = RAILWAY_TABLE_SIZE,
+                     const MemLatency &latency = MemLatency(),
+                     uint32_t num_pipes = 1)
+      : latency(latency) {
+    for (uint32_t pipe = 0; pipe < num_pipes; pipe++) {
+      sw.emplace_back(bunny_table_size, railway_table_size);
+      hw.emplace_back(bunny_table_size, railway_table_size);
+    }
+  }
+
+  // The progress digest ur.p4 sends when the robot moves to a new bunny,
+  // from the registers of pipe. Called with lock held.
+  void notifyProgress(const robot_id_t &robot_id, const uint32_t &pipe) {
+    if (listener == nullptr) {
+      return;
+    }
+    robot_progress_t progress;
+    progress.actual_bunny = hw[pipe].r_actual_bunny[robot_id];
+    progress.next_bunny = hw[pipe].r_next_bunny[robot_id];
+    progress.end_time = hw[pipe].end_time[robot_id];
+    listener->progress(robot_id, progress);
+  }
+
+  // indexed by pipe
+  std::vector<MemTables> sw;
+  std::vector<MemTables> hw;
+  MemLatency latency;
+  std::mutex lock;
+  ProgressListener *listener = nullptr;
+};
+
+// One session on a MemDevice.
+class MemBackend : public TableBackend {
+ public:
+  MemBackend(MemDevice *device, const PipeMap &pipes)
+      : device_(device), pipes_(pipes), batching_(false), transaction_(false) {}
+
+  bf_status_t beginBatch() override {
+    if (batching_) {
+      return BF_INVALID_ARG;
+    }
+    batching_ = true;
+    return BF_SUCCESS;
+  }
+
+  // An asynchronous end only hands the batch over, it is pushed to the hw
+  // state (and its commit cost is paid) by completeOperations.
+  bf_status_t endBatch(bool hw_synchronous) override {
+    if (!batching_) {
+      return BF_INVALID_ARG;
+    }
+    batching_ = false;
+    if (inflight_.empty()) {
+      inflight_.swap(pending_);
+    } else {
+      inflight_.insert(inflight_.end(), pending_.begin(), pending_.end());
+      pending_.clear();
+    }
+    if (hw_synchronous) {
+      push();
+    }
+    return BF_SUCCESS;
+  }
+
+  bf_status_t completeOperations() override {
+    push();
+    return BF_SUCCESS;
+  }
+
+  // A batch is pushed to the hw state under the device lock, so every batch
+  // is atomic here. A transaction also records how to undo its operations
+  // on the sw state.
+  bf_status_t beginTransaction() override {
+    auto status = beginBatch();
+    if (status == BF_SUCCESS) {
+      transaction_ = true;
+    }
+    return status;
+  }
+
+  bf_status_t commitTransaction() override {
+    if (!transaction_) {
+      return BF_INVALID_ARG;
+    }
+    transaction_ = false;
+    undo_.clear();
+    return endBatch(true);
+  }
+
+  bf_status_t abortTransaction() override {
+    if (!transaction_) {
+      return BF_INVALID_ARG;
+    }
+    {
+      std::lock_guard<std::mutex> guard(device_->lock);
+      for (auto op = undo_.rbegin(); op != undo_.rend(); ++op) {
+        apply(&device_->sw[op->pipe], *op, SET);
+      }
+    }
+    undo_.clear();
+    pending_.clear();
+    transaction_ = false;
+    batching_ = false;
+    return BF_SUCCESS;
+  }
+
+  bf_status_t iBunnyEntryAdd(const bunny_key_t &key,
+                             const bunny_data_t &data,
+                             const bool &add) override {
+    MemOp op;
+    op.kind = MemOp::I_SET;
+    op.key = bunny_point_pack(key);
+    op.idata = data;
+    return execute(op, add ? ADD : MOD, pipes_.ingressPipes(key.robot_id));
+  }
+
+  bf_status_t iBunnyEntryDel(const bunny_key_t &key) override {
+    MemOp op;
+    op.kind = MemOp::I_DEL;
+    op.key = bunny_point_pack(key);
+    return execute(op, ADD, pipes_.ingressPipes(key.robot_id));
+  }
+
+  bf_status_t iBunnyEntryGet(const bunny_key_t &key,
+                             const bool &from_hw,
+                             bunny_data_t *data) override {
+    auto tables = pipeTables(from_hw, pipes_.ingressPipes(key.robot_id));
+    if (tables == nullptr) {
+      return BF_INVALID_ARG;
+    }
+    return get(&tables->bunny, bunny_point_pack(key), data);
+  }
+
+  bf_status_t eBunnyEntryAdd(const bunny_key_t &key,
+                             const bunny_target_t &data,
+                             const bool &add) override {
+    MemOp op;
+    op.kind = MemOp::E_SET;
+    op.key = bunny_key_pack(key);
+    op.edata = data;
+    return execute(op, add ? ADD : MOD, pipes_.egressPipes(key.robot_id));
+  }
+
+  bf_status_t eBunnyEntryDel(const bunny_key_t &key) override {
+    MemOp op;
+    op.kind = MemOp::E_DEL;
+    op.key = bunny_key_pack(key);
+    return execute(op, ADD, pipes_.egressPipes(key.robot_id));
+  }
+
+  bf_status_t eBunnyEntryGet(const bunny_key_t &key,
+                             const bool &from_hw,
+                             bunny_target_t *data) override {
+    auto tables = pipeTables(from_hw, pipes_.egressPipes(key.robot_id));
+    if (tables == nullptr) {
+      return BF_INVALID_ARG;
+    }
+    return get(&tables->bunny_e, bunny_key_pack(key), data);
+  }
+
+  bf_status_t railwayEntryAdd(const robot_id_t &robot_id,
+                              const bunny_id_t &from_id,
+                              const bunny_id_t &to_id) override {
+    MemOp op;
+    op.kind = MemOp::R_SET;
+    op.key = railway_key_pack(robot_id, from_id);
+    op.to_id = to_id;
+    return execute(op, ADD, pipes_.ingressPipes(robot_id));
+  }
+
+  bf_status_t railwayEntryMod(const robot_id_t &robot_id,
+                              const bunny_id_t &from_id,
+                              const bunny_id_t &to_id) override {
+    MemOp op;
+    op.kind = MemOp::R_SET;
+    op.key = railway_key_pack(robot_id, from_id);
+    op.to_id = to_id;
+    return execute(op, MOD, pipes_.ingressPipes(robot_id));
+  }
+
+  bf_status_t railwayEntryDel(const robot_id_t &robot_id,
+                              const bunny_id_t &from_id) override {
+    MemOp op;
+    op.kind = MemOp::R_DEL;
+    op.key = railway_key_pack(robot_id, from_id);
+    return execute(op, ADD, pipes_.ingressPipes(robot_id));
+  }
+
+  bf_status_t speedLimitEntryAdd(const speed_limit_entry_t &entry,
+                                 const bool &add) override {
+    MemOp op;
+    op.kind = MemOp::S_SET;
+    op.key = 0;
+    op.sdata = entry;
+    return execute(op, add ? ADD : MOD, pipes_.allPipes());
+  }
+
+  bf_status_t speedLimitEntryDel(const speed_limit_key_t &key) override {
+    MemOp op;
+    op.kind = MemOp::S_DEL;
+    op.key = 0;
+    op.sdata.key = key;
+    return execute(op, ADD, pipes_.allPipes());
+  }
+
+  bf_status_t robotClassSet(const robot_id_t &robot_id,
+                            const robot_class_t &robot_class) override {
+    if (robot_id >= MAX_ROBOTS) {
+      return BF_INVALID_ARG;
+    }
+    MemOp op;
+    op.kind = MemOp::C_SET;
+    op.key = robot_id;
+    op.robot_class = robot_class;
+    return execute(op, ADD, pipes_.allPipes());
+  }
+
+  bf_status_t functionEntryAdd(const uint32_t &function,
+                               const function_entry_t &entry) override {
+    if (function >= NUM_FUNCTIONS) {
+      return BF_INVALID_ARG;
+    }
+    MemOp op;
+    op.kind = MemOp::F_SET;
+    op.key = function;
+    op.fdata = entry;
+    return execute(op, ADD, pipes_.allPipes());
+  }
+
+  bf_status_t functionEntryDel(const uint32_t &function,
+                               const function_key_t &key) override {
+    if (function >= NUM_FUNCTIONS) {
+      return BF_INVALID_ARG;
+    }
+    MemOp op;
+    op.kind = MemOp::F_DEL;
+    op.key = function;
+    op.fdata.key = key;
+    return execute(op, ADD, pipes_.allPipes());
+  }
+
+  bf_status_t functionVersionSet(const uint8_t &version) override {
+    MemOp op;
+    op.kind = MemOp::V_SET;
+    op.key = version;
+    return execute(op, ADD, pipes_.allPipes());
+  }
+
+  bf_status_t bunnyClear() override {
+    MemOp op;
+    op.kind = MemOp::CLEAR;
+    op.key = 0;
+    return execute(op, ADD, pipes_.allPipes());
+  }
+
+  // The keys of the robot are collected from the sw state of its first
+  // pipes, every entry of the tables is visited like BfRtBackend does.
+  bf_status_t bunnyRobotKeys(const robot_id_t &robot_id, std::vector<bunny_id_t> *bunny_ids,
+                             std::vector<bunny_id_t> *from_ids) override {
+    auto ingress = pipeTables(false, pipes_.ingressPipes(robot_id));
+    auto egress = pipeTables(false, pipes_.egressPipes(robot_id));
+    if (ingress == nullptr || egress == nullptr) {
+      return BF_INVALID_ARG;
+    }
+    uint64_t bunny_first = static_cast<uint64_t>(robot_id) << 24;
+    uint64_t bunny_last = bunny_first + (1ULL << 24);
+    uint64_t railway_first = railway_key_pack(robot_id, 0);
+    uint64_t railway_last = railway_first + (1ULL << 16);
+
+    std::vector<uint64_t> ingress_keys, egress_keys, railway_keys;
+    {
+      std::lock_guard<std::mutex> guard(device_->lock);
+      ingress_keys = keysWithin(ingress->bunny, bunny_first, bunny_last);
+      egress_keys = keysWithin(egress->bunny_e, bunny_first, bunny_last);
+      railway_keys = keysWithin(ingress->railway_switch, railway_first, railway_last);
+    }
+
+    bunny_ids->clear();
+    for (auto key : ingress_keys) {
+      bunny_ids->push_back(bunny_key_unpack(key).actual_bunny);
+    }
+    for (auto key : egress_keys) {
+      bunny_ids->push_back(bunny_key_unpack(key).actual_bunny);
+    }
+    std::sort(bunny_ids->begin(), bunny_ids->end());
+    bunny_ids->erase(std::unique(bunny_ids->begin(), bunny_ids->end()), bunny_ids->end());
+    from_ids->clear();
+    for (auto key : railway_keys) {
+      from_ids->push_back(static_cast<bunny_id_t>(key));
+    }
+    return BF_SUCCESS;
+  }
+
+  bf_status_t iBunnyScan(const bool &from_hw, const uint32_t &pipe,
+                         const uint32_t &chunk,
+                         const std::function<bool(const bunny_entry_t &)> &f) override {
+    return scan(from_hw, pipe, chunk, &MemTables::bunny,
+                [&](const uint64_t &key, const bunny_data_t &data) {
+                  bunny_entry_t entry;
+                  entry.key = bunny_key_unpack(key);
+                  entry.data = data;
+                  return f(entry);
+                });
+  }
+
+  bf_status_t eBunnyScan(const bool &from_hw, const uint32_t &pipe,
+                         const uint32_t &chunk,
+                         const std::function<bool(const bunny_e_entry_t &)> &f) override {
+    return scan(from_hw, pipe, chunk, &MemTables::bunny_e,
+                [&](const uint64_t &key, const bunny_target_t &target) {
+                  bunny_e_entry_t entry;
+                  entry.key = bunny_key_unpack(key);
+                  entry.target = target;
+                  return f(entry);
+                });
+  }
+
+  bf_status_t railwayScan(const bool &from_hw, const uint32_t &pipe,
+                          const uint32_t &chunk,
+                          const std::function<bool(const railway_entry_t &)> &f) override {
+    return scan(from_hw, pipe, chunk, &MemTables::railway_switch,
+                [&](const uint64_t &key, const bunny_id_t &to_id) {
+                  railway_entry_t entry;
+                  entry.robot_id = static_cast<robot_id_t>(key >> 16);
+                  entry.from_id = static_cast<bunny_id_t>(key);
+                  entry.to_id = to_id;
+                  return f(entry);
+                });
+  }
+
+  bf_status_t actualBunnyGet(const robot_id_t &robot_id,
+                             bunny_id_t *bunny_id) override {
+    if (robot_id >= MAX_ROBOTS) {
+      return BF_INVALID_ARG;
+    }
+    uint32_t pipe = pipes_.registerPipe(robot_id);
+    if (pipe >= device_->hw.size()) {
+      return BF_INVALID_ARG;
+    }
+    busy_wait_ns(device_->latency.op_ns);
+    std::lock_guard<std::mutex> guard(device_->lock);
+    *bunny_id = device_->hw[pipe].r_actual_bunny[robot_id];
+    return BF_SUCCESS;
+  }
+
+  bf_status_t actualBunnySet(const robot_id_t &robot_id,
+                             const bunny_id_t &bunny_id) override {
+    if (robot_id >= MAX_ROBOTS) {
+      return BF_INVALID_ARG;
+    }
+    return forPipes(pipes_.ingressPipes(robot_id), [&](const uint32_t &pipe) -> bf_status_t {
+      busy_wait_ns(device_->latency.op_ns);
+      std::lock_guard<std::mutex> guard(device_->lock);
+      device_->sw[pipe].r_actual_bunny[robot_id] = bunny_id;
+      device_->hw[pipe].r_actual_bunny[robot_id] = bunny_id;
+      // nothing moves the robots here, a register write stands in for the
+      // data plane and sends the digest
+      if (pipe == pipes_.registerPipe(robot_id)) {
+        device_->notifyProgress(robot_id, pipe);
+      }
+      return BF_SUCCESS;
+    });
+  }
+
+  // One driver call per register sync, the values are copied under one lock
+  bf_status_t progressRead(robot_progress_t *progress) override {
+    busy_wait_ns(3 * device_->latency.op_ns);
+    std::lock_guard<std::mutex> guard(device_->lock);
+    for (int robot_id = 0; robot_id < MAX_ROBOTS; robot_id++) {
+      uint32_t pipe = pipes_.registerPipe(robot_id);
+      if (pipe >= device_->hw.size()) {
+        return BF_INVALID_ARG;
+      }
+      auto &tables = device_->hw[pipe];
+      progress[robot_id].actual_bunny = tables.r_actual_bunny[robot_id];
+      progress[robot_id].next_bunny = tables.r_next_bunny[robot_id];
+      progress[robot_id].end_time = tables.end_time[robot_id];
+    }
+    return BF_SUCCESS;
+  }
+
+  // One listener per device, like one digest callback per device
+  bf_status_t progressListen(ProgressListener *listener) override {
+    std::lock_guard<std::mutex> guard(device_->lock);
+    device_->listener = listener;
+    return BF_SUCCESS;
+  }
+
+ private:
+  struct MemOp {
+    enum Kind { I_SET, I_DEL, E_SET, E_DEL, R_SET, R_DEL, S_SET, S_DEL, C_SET,
+                F_SET, F_DEL, V_SET, CLEAR } kind;
+    uint64_t key;
+    bunny_data_t idata;
+    bunny_target_t edata;
+    bunny_id_t to_id;
+    speed_limit_entry_t sdata;
+    robot_class_t robot_class;
+    function_entry_t fdata;
+    uint32_t pipe;
+  };
+
+  // ADD and MOD check the existence of the entry like the driver does, SET is
+  // used when the already validated operations are pushed to the hw state.
+  enum Mode { ADD, MOD, SET };
+
+  // Call f with the device pipe index of every target, ALL_PIPES is every
+  // pipe. Stops at the first error.
+  template <typename F>
+  bf_status_t forPipes(const std::vector<uint32_t> &targets, F f) {
+    uint32_t num_pipes = device_->sw.size();
+    for (auto target : targets) {
+      uint32_t first = target == ALL_PIPES ? 0 : target;
+      uint32_t last = target == ALL_PIPES ? num_pipes : target + 1;
+      if (last > num_pipes) {
+        return BF_INVALID_ARG;
+      }
+      for (uint32_t pipe = first; pipe < last; pipe++) {
+        auto status = f(pipe);
+        if (status != BF_SUCCESS) {
+          return status;
+        }
+      }
+    }
+    return BF_SUCCESS;
+  }
+
+  // The tables of the first target pipe, reads are served from there.
+  MemTables *pipeTables(const bool &from_hw, const std::vector<uint32_t> &targets) {
+    uint32_t pipe = targets[0] == ALL_PIPES ? 0 : targets[0];
+    if (pipe >= device_->sw.size()) {
+      return nullptr;
+    }
+    return from_hw ? &device_->hw[pipe] : &device_->sw[pipe];
+  }
+
+  // Apply the operation on the sw state of every target pipe, then queue it
+  // for the hw state. One driver call per pipe, like BfRtBackend.
+  bf_status_t execute(MemOp op, const Mode &mode,
+                      const std::vector<uint32_t> &targets) {
+    return forPipes(targets, [&](const uint32_t &pipe) -> bf_status_t {
+      op.pipe = pipe;
+      busy_wait_ns(device_->latency.op_ns);
+      std::lock_guard<std::mutex> guard(device_->lock);
+      MemOp undo;
+      if (transaction_ && !undoOf(device_->sw[pipe], op, &undo)) {
+        return BF_INVALID_ARG;
+      }
+      auto status = apply(&device_->sw[pipe], op, mode);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      if (transaction_) {
+        undo_.push_back(undo);
+      }
+      if (batching_) {
+        pending_.push_back(op);
+      } else {
+        pushLocked();
+        busy_wait_ns(device_->latency.commit_ns + device_->latency.commit_op_ns);
+        apply(&device_->hw[pipe], op, SET);
+      }
+      return BF_SUCCESS;
+    });
+  }
+
+  template <typename V>
+  bf_status_t get(const ExactMatchTable<V> *table, const uint64_t &key, V *value) {
+    busy_wait_ns(device_->latency.op_ns);
+    std::lock_guard<std::mutex> guard(device_->lock);
+    auto found = table->find(key);
+    if (found == nullptr) {
+      return BF_OBJECT_NOT_FOUND;
+    }
+    *value = *found;
+    return BF_SUCCESS;
+  }
+
+  // Copy the entries of the table chunk at a time, the device lock is only
+  // held while a chunk is copied. Like a driver scan, entries written during
+  // the scan may be missed.
+  template <typename V, typename F>
+  bf_status_t scan(const bool &from_hw, const uint32_t &pipe, const uint32_t &chunk,
+                   ExactMatchTable<V> MemTables::*table, F f) {
+    uint32_t index = pipe == ALL_PIPES ? 0 : pipe;
+    if (index >= device_->sw.size() || chunk == 0) {
+      return BF_INVALID_ARG;
+    }
+    std::vector<std::pair<uint64_t, V>> entries;
+    entries.reserve(chunk);
+    uint64_t next = 0;
+    do {
+      entries.clear();
+      busy_wait_ns(device_->latency.op_ns);
+      {
+        std::lock_guard<std::mutex> guard(device_->lock);
+        auto &tables = from_hw ? device_->hw[index] : device_->sw[index];
+        next = (tables.*table).forEachFrom(next, chunk, [&](const uint64_t &key, const V &value) {
+          entries.emplace_back(key, value);
+        });
+      }
+      for (auto &entry : entries) {
+        if (!f(entry.first, entry.second)) {
+          return BF_SUCCESS;
+        }
+      }
+    } while (entries.size() == chunk);
+    return BF_SUCCESS;
+  }
+
+  // Keys of the table within [first, last), device_->lock is held
+  template <typename V>
+  static std::vector<uint64_t> keysWithin(const ExactMatchTable<V> &table,
+                                          const uint64_t &first, const uint64_t &last) {
+    std::vector<uint64_t> keys;
+    table.forEach([&](const uint64_t &key, const V &) {
+      if (key >= first && key < last) {
+        keys.push_back(key);
+      }
+    });
+    return keys;
+  }
+
+  template <typename V>
+  static bf_status_t write(ExactMatchTable<V> *table, const uint64_t &key,
+                           const V &value, const Mode &mode) {
+    switch (mode) {
+      case ADD:
+        return table->add(key, value);
+      case MOD:
+        return table->mod(key, value);
+      case SET:
+        return table->set(key, value);
+    }
+    return BF_INVALID_ARG;
+  }
+
+  // The operation restoring the state of t before op, false for a clear
+  static bool undoOf(const MemTables &t, const MemOp &op, MemOp *undo) {
+    *undo = op;
+    switch (op.kind) {
+      case MemOp::I_SET:
+      case MemOp::I_DEL: {
+        auto found = t.bunny.find(op.key);
+        undo->kind = found != nullptr ? MemOp::I_SET : MemOp::I_DEL;
+        if (found != nullptr) {
+          undo->idata = *found;
+        }
+        return true;
+      }
+      case MemOp::E_SET:
+      case MemOp::E_DEL: {
+        auto found = t.bunny_e.find(op.key);
+        undo->kind = found != nullptr ? MemOp::E_SET : MemOp::E_DEL;
+        if (found != nullptr) {
+          undo->edata = *found;
+        }
+        return true;
+      }
+      case MemOp::R_SET:
+      case MemOp::R_DEL: {
+        auto found = t.railway_switch.find(op.key);
+        undo->kind = found != nullptr ? MemOp::R_SET : MemOp::R_DEL;
+        if (found != nullptr) {
+          undo->to_id = *found;
+        }
+        return true;
+      }
+      case MemOp::S_SET:
+      case MemOp::S_DEL: {
+        auto found = t.speed_limit.find(op.sdata.key);
+        undo->kind = found != t.speed_limit.end() ? MemOp::S_SET : MemOp::S_DEL;
+        if (found != t.speed_limit.end()) {
+          undo->sdata.speed = found->second;
+        }
+        return true;
+      }
+      case MemOp::C_SET:
+        undo->robot_class = t.robot_class[op.key];
+        return true;
+      case MemOp::F_SET:
+      case MemOp::F_DEL: {
+        const auto &entries = t.functions[op.key];
+        auto found = entries.find(op.fdata.key);
+        undo->kind = found != entries.end() ? MemOp::F_SET : MemOp::F_DEL;
+        if (found != entries.end()) {
+          undo->fdata.d = found->second;
+        }
+        return true;
+      }
+      case MemOp::V_SET:
+        undo->key = t.function_version;
+        return true;
+      case MemOp::CLEAR:
+        return false;
+    }
+    return false;
+  }
+
+  static bf_status_t speedLimitWrite(MemTables *t, const speed_limit_entry_t &entry,
+                                     const Mode &mode) {
+    auto found = t->speed_limit.find(entry.key);
+    if (found != t->speed_limit.end()) {
+      if (mode == ADD) {
+        return BF_ALREADY_EXISTS;
+      }
+      found->second = entry.speed;
+      return BF_SUCCESS;
+    }
+    if (mode == MOD) {
+      return BF_OBJECT_NOT_FOUND;
+    }
+    if (t->speed_limit.size() >= SPEED_LIMIT_SIZE) {
+      return BF_NO_SPACE;
+    }
+    t->speed_limit.emplace(entry.key, entry.speed);
+    return BF_SUCCESS;
+  }
+
+  static bf_status_t functionWrite(MemTables *t, const uint32_t &function,
+                                   const function_entry_t &entry, const Mode &mode) {
+    auto &entries = t->functions[function];
+    auto found = entries.find(entry.key);
+    if (found != entries.end()) {
+      if (mode == ADD) {
+        return BF_ALREADY_EXISTS;
+      }
+      found->second = entry.d;
+      return BF_SUCCESS;
+    }
+    if (mode == MOD) {
+      return BF_OBJECT_NOT_FOUND;
+    }
+    if (entries.size() >= FUNCTION_SIZE) {
+      return BF_NO_SPACE;
+    }
+    entries.emplace(entry.key, entry.d);
+    return BF_SUCCESS;
+  }
+
+  static bf_status_t apply(MemTables *t, const MemOp &op, const Mode &mode) {
+    switch (op.kind) {
+      case MemOp::I_SET:
+        return write(&t->bunny, op.key, op.idata, mode);
+      case MemOp::I_DEL:
+        return t->bunny.del(op.key);
+      case MemOp::E_SET:
+        return write(&t->bunny_e, op.key, op.edata, mode);
+      case MemOp::E_DEL:
+        return t->bunny_e.del(op.key);
+      case MemOp::R_SET:
+        return write(&t->railway_switch, op.key, op.to_id, mode);
+      case MemOp::R_DEL:
+        return t->railway_switch.del(op.key);
+      case MemOp::S_SET:
+        return speedLimitWrite(t, op.sdata, mode);
+      case MemOp::S_DEL:
+        return t->speed_limit.erase(op.sdata.key) == 1 ? BF_SUCCESS : BF_OBJECT_NOT_FOUND;
+      case MemOp::C_SET:
+        t->robot_class[op.key] = op.robot_class;
+        return BF_SUCCESS;
+      case MemOp::F_SET:
+        t->function_generation++;
+        return functionWrite(t, op.key, op.fdata, mode);
+      case MemOp::F_DEL:
+        t->function_generation++;
+        return t->functions[op.key].erase(op.fdata.key) == 1 ? BF_SUCCESS
+                                                             : BF_OBJECT_NOT_FOUND;
+      case MemOp::V_SET:
+        t->function_generation++;
+        t->function_version = static_cast<uint8_t>(op.key);
+        return BF_SUCCESS;
+      case MemOp::CLEAR:
+        t->bunny.clear();
+        t->bunny_e.clear();
+        t->railway_switch.clear();
+        return BF_SUCCESS;
+    }
+    return BF_INVALID_ARG;
+  }
+
+  // Push the ended batches to the hw state.
+  void push() {
+    if (inflight_.empty()) {
+      return;
+    }
+    busy_wait_ns(device_->latency.commit_ns +
+                 device_->latency.commit_op_ns * inflight_.size());
+    std::lock_guard<std::mutex> guard(device_->lock);
+    pushLocked();
+  }
+
+  // Same without the commit cost, device_->lock is held. Keeps the ended
+  // batches ahead of a single operation.
+  void pushLocked() {
+    for (auto &op : inflight_) {
+      apply(&device_->hw[op.pipe], op, SET);
+    }
+    inflight_.clear();
+  }
+
+  MemDevice *device_;
+  const PipeMap &pipes_;
+  bool batching_;
+  bool transaction_;
+  std::vector<MemOp> undo_;      // sw state before the transaction's operations
+  std::vector<MemOp> pending_;   // operations of the open batch
+  std::vector<MemOp> inflight_;  // ended batches not pushed yet
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef PIPE_MAP_HPP
+#define PIPE_MAP_HPP
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cp_types.hpp"
+
+// Same value as BF_DEV_PIPE_ALL
+#define ALL_PIPES 0xffff
+#define MAX_PIPES 4
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Pipe of a Tofino device port: bits 7-8 of the port number.
+inline uint32_t dev_port_to_pipe(const uint32_t &dev_port) {
+  return (dev_port >> 7) & 0x3;
+}
+
+// Pipes that hold the entries of each robot.
+//
+// ur.p4 sends the trajectory packets back on their ingress port, so a robot
+// only needs its bunny and railway_switch entries in the ingress pipe of its
+// port, and its bunny_e entries in the egress pipe of the same port. Without
+// a map (symmetric mode) every entry goes to every pipe (ALL_PIPES). With a
+// map the tables are switched to asymmetric mode: mapped robots are written
+// only to their own pipes, the others to each pipe one by one.
+//
+// Map file, one robot per line:
+//   <robot_id> port <ingress dev port> [<egress dev port>]
+//   <robot_id> pipe <ingress pipe> [<egress pipe>]
+// '#' starts a comment.
+class PipeMap {
+ public:
+  explicit PipeMap(uint32_t num_pipes = MAX_PIPES)
+      : num_pipes_(num_pipes), asymmetric_(false) {
+    for (uint32_t pipe = 0; pipe < num_pipes_; pipe++) {
+      all_.push_back(pipe);
+    }
+    for (int i = 0; i < MAX_ROBOTS; i++) {
+      ingress_[i] = {ALL_PIPES};
+      egress_[i] = {ALL_PIPES};
+    }
+  }
+
+  // Load the map file, switches to asymmetric mode. Returns false (and
+  // prints why) if the file is invalid.
+  bool load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+      std::cout<<"ERROR: cannot open pipe map "<<path<<std::endl;
+      return false;
+    }
+
+    enableAsymmetric();
+    std::string line;
+    int line_no = 0;
+    while (std::getline(file, line)) {
+      line_no++;
+      line = line.substr(0, line.find('#'));
+      std::istringstream in(line);
+      uint32_t robot_id, ingress, egress;
+      std::string kind;
+      if (!(in>>robot_id)) {
+        continue;  // empty line
+      }
+      if (!(in>>kind>>ingress) || (kind != "port" && kind != "pipe")) {
+        std::cout<<"ERROR: "<<path<<":"<<line_no<<": invalid line"<<std::endl;
+        return false;
+      }
+      if (!(in>>egress)) {
+        egress = ingress;
+      }
+      if (kind == "port") {
+        ingress = dev_port_to_pipe(ingress);
+        egress = dev_port_to_pipe(egress);
+      }
+      if (!set(robot_id, ingress, egress)) {
+        std::cout<<"ERROR: "<<path<<":"<<line_no<<": robot or pipe out of range"<<std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Unmapped robots are written to every pipe one by one from now on.
+  void enableAsymmetric() {
+    if (asymmetric_) {
+      return;
+    }
+    asymmetric_ = true;
+    for (int i = 0; i < MAX_ROBOTS; i++) {
+      ingress_[i] = all_;
+      egress_[i] = all_;
+    }
+  }
+
+  bool set(const uint32_t &robot_id, const uint32_t &ingress_pipe,
+           const uint32_t &egress_pipe) {
+    if (robot_id >= MAX_ROBOTS || ingress_pipe >= num_pipes_ ||
+        egress_pipe >= num_pipes_) {
+      return false;
+    }
+    enableAsymmetric();
+    ingress_[robot_id] = {ingress_pipe};
+    egress_[robot_id] = {egress_pipe};
+    return true;
+  }
+
+  bool asymmetric() const { return asymmetric_; }
+  uint32_t numPipes() const { return num_pipes_; }
+
+  // Targets of the ingress (bunny, railway_switch) entries of a robot
+  const std::vector<uint32_t> &ingressPipes(const robot_id_t &robot_id) const {
+    return robot_id < MAX_ROBOTS ? ingress_[robot_id] : all_targets();
+  }
+
+  // Targets of the egress (bunny_e) entries of a robot
+  const std::vector<uint32_t> &egressPipes(const robot_id_t &robot_id) const {
+    return robot_id < MAX_ROBOTS ? egress_[robot_id] : all_targets();
+  }
+
+  // Targets of table wide operations (clear)
+  const std::vector<uint32_t> &allPipes() const { return all_targets(); }
+
+  // The pipe whose register values belong to the robot
+  uint32_t registerPipe(const robot_id_t &robot_id) const {
+    auto &pipes = ingressPipes(robot_id);
+    return pipes[0] == ALL_PIPES ? 0 : pipes[0];
+  }
+
+ private:
+  const std::vector<uint32_t> &all_targets() const {
+    static const std::vector<uint32_t> symmetric = {ALL_PIPES};
+    return asymmetric_ ? all_ : symmetric;
+  }
+
+  uint32_t num_pipes_;
+  bool asymmetric_;
+  std::vector<uint32_t> all_;
+  std::vector<uint32_t> ingress_[MAX_ROBOTS];
+  std::vector<uint32_t> egress_[MAX_ROBOTS];
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef PROGRESS_POLLER_HPP
+#define PROGRESS_POLLER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "table_backend.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Poll cost and staleness of a ProgressPoller
+struct PollStats {
+  uint64_t polls = 0;
+  uint64_t errors = 0;
+  uint64_t cost_ns_sum = 0;
+  uint64_t cost_ns_max = 0;
+  // longest time between two published snapshots
+  uint64_t interval_ns_max = 0;
+};
+
+// Reads r_actual_bunny, r_next_bunny and end_time of every robot every
+// period_us with one progressRead on its own backend (session) and publishes
+// the values. Readers never take a lock and never touch the driver: every
+// robot has one atomic word holding its three values, so the values of a
+// robot always come from the same poll. The age of the snapshot is the time
+// since the last successful poll started.
+class ProgressPoller {
+ public:
+  ProgressPoller(std::unique_ptr<TableBackend> backend, const uint32_t &period_us)
+      : backend_(std::move(backend)),
+        period_(std::chrono::microseconds(period_us)),
+        published_ns_(0),
+        stop_(false) {
+    for (auto &slot : slots_) {
+      slot.store(0, std::memory_order_relaxed);
+    }
+    thread_ = std::thread(&ProgressPoller::run, this);
+  }
+
+  ~ProgressPoller() {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+
+    auto stats = this->stats();
+    std::cout<<"progress poller: "<<stats.polls<<" polls, "<<stats.errors<<" errors";
+    if (stats.polls > 0) {
+      std::cout<<", cost mean "<<stats.cost_ns_sum / stats.polls / 1000<<" us max "
+               <<stats.cost_ns_max / 1000<<" us, max interval "
+               <<stats.interval_ns_max / 1000<<" us";
+    }
+    std::cout<<std::endl;
+  }
+
+  // The last polled values of the robot, false before the first poll
+  bool get(const robot_id_t &robot_id, robot_progress_t *progress,
+           uint64_t *age_ns) const {
+    uint64_t published = published_ns_.load(std::memory_order_acquire);
+    if (published == 0 || robot_id >= MAX_ROBOTS) {
+      return false;
+    }
+    uint64_t value = slots_[robot_id].load(std::memory_order_relaxed);
+    progress->actual_bunny = static_cast<bunny_id_t>(value & 0xffff);
+    progress->next_bunny = static_cast<bunny_id_t>((value >> 16) & 0xffff);
+    progress->end_time = static_cast<p4_time_t>(value >> 32);
+    if (age_ns != nullptr) {
+      uint64_t now = nowNs();
+      *age_ns = now > published ? now - published : 0;
+    }
+    return true;
+  }
+
+  PollStats stats() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+  }
+
+ private:
+  static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void run() {
+    robot_progress_t progress[MAX_ROBOTS] = {};
+    auto next = std::chrono::steady_clock::now();
+    uint64_t last_published = 0;
+    while (true) {
+      uint64_t start = nowNs();
+      auto status = backend_->progressRead(progress);
+      uint64_t cost = nowNs() - start;
+      if (status == BF_SUCCESS) {
+        for (uint32_t i = 0; i < MAX_ROBOTS; i++) {
+          slots_[i].store(static_cast<uint64_t>(progress[i].actual_bunny) |
+                              static_cast<uint64_t>(progress[i].next_bunny) << 16 |
+                              static_cast<uint64_t>(progress[i].end_time) << 32,
+                          std::memory_order_relaxed);
+        }
+        published_ns_.store(start, std::memory_order_release);
+      }
+
+      std::unique_lock<std::mutex> guard(lock_);
+      stats_.polls++;
+      stats_.cost_ns_sum += cost;
+      stats_.cost_ns_max = std::max(stats_.cost_ns_max, cost);
+      if (status != BF_SUCCESS) {
+        stats_.errors++;
+      } else {
+        if (last_published != 0) {
+          stats_.interval_ns_max = std::max(stats_.interval_ns_max, start - last_published);
+        }
+        last_published = start;
+      }
+
+      // a fixed cadence, a poll longer than the period starts the next at once
+      next += period_;
+      auto now = std::chrono::steady_clock::now();
+      if (next < now) {
+        next = now;
+      }
+      if (wake_.wait_until(guard, next, [this] { return stop_; })) {
+        return;
+      }
+    }
+  }
+
+  std::unique_ptr<TableBackend> backend_;
+  std::chrono::steady_clock::duration period_;
+  // actual_bunny | next_bunny << 16 | end_time << 32
+  std::atomic<uint64_t> slots_[MAX_ROBOTS];
+  std::atomic<uint64_t> published_ns_;
+
+  mutable std::mutex lock_;
+  std::condition_variable wake_;
+  bool stop_;
+  PollStats stats_;
+  std::thread thread_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef PROGRESS_STREAM_HPP
+#define PROGRESS_STREAM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "table_backend.hpp"
+#include "writer_pool.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Digest counts of a ProgressStream
+struct ProgressStreamStats {
+  uint64_t digests = 0;
+  // digests merged into a pending one of the same robot
+  uint64_t coalesced = 0;
+  // deliveries held back by the minimum interval of the robot
+  uint64_t limited = 0;
+  uint64_t delivered = 0;
+};
+
+// Per robot stream of the progress digests of ur.p4. The driver thread only
+// stores the newest values of the robot and queues the robot if it is not
+// queued yet, so a burst of digests of one robot becomes one delivery of the
+// last values (coalescing). A dispatcher thread calls handler for the queued
+// robots, at most once every min_interval_us per robot (rate limiting): a
+// robot that comes too early waits for its interval and takes the digests
+// of the meantime with it. The newest values of every robot can be read at
+// any time without a lock.
+class ProgressStream : public ProgressListener {
+ public:
+  typedef std::function<void(const robot_id_t &robot_id,
+                             const robot_progress_t &progress)> Handler;
+
+  ProgressStream(const uint32_t &min_interval_us, Handler handler)
+      : min_interval_ns_(static_cast<uint64_t>(min_interval_us) * 1000),
+        handler_(handler),
+        // a robot is queued at most once
+        queue_(256),
+        digests_(0),
+        coalesced_(0),
+        limited_(0),
+        delivered_(0),
+        stop_(false) {
+    for (uint32_t i = 0; i < MAX_ROBOTS; i++) {
+      slots_[i].store(0, std::memory_order_relaxed);
+      stamps_[i].store(0, std::memory_order_relaxed);
+      pending_[i].store(false, std::memory_order_relaxed);
+    }
+    thread_ = std::thread(&ProgressStream::run, this);
+  }
+
+  ~ProgressStream() {
+    stop_.store(true);
+    thread_.join();
+
+    auto stats = this->stats();
+    std::cout<<"progress stream: "<<stats.digests<<" digests, "<<stats.coalesced
+             <<" coalesced, "<<stats.limited<<" rate limited, "<<stats.delivered
+             <<" delivered"<<std::endl;
+  }
+
+  void progress(const robot_id_t &robot_id, const robot_progress_t &progress) override {
+    if (robot_id >= MAX_ROBOTS) {
+      return;
+    }
+    digests_.fetch_add(1, std::memory_order_relaxed);
+    slots_[robot_id].store(pack(progress), std::memory_order_relaxed);
+    stamps_[robot_id].store(now_ns(), std::memory_order_release);
+    if (pending_[robot_id].exchange(true, std::memory_order_acq_rel)) {
+      coalesced_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    bool queued = queue_.push(robot_id);
+    assert(queued);
+    (void)queued;
+  }
+
+  // The newest values of the robot and when their digest came (steady clock
+  // ns), false before its first digest
+  bool get(const robot_id_t &robot_id, robot_progress_t *progress,
+           uint64_t *stamp_ns) const {
+    if (robot_id >= MAX_ROBOTS) {
+      return false;
+    }
+    uint64_t stamp = stamps_[robot_id].load(std::memory_order_acquire);
+    if (stamp == 0) {
+      return false;
+    }
+    *progress = unpack(slots_[robot_id].load(std::memory_order_relaxed));
+    if (stamp_ns != nullptr) {
+      *stamp_ns = stamp;
+    }
+    return true;
+  }
+
+  ProgressStreamStats stats() const {
+    ProgressStreamStats stats;
+    stats.digests = digests_.load(std::memory_order_relaxed);
+    stats.coalesced = coalesced_.load(std::memory_order_relaxed);
+    stats.limited = limited_.load(std::memory_order_relaxed);
+    stats.delivered = delivered_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+ private:
+  static uint64_t pack(const robot_progress_t &progress) {
+    return static_cast<uint64_t>(progress.actual_bunny) |
+           static_cast<uint64_t>(progress.next_bunny) << 16 |
+           static_cast<uint64_t>(progress.end_time) << 32;
+  }
+
+  static robot_progress_t unpack(const uint64_t &value) {
+    robot_progress_t progress;
+    progress.actual_bunny = static_cast<bunny_id_t>(value & 0xffff);
+    progress.next_bunny = static_cast<bunny_id_t>((value >> 16) & 0xffff);
+    progress.end_time = static_cast<p4_time_t>(value >> 32);
+    return progress;
+  }
+
+  static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void deliver(const robot_id_t &robot_id, const uint64_t &now) {
+    // a digest after this point queues the robot again
+    pending_[robot_id].store(false, std::memory_order_seq_cst);
+    auto progress = unpack(slots_[robot_id].load(std::memory_order_relaxed));
+    last_[robot_id] = now;
+    delivered_.fetch_add(1, std::memory_order_relaxed);
+    if (handler_) {
+      handler_(robot_id, progress);
+    }
+  }
+
+  void run() {
+    std::vector<robot_id_t> waiting;
+    uint32_t idle = 0;
+    for (auto &last : last_) {
+      last = 0;
+    }
+    while (true) {
+      bool busy = false;
+      uint64_t now = now_ns();
+      for (size_t i = 0; i < waiting.size();) {
+        if (now - last_[waiting[i]] >= min_interval_ns_) {
+          deliver(waiting[i], now);
+          waiting[i] = waiting.back();
+          waiting.pop_back();
+          busy = true;
+        } else {
+          i++;
+        }
+      }
+      robot_id_t robot_id;
+      while (queue_.pop(&robot_id)) {
+        busy = true;
+        if (last_[robot_id] != 0 && now - last_[robot_id] < min_interval_ns_) {
+          limited_.fetch_add(1, std::memory_order_relaxed);
+          waiting.push_back(robot_id);
+        } else {
+          deliver(robot_id, now);
+        }
+      }
+
+      if (busy) {
+        idle = 0;
+        continue;
+      }
+      if (stop_.load()) {
+        return;
+      }
+      // spin a little, then back off to not burn a core while idle
+      if (++idle > 1000) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  uint64_t min_interval_ns_;
+  Handler handler_;
+  BoundedQueue<robot_id_t> queue_;
+  // actual_bunny | next_bunny << 16 | end_time << 32
+  std::atomic<uint64_t> slots_[MAX_ROBOTS];
+  std::atomic<uint64_t> stamps_[MAX_ROBOTS];
+  std::atomic<bool> pending_[MAX_ROBOTS];
+  // dispatcher thread only: time of the last delivery
+  uint64_t last_[MAX_ROBOTS];
+
+  std::atomic<uint64_t> digests_;
+  std::atomic<uint64_t> coalesced_;
+  std::atomic<uint64_t> limited_;
+  std::atomic<uint64_t> delivered_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
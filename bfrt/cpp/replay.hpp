@@ -0,0 +1,299 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "function_table.hpp"
+#include "table_backend.hpp"
+#include "traj_csv.hpp"
+#include "traj_simplify.hpp"
+#include "ur_model.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+/*******************************************************************************
+ * Replay of a trajectory csv through the control loop of ur.p4 (UrModel),
+ * without a switch and without robots.
+ *
+ * The trajectory is installed for every robot through the backend of cp, the
+ * weighting functions are compiled like by command 24. Every robot starts at
+ * the first point at rest; every 1/rate s of simulated time it sends a cur_t
+ * packet per joint and moves with the speed of the reply until the next one
+ * (speed control, like speedj). The replay ends when every robot has passed
+ * the last point (the bunny of the resubmit is not installed) or after
+ * max_time. The simulated clock runs as fast as the model allows.
+ *
+ * The report has the commanded speeds of every joint and the largest
+ * distance of the robot from the csv path at the same time.
+ ******************************************************************************/
+
+struct ReplayConfig {
+  std::string csv_file;
+  uint32_t robots = 1;
+  uint32_t rate = 500;                        // packets per joint per s
+  double weights[NUM_FUNCTIONS] = {0, 1, 1};  // actual, target, diff
+  double max_time = 0;                        // s, 0: until the end
+  std::string output;                         // csv of robot 0 per packet round
+  SimplifyConfig simplify;                    // of the installed trajectory
+};
+
+// The positions (rad) of a csv point, time (s) after the first one
+struct replay_point_t {
+  double time;
+  double positions[NUM_JOINTS];
+};
+
+// Commanded speeds and tracking error of a joint over all robots
+struct ReplayJointStats {
+  double min_speed = 0;
+  double max_speed = 0;
+  double sum_abs_speed = 0;
+  double max_error = 0;
+};
+
+class Replay {
+ public:
+  Replay(TableBackend *backend, UrModel *model, const ReplayConfig &config)
+      : backend_(backend), model_(model), config_(config) {}
+
+  bool run(std::ostream &out) {
+    std::string csv;
+    if (!load(&csv)) {
+      return false;
+    }
+    if (config_.robots == 0 || config_.robots > MAX_ROBOTS || config_.rate == 0) {
+      std::cout<<"ERROR: invalid replay robots or rate"<<std::endl;
+      return false;
+    }
+    auto status = install(csv);
+    if (status != BF_SUCCESS) {
+      std::cout<<"ERROR: replay setup failed with status "<<status<<std::endl;
+      return false;
+    }
+
+    std::ofstream trace;
+    if (!config_.output.empty()) {
+      trace.open(config_.output);
+      if (!trace) {
+        std::cout<<"ERROR: cannot open "<<config_.output<<std::endl;
+        return false;
+      }
+      trace<<"time,bunny";
+      for (int j = 0; j < NUM_JOINTS; j++) {
+        trace<<",j"<<j<<"pos";
+      }
+      for (int j = 0; j < NUM_JOINTS; j++) {
+        trace<<",j"<<j<<"cmd";
+      }
+      trace<<"\n";
+    }
+
+    // the robots, at the first point at rest
+    struct Robot {
+      double positions[NUM_JOINTS];
+      double speeds[NUM_JOINTS];
+      bool done;
+    };
+    std::vector<Robot> robots(config_.robots);
+    for (auto &robot : robots) {
+      std::copy(path_[0].positions, path_[0].positions + NUM_JOINTS, robot.positions);
+      std::fill(robot.speeds, robot.speeds + NUM_JOINTS, 0.0);
+      robot.done = false;
+    }
+
+    const uint64_t period_ns = 1000000000ULL / config_.rate;
+    const double dt = period_ns / 1e9;
+    const uint64_t max_ns = static_cast<uint64_t>(config_.max_time * 1e9);
+    uint64_t now = 0;
+    uint64_t packets = 0;
+    uint64_t samples = 0;
+    uint32_t running = config_.robots;
+    size_t segment = 0;  // of the csv path at now
+    auto wall_start = std::chrono::steady_clock::now();
+
+    while (running > 0 && (max_ns == 0 || now < max_ns)) {
+      double t = now / 1e9;
+      while (segment + 1 < path_.size() && path_[segment + 1].time <= t) {
+        segment++;
+      }
+      double expected[NUM_JOINTS];
+      interpolate(segment, t, expected);
+
+      for (uint32_t r = 0; r < robots.size(); r++) {
+        auto &robot = robots[r];
+        if (robot.done) {
+          continue;
+        }
+        ur_reply_t reply;
+        for (int j = 0; j < NUM_JOINTS; j++) {
+          ur_packet_t packet;
+          packet.robot_id = static_cast<robot_id_t>(r);
+          packet.jointId = static_cast<joint_id_t>(j);
+          packet.position = double_to_dec(robot.positions[j]);
+          packet.speed = double_to_dec(robot.speeds[j]);
+          reply = model_->cur(packet, now);
+          robot.speeds[j] = dec_to_double(reply.speed);
+          packets++;
+          if (reply.resubmitted && !reply.bunny_hit) {
+            // past the last point
+            robot.done = true;
+            running--;
+            break;
+          }
+        }
+        if (robot.done) {
+          continue;
+        }
+        for (int j = 0; j < NUM_JOINTS; j++) {
+          auto &joint = joints_[j];
+          double speed = robot.speeds[j];
+          joint.min_speed = samples == 0 ? speed : std::min(joint.min_speed, speed);
+          joint.max_speed = samples == 0 ? speed : std::max(joint.max_speed, speed);
+          joint.sum_abs_speed += std::fabs(speed);
+          joint.max_error = std::max(joint.max_error,
+                                     std::fabs(robot.positions[j] - expected[j]));
+        }
+        samples++;
+        if (r == 0 && trace.is_open()) {
+          trace<<t<<","<<reply.actual_bunny;
+          for (int j = 0; j < NUM_JOINTS; j++) {
+            trace<<","<<robot.positions[j];
+          }
+          for (int j = 0; j < NUM_JOINTS; j++) {
+            trace<<","<<robot.speeds[j];
+          }
+          trace<<"\n";
+        }
+        for (int j = 0; j < NUM_JOINTS; j++) {
+          robot.positions[j] += robot.speeds[j] * dt;
+        }
+      }
+      now += period_ns;
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    double simulated = now / 1e9;
+    out<<"# replay "<<config_.csv_file<<" points "<<path_.size()<<" robots "<<config_.robots
+       <<" rate "<<config_.rate<<" Hz weights "<<config_.weights[FUNCTION_ACTUAL]<<" "
+       <<config_.weights[FUNCTION_TARGET]<<" "<<config_.weights[FUNCTION_DIFF]<<"\n";
+    out<<"# simulated "<<simulated<<" s wall "<<wall<<" s speedup "
+       <<(wall > 0 ? simulated / wall : 0)<<" packets "<<packets<<" ("
+       <<(wall > 0 ? packets / wall : 0)<<" /s)"
+       <<(running > 0 ? ", stopped before the end" : "")<<"\n";
+    if (config_.simplify.enabled) {
+      out<<"# simplified to "<<simplified_.kept<<" of "<<simplified_.points<<" points ("
+         <<simplified_.ratio()<<"x) within "<<config_.simplify.position<<" rad "
+         <<config_.simplify.speed<<" rad/s, max error "<<simplified_.max_position_error
+         <<" rad "<<simplified_.max_speed_error<<" rad/s\n";
+    }
+    out<<"# joint min max mean|speed| (rad/s) max error (rad)\n";
+    for (int j = 0; j < NUM_JOINTS; j++) {
+      auto &joint = joints_[j];
+      out<<j<<" "<<joint.min_speed<<" "<<joint.max_speed<<" "
+         <<(samples > 0 ? joint.sum_abs_speed / samples : 0)<<" "<<joint.max_error<<"\n";
+    }
+    out<<std::flush;
+    return true;
+  }
+
+ private:
+  // The csv text and the path in rad, from the times and positions of it
+  bool load(std::string *csv) {
+    std::ifstream file(config_.csv_file);
+    if (!file) {
+      std::cout<<"ERROR: cannot read "<<config_.csv_file<<std::endl;
+      return false;
+    }
+    std::stringstream text;
+    text<<file.rdbuf();
+    *csv = text.str();
+
+    path_.clear();
+    int64_t points = TrajCsvParser(0, 0).parse(csv->data(), csv->size(),
+                                               [&](const trajectory_point_t &point) {
+      replay_point_t p;
+      p.time = path_.empty() ? 0 : path_.back().time + last_duration_;
+      for (int j = 0; j < NUM_JOINTS; j++) {
+        p.positions[j] = dec_to_double(point.positions[j]);
+      }
+      path_.push_back(p);
+      last_duration_ = (static_cast<uint64_t>(point.duration) << 16) / 1e9;
+    });
+    if (points < 2) {
+      std::cout<<"ERROR: "<<config_.csv_file<<" is not a trajectory of at least 2 points"
+               <<std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // The trajectory of every robot and the weighting functions
+  bf_status_t install(const std::string &csv) {
+    for (uint32_t r = 0; r < config_.robots; r++) {
+      auto status = backend_->beginBatch();
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      TrajCsvParser parser(static_cast<robot_id_t>(r), 0);
+      TrajSimplifier simplifier(config_.simplify);
+      auto add = [&](const trajectory_point_t &point) {
+        if (status == BF_SUCCESS) {
+          status = backend_->bunnyPointAdd(point);
+        }
+      };
+      if (config_.simplify.enabled) {
+        parser.parse(csv.data(), csv.size(), [&](const trajectory_point_t &point) {
+          simplifier.push(point, add);
+        });
+        simplifier.finish(add);
+        simplified_ = simplifier.stats();
+      } else {
+        parser.parse(csv.data(), csv.size(), add);
+      }
+      auto end_status = backend_->endBatch(true);
+      backend_->completeOperations();
+      if (status != BF_SUCCESS || end_status != BF_SUCCESS) {
+        return status != BF_SUCCESS ? status : end_status;
+      }
+    }
+    return functions_.set(backend_, config_.weights, FUNCTION_DEFAULT_PRECISION);
+  }
+
+  // Linear between the csv points around t, the last point after the end
+  void interpolate(const size_t &segment, const double &t, double positions[NUM_JOINTS]) const {
+    auto &a = path_[segment];
+    if (segment + 1 == path_.size()) {
+      std::copy(a.positions, a.positions + NUM_JOINTS, positions);
+      return;
+    }
+    auto &b = path_[segment + 1];
+    double x = b.time > a.time ? (t - a.time) / (b.time - a.time) : 1;
+    for (int j = 0; j < NUM_JOINTS; j++) {
+      positions[j] = a.positions[j] + x * (b.positions[j] - a.positions[j]);
+    }
+  }
+
+  TableBackend *backend_;
+  UrModel *model_;
+  ReplayConfig config_;
+  FunctionTables functions_;
+  std::vector<replay_point_t> path_;
+  double last_duration_ = 0;
+  ReplayJointStats joints_[NUM_JOINTS];
+  SimplifyStats simplified_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
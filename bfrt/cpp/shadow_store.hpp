@@ -0,0 +1,694 @@
+#ifndef SHADOW_STORE_HPP
+#define SHADOW_STORE_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "exact_match_table.hpp"
+#include "table_backend.hpp"
+
+// Points per page of the shadow of a robot
+#define SHADOW_PAGE_BITS 8
+#define SHADOW_PAGE_POINTS (1u << SHADOW_PAGE_BITS)
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// The installed entries of a trajectory point
+struct shadow_point_t {
+  uint8_t ingress;  // 1: the bunny entry of the point is installed
+  uint8_t egress;   // bit j: the bunny_e entry of joint j is installed
+  bunny_data_t data;
+  bunny_target_t target[NUM_JOINTS];
+};
+
+#define SHADOW_ALL_JOINTS ((1u << NUM_JOINTS) - 1)
+
+// Copy of the bunny, bunny_e and railway_switch entries that cp installed,
+// so existence checks, reads of the sw state, diffs and occupancy counts
+// need no driver call.
+//
+// The bunny entries are kept per robot in dense arrays indexed by bunny id,
+// split in pages of SHADOW_PAGE_POINTS points that are allocated on first
+// use. A range of ids is a range of the array and empty pages are skipped.
+// The railway_switch entries are in an ExactMatchTable. Every robot has its
+// own lock, the backends of the writers can update the shadow in parallel.
+class ShadowStore {
+ public:
+  ShadowStore() : railway_(RAILWAY_TABLE_SIZE) {}
+
+  ShadowStore(const ShadowStore &) = delete;
+  ShadowStore &operator=(const ShadowStore &) = delete;
+
+  // Copy of the point, false if no entry of it is installed
+  bool getPoint(const robot_id_t &robot_id, const bunny_id_t &bunny_id,
+                shadow_point_t *point) {
+    auto &robot = robots_[robot_id];
+    std::lock_guard<std::mutex> guard(robot.lock);
+    auto found = find(robot, bunny_id);
+    if (found == nullptr || (found->ingress == 0 && found->egress == 0)) {
+      return false;
+    }
+    *point = *found;
+    return true;
+  }
+
+  // Replace the entries of the point, none installed if both masks are 0
+  void putPoint(const robot_id_t &robot_id, const bunny_id_t &bunny_id,
+                const shadow_point_t &point) {
+    auto &robot = robots_[robot_id];
+    std::lock_guard<std::mutex> guard(robot.lock);
+    if (point.ingress == 0 && point.egress == 0) {
+      auto found = find(robot, bunny_id);
+      if (found != nullptr) {
+        mark(robot, bunny_id, &found->ingress, 0);
+        mark(robot, bunny_id, &found->egress, 0);
+      }
+      return;
+    }
+    auto &shadow = slot(robot, bunny_id);
+    mark(robot, bunny_id, &shadow.ingress, point.ingress);
+    mark(robot, bunny_id, &shadow.egress, point.egress);
+    shadow.data = point.data;
+    for (int j = 0; j < NUM_JOINTS; j++) {
+      shadow.target[j] = point.target[j];
+    }
+  }
+
+  bool railwayGet(const robot_id_t &robot_id, const bunny_id_t &from_id,
+                  bunny_id_t *to_id) {
+    std::lock_guard<std::mutex> guard(railway_lock_);
+    auto found = railway_.find(railwayKey(robot_id, from_id));
+    if (found == nullptr) {
+      return false;
+    }
+    *to_id = *found;
+    return true;
+  }
+
+  void railwaySet(const robot_id_t &robot_id, const bunny_id_t &from_id,
+                  const bunny_id_t &to_id) {
+    std::lock_guard<std::mutex> guard(railway_lock_);
+    railway_.set(railwayKey(robot_id, from_id), to_id);
+  }
+
+  void railwayDel(const robot_id_t &robot_id, const bunny_id_t &from_id) {
+    std::lock_guard<std::mutex> guard(railway_lock_);
+    railway_.del(railwayKey(robot_id, from_id));
+  }
+
+  // from_ids of the railway_switch entries of the robot
+  std::vector<bunny_id_t> railways(const robot_id_t &robot_id) {
+    std::vector<bunny_id_t> result;
+    std::lock_guard<std::mutex> guard(railway_lock_);
+    railway_.forEach([&](const uint64_t &key, const bunny_id_t &) {
+      if ((key >> 16) == robot_id) {
+        result.push_back(static_cast<bunny_id_t>(key));
+      }
+    });
+    return result;
+  }
+
+  void clear() {
+    for (auto &robot : robots_) {
+      std::lock_guard<std::mutex> guard(robot.lock);
+      robot.pages.clear();
+      robot.entries = 0;
+    }
+    std::lock_guard<std::mutex> guard(railway_lock_);
+    railway_.clear();
+  }
+
+  // Number of installed bunny and bunny_e entries of the robot
+  uint64_t entries(const robot_id_t &robot_id) {
+    auto &robot = robots_[robot_id];
+    std::lock_guard<std::mutex> guard(robot.lock);
+    return robot.entries;
+  }
+
+  // Ids within [first, last] that have installed entries, in order
+  std::vector<bunny_id_t> points(const robot_id_t &robot_id,
+                                 const bunny_id_t &first, const bunny_id_t &last) {
+    std::vector<bunny_id_t> result;
+    auto &robot = robots_[robot_id];
+    std::lock_guard<std::mutex> guard(robot.lock);
+    for (uint32_t id = first; id <= last;) {
+      uint32_t page = id >> SHADOW_PAGE_BITS;
+      uint32_t page_end = (page + 1) << SHADOW_PAGE_BITS;
+      if (page >= robot.pages.size() || !robot.pages[page] || robot.pages[page]->used == 0) {
+        id = page_end;
+        continue;
+      }
+      auto &points = robot.pages[page]->points;
+      for (; id <= last && id < page_end; id++) {
+        auto &point = points[id & (SHADOW_PAGE_POINTS - 1)];
+        if (point.ingress != 0 || point.egress != 0) {
+          result.push_back(static_cast<bunny_id_t>(id));
+        }
+      }
+    }
+    return result;
+  }
+
+ private:
+  struct Page {
+    Page() : used(0) {
+      for (auto &point : points) {
+        point.ingress = 0;
+        point.egress = 0;
+      }
+    }
+    shadow_point_t points[SHADOW_PAGE_POINTS];
+    uint32_t used;  // points with entries
+  };
+
+  struct Robot {
+    Robot() : entries(0) {}
+    std::mutex lock;
+    std::vector<std::unique_ptr<Page>> pages;
+    uint64_t entries;
+  };
+
+  static uint64_t railwayKey(const robot_id_t &robot_id, const bunny_id_t &from_id) {
+    return (static_cast<uint64_t>(robot_id) << 16) | from_id;
+  }
+
+  static shadow_point_t *find(Robot &robot, const bunny_id_t &bunny_id) {
+    uint32_t page = bunny_id >> SHADOW_PAGE_BITS;
+    if (page >= robot.pages.size() || !robot.pages[page]) {
+      return nullptr;
+    }
+    return &robot.pages[page]->points[bunny_id & (SHADOW_PAGE_POINTS - 1)];
+  }
+
+  static shadow_point_t &slot(Robot &robot, const bunny_id_t &bunny_id) {
+    uint32_t page = bunny_id >> SHADOW_PAGE_BITS;
+    if (page >= robot.pages.size()) {
+      robot.pages.resize(page + 1);
+    }
+    if (!robot.pages[page]) {
+      robot.pages[page].reset(new Page());
+    }
+    return robot.pages[page]->points[bunny_id & (SHADOW_PAGE_POINTS - 1)];
+  }
+
+  // Change the ingress flag or the egress joint mask of a point and keep the counters up to date
+  static void mark(Robot &robot, const bunny_id_t &bunny_id, uint8_t *mask,
+                   const uint32_t &value) {
+    auto &page = *robot.pages[bunny_id >> SHADOW_PAGE_BITS];
+    auto &point = page.points[bunny_id & (SHADOW_PAGE_POINTS - 1)];
+    bool was_used = point.ingress != 0 || point.egress != 0;
+    robot.entries -= __builtin_popcount(*mask);
+    *mask = static_cast<uint8_t>(value);
+    robot.entries += __builtin_popcount(*mask);
+    bool used = point.ingress != 0 || point.egress != 0;
+    if (used && !was_used) {
+      page.used++;
+    } else if (!used && was_used) {
+      page.used--;
+    }
+  }
+
+  Robot robots_[MAX_ROBOTS];
+  std::mutex railway_lock_;
+  ExactMatchTable<bunny_id_t> railway_;
+};
+
+// Backend that keeps a ShadowStore up to date with the successful writes of
+// another backend and serves the reads of the sw state from it. Several
+// ShadowBackends (sessions) share one store.
+//
+// The changes of a batch or a transaction are kept in a pending log of the
+// backend, the reads of the backend see them. The log reaches the store when
+// the batch is committed (endBatch and completeOperations succeed) or the
+// transaction commits, it is dropped if that fails or on abort. Writes
+// outside of them go to the store directly.
+//
+// Whole point writes use the shadow to skip driver calls: a point that is
+// not installed is not deleted, an installed point is modified directly
+// instead of trying an add first. The store is only right if cp is the only
+// writer of the tables and they are empty (or cleared) when it starts.
+class ShadowBackend : public TableBackend {
+ public:
+  ShadowBackend(std::unique_ptr<TableBackend> tables, ShadowStore *shadow)
+      : tables_(std::move(tables)), shadow_(shadow), deferred_(false), ended_(false) {}
+
+  ShadowStore *shadow() const { return shadow_; }
+
+  bf_status_t beginBatch() override {
+    if (ended_) {
+      // the last batch was ended without completeOperations
+      apply();
+    }
+    auto status = tables_->beginBatch();
+    deferred_ = status == BF_SUCCESS;
+    return status;
+  }
+
+  bf_status_t endBatch(bool hw_synchronous) override {
+    auto status = tables_->endBatch(hw_synchronous);
+    if (status != BF_SUCCESS) {
+      drop();
+    } else if (deferred_) {
+      ended_ = true;
+    }
+    return status;
+  }
+
+  bf_status_t completeOperations() override {
+    auto status = tables_->completeOperations();
+    if (ended_) {
+      if (status == BF_SUCCESS) {
+        apply();
+      } else {
+        drop();
+      }
+    }
+    return status;
+  }
+
+  bf_status_t beginTransaction() override {
+    auto status = tables_->beginTransaction();
+    deferred_ = status == BF_SUCCESS;
+    return status;
+  }
+
+  bf_status_t commitTransaction() override {
+    auto status = tables_->commitTransaction();
+    if (status == BF_SUCCESS) {
+      apply();
+    } else {
+      drop();
+    }
+    return status;
+  }
+
+  bf_status_t abortTransaction() override {
+    drop();
+    return tables_->abortTransaction();
+  }
+
+  bf_status_t iBunnyEntryAdd(const bunny_key_t &key, const bunny_data_t &data,
+                             const bool &add) override {
+    auto status = tables_->iBunnyEntryAdd(key, data, add);
+    if (status == BF_SUCCESS) {
+      auto point = get(key.robot_id, key.actual_bunny);
+      point.ingress = 1;
+      point.data = data;
+      put(key.robot_id, key.actual_bunny, point);
+    }
+    return status;
+  }
+
+  bf_status_t iBunnyEntryDel(const bunny_key_t &key) override {
+    auto point = get(key.robot_id, key.actual_bunny);
+    if (point.ingress == 0) {
+      return BF_OBJECT_NOT_FOUND;
+    }
+    auto status = tables_->iBunnyEntryDel(key);
+    if (status == BF_SUCCESS || status == BF_OBJECT_NOT_FOUND) {
+      point.ingress = 0;
+      put(key.robot_id, key.actual_bunny, point);
+    }
+    return status;
+  }
+
+  bf_status_t iBunnyEntryGet(const bunny_key_t &key, const bool &from_hw,
+                             bunny_data_t *data) override {
+    if (from_hw) {
+      return tables_->iBunnyEntryGet(key, true, data);
+    }
+    auto point = get(key.robot_id, key.actual_bunny);
+    if (point.ingress == 0) {
+      return BF_OBJECT_NOT_FOUND;
+    }
+    *data = point.data;
+    return BF_SUCCESS;
+  }
+
+  bf_status_t eBunnyEntryAdd(const bunny_key_t &key, const bunny_target_t &data,
+                             const bool &add) override {
+    auto status = tables_->eBunnyEntryAdd(key, data, add);
+    if (status == BF_SUCCESS) {
+      auto point = get(key.robot_id, key.actual_bunny);
+      point.egress |= 1u << key.jointId;
+      point.target[key.jointId] = data;
+      put(key.robot_id, key.actual_bunny, point);
+    }
+    return status;
+  }
+
+  bf_status_t eBunnyEntryDel(const bunny_key_t &key) override {
+    auto point = get(key.robot_id, key.actual_bunny);
+    if (!(point.egress & (1u << key.jointId))) {
+      return BF_OBJECT_NOT_FOUND;
+    }
+    auto status = tables_->eBunnyEntryDel(key);
+    if (status == BF_SUCCESS || status == BF_OBJECT_NOT_FOUND) {
+      point.egress &= ~(1u << key.jointId);
+      put(key.robot_id, key.actual_bunny, point);
+    }
+    return status;
+  }
+
+  bf_status_t eBunnyEntryGet(const bunny_key_t &key, const bool &from_hw,
+                             bunny_target_t *data) override {
+    if (from_hw) {
+      return tables_->eBunnyEntryGet(key, true, data);
+    }
+    auto point = get(key.robot_id, key.actual_bunny);
+    if (!(point.egress & (1u << key.jointId))) {
+      return BF_OBJECT_NOT_FOUND;
+    }
+    *data = point.target[key.jointId];
+    return BF_SUCCESS;
+  }
+
+  bf_status_t bunnyPointAdd(const trajectory_point_t &point) override {
+    auto installed = get(point.robot_id, point.bunny_id);
+    bf_status_t status;
+    if (installed.ingress != 0 && installed.egress == SHADOW_ALL_JOINTS) {
+      status = modifyPoint(point);
+    } else {
+      status = tables_->bunnyPointAdd(point);
+    }
+    if (status == BF_SUCCESS) {
+      installed.ingress = 1;
+      installed.egress = SHADOW_ALL_JOINTS;
+      installed.data.next_id = point.next_id;
+      installed.data.duration = point.duration;
+      for (int j = 0; j < NUM_JOINTS; j++) {
+        installed.target[j].tpos = point.positions[j];
+        installed.target[j].tspeed = point.speeds[j];
+      }
+      put(point.robot_id, point.bunny_id, installed);
+    }
+    return status;
+  }
+
+  bf_status_t bunnyPointDel(const robot_id_t &robot_id,
+                            const bunny_id_t &bunny_id) override {
+    auto installed = get(robot_id, bunny_id);
+    if (installed.ingress == 0 && installed.egress == 0) {
+      return BF_SUCCESS;
+    }
+    auto status = tables_->bunnyPointDel(robot_id, bunny_id);
+    if (status == BF_SUCCESS) {
+      installed.ingress = 0;
+      installed.egress = 0;
+      put(robot_id, bunny_id, installed);
+    }
+    return status;
+  }
+
+  // Only the installed points of the range reach the driver
+  bf_status_t bunnyRangeDel(const robot_id_t &robot_id, const bunny_id_t &first,
+                            const bunny_id_t &last) override {
+    for (auto bunny_id : points(robot_id, first, last)) {
+      auto status = bunnyPointDel(robot_id, bunny_id);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+    }
+    return BF_SUCCESS;
+  }
+
+  // The keys come from the pages of the robot in the shadow, the tables are
+  // not scanned
+  bf_status_t bunnyRobotKeys(const robot_id_t &robot_id, std::vector<bunny_id_t> *bunny_ids,
+                             std::vector<bunny_id_t> *from_ids) override {
+    *bunny_ids = points(robot_id, 0, static_cast<bunny_id_t>((1u << 16) - 1));
+    *from_ids = railways(robot_id);
+    return BF_SUCCESS;
+  }
+
+  bf_status_t railwayEntryAdd(const robot_id_t &robot_id, const bunny_id_t &from_id,
+                              const bunny_id_t &to_id) override {
+    auto status = tables_->railwayEntryAdd(robot_id, from_id, to_id);
+    if (status == BF_SUCCESS) {
+      putRailway(robot_id, from_id, to_id);
+    }
+    return status;
+  }
+
+  bf_status_t railwayEntryMod(const robot_id_t &robot_id, const bunny_id_t &from_id,
+                              const bunny_id_t &to_id) override {
+    auto status = tables_->railwayEntryMod(robot_id, from_id, to_id);
+    if (status == BF_SUCCESS) {
+      putRailway(robot_id, from_id, to_id);
+    }
+    return status;
+  }
+
+  bf_status_t railwayEntryDel(const robot_id_t &robot_id,
+                              const bunny_id_t &from_id) override {
+    auto status = tables_->railwayEntryDel(robot_id, from_id);
+    if (status == BF_SUCCESS || status == BF_OBJECT_NOT_FOUND) {
+      putRailway(robot_id, from_id, -1);
+    }
+    return status;
+  }
+
+  // The speed limits and the functions are not shadowed
+  bf_status_t speedLimitEntryAdd(const speed_limit_entry_t &entry,
+                                 const bool &add) override {
+    return tables_->speedLimitEntryAdd(entry, add);
+  }
+  bf_status_t speedLimitEntryDel(const speed_limit_key_t &key) override {
+    return tables_->speedLimitEntryDel(key);
+  }
+  bf_status_t robotClassSet(const robot_id_t &robot_id,
+                            const robot_class_t &robot_class) override {
+    return tables_->robotClassSet(robot_id, robot_class);
+  }
+
+  bf_status_t functionEntryAdd(const uint32_t &function,
+                               const function_entry_t &entry) override {
+    return tables_->functionEntryAdd(function, entry);
+  }
+  bf_status_t functionEntryDel(const uint32_t &function,
+                               const function_key_t &key) override {
+    return tables_->functionEntryDel(function, key);
+  }
+  bf_status_t functionVersionSet(const uint8_t &version) override {
+    return tables_->functionVersionSet(version);
+  }
+
+  bf_status_t bunnyClear() override {
+    auto status = tables_->bunnyClear();
+    if (status == BF_SUCCESS) {
+      if (deferred_) {
+        pending_ = PendingLog();
+        pending_.cleared = true;
+      } else {
+        shadow_->clear();
+      }
+    }
+    return status;
+  }
+
+  // Scans read the tables, not the shadow: they are used to audit it.
+  bf_status_t iBunnyScan(const bool &from_hw, const uint32_t &pipe, const uint32_t &chunk,
+                         const std::function<bool(const bunny_entry_t &)> &f) override {
+    return tables_->iBunnyScan(from_hw, pipe, chunk, f);
+  }
+
+  bf_status_t eBunnyScan(const bool &from_hw, const uint32_t &pipe, const uint32_t &chunk,
+                         const std::function<bool(const bunny_e_entry_t &)> &f) override {
+    return tables_->eBunnyScan(from_hw, pipe, chunk, f);
+  }
+
+  bf_status_t railwayScan(const bool &from_hw, const uint32_t &pipe, const uint32_t &chunk,
+                          const std::function<bool(const railway_entry_t &)> &f) override {
+    return tables_->railwayScan(from_hw, pipe, chunk, f);
+  }
+
+  bf_status_t actualBunnyGet(const robot_id_t &robot_id,
+                             bunny_id_t *bunny_id) override {
+    return tables_->actualBunnyGet(robot_id, bunny_id);
+  }
+
+  bf_status_t actualBunnySet(const robot_id_t &robot_id,
+                             const bunny_id_t &bunny_id) override {
+    return tables_->actualBunnySet(robot_id, bunny_id);
+  }
+
+  bf_status_t progressRead(robot_progress_t *progress) override {
+    return tables_->progressRead(progress);
+  }
+
+  bf_status_t progressListen(ProgressListener *listener) override {
+    return tables_->progressListen(listener);
+  }
+
+ private:
+  bf_status_t modifyPoint(const trajectory_point_t &point) {
+    bunny_key_t key;
+    key.robot_id = point.robot_id;
+    key.actual_bunny = point.bunny_id;
+    bunny_data_t data;
+    data.next_id = point.next_id;
+    data.duration = point.duration;
+    key.jointId = 0;
+    auto status = tables_->iBunnyEntryAdd(key, data, false);
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    for (int j = 0; j < NUM_JOINTS; j++) {
+      key.jointId = j;
+      bunny_target_t target;
+      target.tpos = point.positions[j];
+      target.tspeed = point.speeds[j];
+      status = tables_->eBunnyEntryAdd(key, target, false);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+    }
+    return BF_SUCCESS;
+  }
+
+  // The changes of the open batch or transaction: the points and switch
+  // entries they wrote, in their state after it
+  struct PendingLog {
+    bool cleared = false;                        // bunnyClear in the batch
+    std::map<uint32_t, shadow_point_t> points;   // by key(), masks 0: deleted
+    std::map<uint32_t, int32_t> railways;        // to_id by key(), -1: deleted
+  };
+
+  static uint32_t key(const robot_id_t &robot_id, const bunny_id_t &bunny_id) {
+    return (static_cast<uint32_t>(robot_id) << 16) | bunny_id;
+  }
+
+  // The point as this backend sees it, the pending log over the store
+  shadow_point_t get(const robot_id_t &robot_id, const bunny_id_t &bunny_id) {
+    auto pending = pending_.points.find(key(robot_id, bunny_id));
+    if (pending != pending_.points.end()) {
+      return pending->second;
+    }
+    shadow_point_t point;
+    if (pending_.cleared || !shadow_->getPoint(robot_id, bunny_id, &point)) {
+      point.ingress = 0;
+      point.egress = 0;
+    }
+    return point;
+  }
+
+  void put(const robot_id_t &robot_id, const bunny_id_t &bunny_id,
+           const shadow_point_t &point) {
+    if (deferred_) {
+      pending_.points[key(robot_id, bunny_id)] = point;
+    } else {
+      shadow_->putPoint(robot_id, bunny_id, point);
+    }
+  }
+
+  void putRailway(const robot_id_t &robot_id, const bunny_id_t &from_id, const int32_t &to_id) {
+    if (deferred_) {
+      pending_.railways[key(robot_id, from_id)] = to_id;
+    } else if (to_id < 0) {
+      shadow_->railwayDel(robot_id, from_id);
+    } else {
+      shadow_->railwaySet(robot_id, from_id, static_cast<bunny_id_t>(to_id));
+    }
+  }
+
+  // Installed ids within [first, last], in order
+  std::vector<bunny_id_t> points(const robot_id_t &robot_id, const bunny_id_t &first,
+                                 const bunny_id_t &last) {
+    std::vector<bunny_id_t> stored;
+    if (!pending_.cleared) {
+      stored = shadow_->points(robot_id, first, last);
+    }
+    auto pending = pending_.points.lower_bound(key(robot_id, first));
+    auto pending_end = pending_.points.upper_bound(key(robot_id, last));
+    if (pending == pending_end) {
+      return stored;
+    }
+    std::vector<bunny_id_t> result;
+    auto installed = [](const shadow_point_t &point) {
+      return point.ingress != 0 || point.egress != 0;
+    };
+    for (auto bunny_id : stored) {
+      for (; pending != pending_end && pending->first < key(robot_id, bunny_id); ++pending) {
+        if (installed(pending->second)) {
+          result.push_back(static_cast<bunny_id_t>(pending->first));
+        }
+      }
+      if (pending != pending_end && pending->first == key(robot_id, bunny_id)) {
+        if (installed(pending->second)) {
+          result.push_back(bunny_id);
+        }
+        ++pending;
+      } else {
+        result.push_back(bunny_id);
+      }
+    }
+    for (; pending != pending_end; ++pending) {
+      if (installed(pending->second)) {
+        result.push_back(static_cast<bunny_id_t>(pending->first));
+      }
+    }
+    return result;
+  }
+
+  // from_ids of the switch entries of the robot
+  std::vector<bunny_id_t> railways(const robot_id_t &robot_id) {
+    std::vector<bunny_id_t> result;
+    if (!pending_.cleared) {
+      for (auto from_id : shadow_->railways(robot_id)) {
+        if (pending_.railways.count(key(robot_id, from_id)) == 0) {
+          result.push_back(from_id);
+        }
+      }
+    }
+    auto pending = pending_.railways.lower_bound(key(robot_id, 0));
+    for (; pending != pending_.railways.end() && (pending->first >> 16) == robot_id; ++pending) {
+      if (pending->second >= 0) {
+        result.push_back(static_cast<bunny_id_t>(pending->first));
+      }
+    }
+    return result;
+  }
+
+  // The batch or transaction is committed
+  void apply() {
+    if (pending_.cleared) {
+      shadow_->clear();
+    }
+    for (auto &entry : pending_.points) {
+      shadow_->putPoint(static_cast<robot_id_t>(entry.first >> 16),
+                        static_cast<bunny_id_t>(entry.first), entry.second);
+    }
+    for (auto &entry : pending_.railways) {
+      auto robot_id = static_cast<robot_id_t>(entry.first >> 16);
+      auto from_id = static_cast<bunny_id_t>(entry.first);
+      if (entry.second < 0) {
+        shadow_->railwayDel(robot_id, from_id);
+      } else {
+        shadow_->railwaySet(robot_id, from_id, static_cast<bunny_id_t>(entry.second));
+      }
+    }
+    drop();
+  }
+
+  void drop() {
+    pending_ = PendingLog();
+    deferred_ = false;
+    ended_ = false;
+  }
+
+  std::unique_ptr<TableBackend> tables_;
+  ShadowStore *shadow_;
+  bool deferred_;  // in a batch or a transaction, changes go to pending_
+  bool ended_;     // the batch is ended, waiting for completeOperations
+  PendingLog pending_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef SPEED_LIMIT_HPP
+#define SPEED_LIMIT_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "fixed_point.hpp"
+#include "table_backend.hpp"
+
+// Default joint speed limit (rad/s), JOINT_SPEED_LIMITS of
+// gen_speed_limit_entries.py
+#define DEFAULT_SPEED_LIMIT 3.5
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Append the entries of SwitchEgress.speed_limit that replace the speeds
+// beyond limit with limit: the prefix cover of get_lpm in
+// gen_speed_limit_entries.py, entry for entry. For a positive limit every 0
+// bit of the limit below the sign gives the prefix of the speeds above it
+// with a 1 there, for a negative one every 1 bit gives the speeds below it.
+// The key of entry gives the class and the joint.
+inline void speed_limit_cover(const double &limit, speed_limit_entry_t entry,
+                              std::vector<speed_limit_entry_t> *entries) {
+  const dec_t bits = double_to_dec(limit);
+  const bool negative = limit < 0;
+  // the sign of the prefix comes from the limit, not from its dec_t
+  dec_t prefix = negative ? 1ULL << 63 : 0;
+  entry.speed = bits;
+  for (int i = 62; i >= 0; i--) {
+    dec_t bit = (bits >> i) & 1;
+    if (bit == (negative ? 1u : 0u)) {
+      entry.key.value = prefix | (negative ? 0 : 1ULL << i);
+      entry.key.mask = ~0ULL << i;
+      entries->push_back(entry);
+    }
+    prefix |= bit << i;
+  }
+}
+
+// The entries limiting the speed of the joint to [-limit, limit], the same
+// as print_lpm_p4(joint, limit) and print_lpm_p4(joint, -limit)
+inline void speed_limit_entries(const robot_class_t &robot_class,
+                                const joint_id_t &joint_id, const double &limit,
+                                std::vector<speed_limit_entry_t> *entries) {
+  speed_limit_entry_t entry;
+  entry.key.robot_class = robot_class;
+  entry.key.jointId = joint_id;
+  speed_limit_cover(limit, entry, entries);
+  speed_limit_cover(-limit, entry, entries);
+}
+
+// Entry counts of one SpeedLimits::set
+struct SpeedLimitStats {
+  uint32_t adds = 0;
+  uint32_t mods = 0;
+  uint32_t dels = 0;
+  uint32_t unchanged = 0;
+};
+
+// The joint speed limits of the robot classes installed in
+// SwitchEgress.speed_limit, which starts empty. A class is replaced in one
+// transaction with the difference of the old and the new entries, so the
+// data plane sees either the old or the new limits of all joints of the
+// class. A limit of 0 removes the limit of the joint.
+//
+// Not thread-safe, used with the backend of one thread.
+class SpeedLimits {
+ public:
+  SpeedLimits() {
+    for (auto &limits : limits_) {
+      for (auto &limit : limits) {
+        limit = 0;
+      }
+    }
+  }
+
+  // Limits in rad/s. On an error the transaction is aborted and the old
+  // limits of the class stay installed.
+  bf_status_t set(TableBackend *tables, const robot_class_t &robot_class,
+                  const double limits[NUM_JOINTS], SpeedLimitStats *stats = nullptr) {
+    if (robot_class >= NUM_ROBOT_CLASSES) {
+      return BF_INVALID_ARG;
+    }
+    std::vector<speed_limit_entry_t> entries;
+    for (int j = 0; j < NUM_JOINTS; j++) {
+      // keeps double_to_dec in range, false for NaN
+      if (!(limits[j] >= 0 && limits[j] < 1e6)) {
+        return BF_INVALID_ARG;
+      }
+      if (limits[j] > 0) {
+        speed_limit_entries(robot_class, j, limits[j], &entries);
+      }
+    }
+    auto by_key = [](const speed_limit_entry_t &a, const speed_limit_entry_t &b) {
+      return a.key < b.key;
+    };
+    std::sort(entries.begin(), entries.end(), by_key);
+
+    // deletes first, they make room for the adds
+    auto &installed = installed_[robot_class];
+    std::vector<const speed_limit_entry_t *> dels, mods, adds;
+    SpeedLimitStats counts;
+    size_t i = 0, k = 0;
+    while (i < installed.size() || k < entries.size()) {
+      if (k == entries.size() || (i < installed.size() && installed[i].key < entries[k].key)) {
+        dels.push_back(&installed[i++]);
+      } else if (i == installed.size() || entries[k].key < installed[i].key) {
+        adds.push_back(&entries[k++]);
+      } else {
+        if (installed[i].speed != entries[k].speed) {
+          mods.push_back(&entries[k]);
+        } else {
+          counts.unchanged++;
+        }
+        i++;
+        k++;
+      }
+    }
+    counts.dels = dels.size();
+    counts.mods = mods.size();
+    counts.adds = adds.size();
+
+    auto status = tables->beginTransaction();
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    for (auto entry : dels) {
+      status = tables->speedLimitEntryDel(entry->key);
+      if (status != BF_SUCCESS) {
+        tables->abortTransaction();
+        return status;
+      }
+    }
+    for (auto entry : mods) {
+      status = tables->speedLimitEntryAdd(*entry, false);
+      if (status != BF_SUCCESS) {
+        tables->abortTransaction();
+        return status;
+      }
+    }
+    for (auto entry : adds) {
+      status = tables->speedLimitEntryAdd(*entry, true);
+      if (status != BF_SUCCESS) {
+        tables->abortTransaction();
+        return status;
+      }
+    }
+    status = tables->commitTransaction();
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+
+    installed.swap(entries);
+    std::copy(limits, limits + NUM_JOINTS, limits_[robot_class]);
+    if (stats != nullptr) {
+      *stats = counts;
+    }
+    return BF_SUCCESS;
+  }
+
+  // The installed limits of the class, 0: no limit
+  bool get(const robot_class_t &robot_class, double limits[NUM_JOINTS]) const {
+    if (robot_class >= NUM_ROBOT_CLASSES) {
+      return false;
+    }
+    std::copy(limits_[robot_class], limits_[robot_class] + NUM_JOINTS, limits);
+    return true;
+  }
+
+  // Installed entries of the class
+  size_t size(const robot_class_t &robot_class) const {
+    return robot_class < NUM_ROBOT_CLASSES ? installed_[robot_class].size() : 0;
+  }
+
+ private:
+  // sorted by key
+  std::vector<speed_limit_entry_t> installed_[NUM_ROBOT_CLASSES];
+  double limits_[NUM_ROBOT_CLASSES][NUM_JOINTS];
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
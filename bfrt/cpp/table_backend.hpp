@@ -0,0 +1,247 @@
+#ifndef TABLE_BACKEND_HPP
+#define TABLE_BACKEND_HPP
+
+#include <functional>
+#include <vector>
+
+#include "cp_types.hpp"
+
+// Entries per driver call of the table scans of cp
+#define TABLE_SCAN_CHUNK 1024
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Receiver of the progress digests of ur.p4: the data plane moved a robot
+// to a new bunny. Called from the driver's notification thread.
+class ProgressListener {
+ public:
+  virtual ~ProgressListener() {}
+
+  virtual void progress(const robot_id_t &robot_id,
+                        const robot_progress_t &progress) = 0;
+};
+
+// Calls f(first, last) for every run of consecutive ids of sorted ids
+template <typename F>
+void bunny_id_runs(const std::vector<bunny_id_t> &ids, F f) {
+  for (size_t i = 0; i < ids.size();) {
+    size_t j = i + 1;
+    while (j < ids.size() && ids[j] == ids[j - 1] + 1) {
+      j++;
+    }
+    f(ids[i], ids[j - 1]);
+    i = j;
+  }
+}
+
+// Everything the control plane writes to or reads from the switch goes
+// through this interface. One backend object behaves like one BfRt session:
+// it has its own batch state and must be used from one thread at a time.
+//
+// Implementations:
+//   - BfRtBackend (cp.cpp): the real tables through the BfRt API
+//   - MemBackend (mem_backend.hpp): in-memory stand-in, no Tofino needed
+class TableBackend {
+ public:
+  virtual ~TableBackend() {}
+
+  // Batch and session handling, same semantics as BfRtSession
+  virtual bf_status_t beginBatch() = 0;
+  virtual bf_status_t endBatch(bool hw_synchronous) = 0;
+  virtual bf_status_t completeOperations() = 0;
+
+  // An atomic batch: the data plane sees either all of its operations or
+  // none of them, abort drops them. Same semantics as the transactions of
+  // BfRtSession. Only used for the speed limits.
+  virtual bf_status_t beginTransaction() = 0;
+  virtual bf_status_t commitTransaction() = 0;
+  virtual bf_status_t abortTransaction() = 0;
+
+  // SwitchIngress.bunny, one entry per trajectory point: key.jointId is
+  // ignored
+  virtual bf_status_t iBunnyEntryAdd(const bunny_key_t &key,
+                                     const bunny_data_t &data,
+                                     const bool &add) = 0;
+  virtual bf_status_t iBunnyEntryDel(const bunny_key_t &key) = 0;
+  virtual bf_status_t iBunnyEntryGet(const bunny_key_t &key,
+                                     const bool &from_hw,
+                                     bunny_data_t *data) = 0;
+
+  // SwitchEgress.bunny_e
+  virtual bf_status_t eBunnyEntryAdd(const bunny_key_t &key,
+                                     const bunny_target_t &data,
+                                     const bool &add) = 0;
+  virtual bf_status_t eBunnyEntryDel(const bunny_key_t &key) = 0;
+  virtual bf_status_t eBunnyEntryGet(const bunny_key_t &key,
+                                     const bool &from_hw,
+                                     bunny_target_t *data) = 0;
+
+  // Both tables: the 7 entries of a trajectory point. Add overwrites the
+  // already installed entries, delete skips the missing ones. The default
+  // implementation makes 7 single entry calls.
+  virtual bf_status_t bunnyPointAdd(const trajectory_point_t &point) {
+    bunny_key_t key;
+    key.robot_id = point.robot_id;
+    key.actual_bunny = point.bunny_id;
+    key.jointId = 0;
+    bunny_data_t data;
+    data.next_id = point.next_id;
+    data.duration = point.duration;
+    auto status = iBunnyEntryAdd(key, data, true);
+    if (status == BF_ALREADY_EXISTS) {
+      status = iBunnyEntryAdd(key, data, false);
+    }
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+
+    for (int j = 0; j < NUM_JOINTS; j++) {
+      key.jointId = j;
+      bunny_target_t target;
+      target.tpos = point.positions[j];
+      target.tspeed = point.speeds[j];
+      status = eBunnyEntryAdd(key, target, true);
+      if (status == BF_ALREADY_EXISTS) {
+        status = eBunnyEntryAdd(key, target, false);
+      }
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+    }
+    return BF_SUCCESS;
+  }
+
+  virtual bf_status_t bunnyPointDel(const robot_id_t &robot_id,
+                                    const bunny_id_t &bunny_id) {
+    bunny_key_t key;
+    key.robot_id = robot_id;
+    key.actual_bunny = bunny_id;
+    key.jointId = 0;
+    auto status = iBunnyEntryDel(key);
+    if (status != BF_SUCCESS && status != BF_OBJECT_NOT_FOUND) {
+      return status;
+    }
+    for (int j = 0; j < NUM_JOINTS; j++) {
+      key.jointId = j;
+      status = eBunnyEntryDel(key);
+      if (status != BF_SUCCESS && status != BF_OBJECT_NOT_FOUND) {
+        return status;
+      }
+    }
+    return BF_SUCCESS;
+  }
+
+  // The points of the robot within [first, last], missing entries are
+  // skipped. Like the other writes it only adds operations to the open
+  // batch, so a whole range is pushed with one commit.
+  virtual bf_status_t bunnyRangeDel(const robot_id_t &robot_id,
+                                    const bunny_id_t &first,
+                                    const bunny_id_t &last) {
+    for (uint32_t id = first; id <= last; id++) {
+      auto status = bunnyPointDel(robot_id, static_cast<bunny_id_t>(id));
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+    }
+    return BF_SUCCESS;
+  }
+
+  // The installed keys of the robot: the ids of its points with a bunny or
+  // bunny_e entry, in order, and the from_ids of its railway_switch entries.
+  // A read of the sw state, so it does not belong in an open batch.
+  virtual bf_status_t bunnyRobotKeys(const robot_id_t &robot_id,
+                                     std::vector<bunny_id_t> *bunny_ids,
+                                     std::vector<bunny_id_t> *from_ids) = 0;
+
+  // Delete the entries of the robot with the keys bunnyRobotKeys returned,
+  // read before the batch is opened: the points are deleted in runs of
+  // consecutive ids instead of trying the whole id space.
+  virtual bf_status_t bunnyRobotClear(const robot_id_t &robot_id,
+                                      const std::vector<bunny_id_t> &bunny_ids,
+                                      const std::vector<bunny_id_t> &from_ids) {
+    bf_status_t status = BF_SUCCESS;
+    bunny_id_runs(bunny_ids, [&](const bunny_id_t &first, const bunny_id_t &last) {
+      if (status == BF_SUCCESS) {
+        status = bunnyRangeDel(robot_id, first, last);
+      }
+    });
+    for (size_t i = 0; status == BF_SUCCESS && i < from_ids.size(); i++) {
+      status = railwayEntryDel(robot_id, from_ids[i]);
+      if (status == BF_OBJECT_NOT_FOUND) {
+        status = BF_SUCCESS;
+      }
+    }
+    return status;
+  }
+
+  // SwitchIngress.railway_switch
+  virtual bf_status_t railwayEntryAdd(const robot_id_t &robot_id,
+                                      const bunny_id_t &from_id,
+                                      const bunny_id_t &to_id) = 0;
+  // Redirect an existing entry to to_id, in place
+  virtual bf_status_t railwayEntryMod(const robot_id_t &robot_id,
+                                      const bunny_id_t &from_id,
+                                      const bunny_id_t &to_id) = 0;
+  virtual bf_status_t railwayEntryDel(const robot_id_t &robot_id,
+                                      const bunny_id_t &from_id) = 0;
+
+  // SwitchEgress.speed_limit
+  virtual bf_status_t speedLimitEntryAdd(const speed_limit_entry_t &entry,
+                                         const bool &add) = 0;
+  virtual bf_status_t speedLimitEntryDel(const speed_limit_key_t &key) = 0;
+
+  // SwitchEgress.robot_class, robots without an entry are of class 0
+  virtual bf_status_t robotClassSet(const robot_id_t &robot_id,
+                                    const robot_class_t &robot_class) = 0;
+
+  // SwitchEgress.actual_speed_function, target_speed_function and
+  // diff_speed_function (function: FUNCTION_*)
+  virtual bf_status_t functionEntryAdd(const uint32_t &function,
+                                       const function_entry_t &entry) = 0;
+  virtual bf_status_t functionEntryDel(const uint32_t &function,
+                                       const function_key_t &key) = 0;
+
+  // SwitchEgress.function_version: the version of the function entries in
+  // use, one write switches all three tables
+  virtual bf_status_t functionVersionSet(const uint8_t &version) = 0;
+
+  // Clear bunny, bunny_e and railway_switch with the table clear of the
+  // driver, not entry by entry
+  virtual bf_status_t bunnyClear() = 0;
+
+  // Read back every installed entry of a table from the sw or the hw state
+  // of one pipe (ALL_PIPES: the symmetric tables). The entries are read
+  // chunk entries at a time, f is called for each of them and stops the
+  // scan by returning false. The order is the one of the table.
+  virtual bf_status_t iBunnyScan(const bool &from_hw, const uint32_t &pipe,
+                                 const uint32_t &chunk,
+                                 const std::function<bool(const bunny_entry_t &)> &f) = 0;
+  virtual bf_status_t eBunnyScan(const bool &from_hw, const uint32_t &pipe,
+                                 const uint32_t &chunk,
+                                 const std::function<bool(const bunny_e_entry_t &)> &f) = 0;
+  virtual bf_status_t railwayScan(const bool &from_hw, const uint32_t &pipe,
+                                  const uint32_t &chunk,
+                                  const std::function<bool(const railway_entry_t &)> &f) = 0;
+
+  // SwitchIngress.r_actual_bunny
+  virtual bf_status_t actualBunnyGet(const robot_id_t &robot_id,
+                                     bunny_id_t *bunny_id) = 0;
+  virtual bf_status_t actualBunnySet(const robot_id_t &robot_id,
+                                     const bunny_id_t &bunny_id) = 0;
+
+  // r_actual_bunny, r_next_bunny and end_time of every robot (MAX_ROBOTS
+  // entries of progress), one hardware sync per register for all of them
+  virtual bf_status_t progressRead(robot_progress_t *progress) = 0;
+
+  // Deliver the progress digests of every robot to listener (nullptr: stop)
+  // on the session of this backend, which must outlive the registration.
+  virtual bf_status_t progressListen(ProgressListener *listener) = 0;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef TRAJ_CSV_HPP
+#define TRAJ_CSV_HPP
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "cp_types.hpp"
+#include "fixed_point.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+/*******************************************************************************
+ * Trajectory csv parser (trajs.csv layout: time, timesecs, timens, 6 pos,
+ * 6 vel, 6 acc, with a header line).
+ *
+ * The separators are found 16 bytes at a time (SSE2), only the used columns
+ * are converted, and the values are turned into the units of the switch
+ * (doubles_to_dec, msec_to_int) at the end of each line. Ids and durations
+ * are the same as in proxy.py:get_traj_from_lines.
+ ******************************************************************************/
+
+#define TRAJ_CSV_COLUMNS 15  // time, timesecs, timens, 6 pos, 6 vel are used
+
+// Bit mask of the ',' and '\n' bytes among the 16 bytes at p
+inline uint32_t csv_separators16(const char *p) {
+#ifdef __SSE2__
+  __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  __m128i commas = _mm_cmpeq_epi8(block, _mm_set1_epi8(','));
+  __m128i newlines = _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'));
+  return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(commas, newlines)));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < 16; i++) {
+    if (p[i] == ',' || p[i] == '\n') {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+#endif
+}
+
+inline bool csv_is_space(const char &c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Parse a decimal number. Plain decimals of at most 19 digits are converted
+// with one exact division (correctly rounded, like float() in Python), the
+// rest falls back to strtod.
+inline bool csv_parse_double(const char *b, const char *e, double *value) {
+  static const double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                 1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  while (b < e && csv_is_space(*b)) {
+    b++;
+  }
+  while (e > b && csv_is_space(e[-1])) {
+    e--;
+  }
+  if (b == e) {
+    return false;
+  }
+
+  const char *p = b;
+  bool negative = *p == '-';
+  if (*p == '-' || *p == '+') {
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int fraction = 0;
+  while (p < e && *p >= '0' && *p <= '9') {
+    mantissa = mantissa * 10 + (*p++ - '0');
+    digits++;
+  }
+  if (p < e && *p == '.') {
+    p++;
+    while (p < e && *p >= '0' && *p <= '9') {
+      mantissa = mantissa * 10 + (*p++ - '0');
+      digits++;
+      fraction++;
+    }
+  }
+  if (p == e && digits > 0 && digits <= 19 && mantissa <= (1ULL << 53) && fraction <= 22) {
+    double v = static_cast<double>(mantissa) / pow10[fraction];
+    *value = negative ? -v : v;
+    return true;
+  }
+
+  char buff[64];
+  size_t len = e - b;
+  if (len >= sizeof(buff)) {
+    return false;
+  }
+  memcpy(buff, b, len);
+  buff[len] = '\0';
+  char *end;
+  *value = strtod(buff, &end);
+  return end == buff + len;
+}
+
+class TrajCsvParser {
+ public:
+  // The points get the ids shift, shift + 1, ... With loop the last point
+  // continues with the first one (client.py), otherwise with the next id.
+  TrajCsvParser(const robot_id_t &robot_id, const int32_t &shift,
+                const bool &loop = false)
+      : robot_id_(robot_id), shift_(shift), loop_(loop), count_(0), field_(0),
+        time_missing_(false), error_(false), time_(0), values_(), row_(), have_prev_(false),
+        prev_time_(0), prev_() {}
+
+  // Parse a whole csv and call emit(const trajectory_point_t &) for every
+  // point, in order. Returns the number of points, or -1 if a line is
+  // malformed (the points before it are already emitted).
+  template <typename F>
+  int64_t parse(const char *data, const size_t &size, F emit) {
+    count_ = 0;
+    field_ = 0;
+    time_missing_ = false;
+    have_prev_ = false;
+    error_ = false;
+
+    // skip the header line
+    auto header_end = static_cast<const char *>(memchr(data, '\n', size));
+    if (header_end == nullptr) {
+      return 0;
+    }
+    size_t start = header_end - data + 1;
+
+    size_t field_start = start;
+    size_t i = start;
+    while (i < size && !error_) {
+      uint32_t mask;
+      if (i + 16 <= size) {
+        mask = csv_separators16(data + i);
+      } else {
+        mask = 0;
+        for (size_t k = i; k < size; k++) {
+          if (data[k] == ',' || data[k] == '\n') {
+            mask |= 1u << (k - i);
+          }
+        }
+      }
+      while (mask != 0 && !error_) {
+        size_t pos = i + __builtin_ctz(mask);
+        field(data + field_start, data + pos);
+        if (data[pos] == '\n') {
+          endLine(emit);
+        }
+        field_start = pos + 1;
+        mask &= mask - 1;
+      }
+      i += 16;
+    }
+    if (!error_ && field_start < size) {
+      // no new line at the end of the file
+      field(data + field_start, data + size);
+      endLine(emit);
+    }
+    if (error_) {
+      return -1;
+    }
+
+    if (have_prev_) {
+      prev_.next_id = loop_ ? static_cast<bunny_id_t>(shift_)
+                            : static_cast<bunny_id_t>(prev_.bunny_id + 1);
+      prev_.duration = msec_to_int(2000);
+      emit(prev_);
+    }
+    return count_;
+  }
+
+ private:
+  void field(const char *b, const char *e) {
+    int index = field_++;
+    if (index >= TRAJ_CSV_COLUMNS || index == 1 || index == 2) {
+      return;
+    }
+    if (index == 0 && b == e) {
+      time_missing_ = true;  // empty line or missing time, see endLine
+      return;
+    }
+    double value;
+    if (!csv_parse_double(b, e, &value)) {
+      error_ = true;
+      return;
+    }
+    if (index == 0) {
+      time_ = value;
+    } else {
+      values_[index - 3] = value;
+    }
+  }
+
+  template <typename F>
+  void endLine(F emit) {
+    int fields = field_;
+    bool time_missing = time_missing_;
+    field_ = 0;
+    time_missing_ = false;
+    if (fields <= 1) {
+      return;  // empty line
+    }
+    if (fields < TRAJ_CSV_COLUMNS || time_missing) {
+      error_ = true;
+      return;
+    }
+
+    // the duration of the previous point is known now
+    if (have_prev_) {
+      double ms = 1000 * (time_ - prev_time_);
+      prev_.duration = msec_to_int(ms > 0 ? static_cast<uint64_t>(ms) : 0);
+      emit(prev_);
+    }
+    doubles_to_dec(values_, row_.positions, NUM_JOINTS);
+    doubles_to_dec(values_ + NUM_JOINTS, row_.speeds, NUM_JOINTS);
+    row_.robot_id = robot_id_;
+    row_.bunny_id = static_cast<bunny_id_t>(shift_ + count_);
+    row_.next_id = static_cast<bunny_id_t>(shift_ + count_ + 1);
+    prev_ = row_;
+    prev_time_ = time_;
+    have_prev_ = true;
+    count_++;
+  }
+
+  robot_id_t robot_id_;
+  int32_t shift_;
+  bool loop_;
+
+  int64_t count_;
+  int field_;
+  bool time_missing_;
+  bool error_;
+  double time_;
+  // positions and speeds of the line
+  double values_[2 * NUM_JOINTS];
+  trajectory_point_t row_;
+  bool have_prev_;
+  double prev_time_;
+  trajectory_point_t prev_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef TRAJ_DELTA_HPP
+#define TRAJ_DELTA_HPP
+
+#include <vector>
+
+#include "table_backend.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Entry counts of a delta upload
+struct DeltaStats {
+  uint64_t adds = 0;
+  uint64_t mods = 0;
+  uint64_t dels = 0;
+  uint64_t unchanged = 0;
+};
+
+// Replace the installed trajectory of a robot with a replanned one without
+// reinstalling it. points are the new trajectory of one robot, consecutive
+// ids from points[0].bunny_id. The installed entries are read back (sw
+// state) and compared:
+//   - missing entries are added
+//   - entries whose next_id/duration (bunny) or tpos/tspeed (bunny_e)
+//     changed are modified with tableEntryMod
+//   - the installed points after the new last one are deleted (up to the
+//     first missing id)
+// The writes are committed in one batch, the reads are made before it.
+class DeltaUploader {
+ public:
+  explicit DeltaUploader(TableBackend *tables) : tables_(tables) {}
+
+  bf_status_t upload(const std::vector<trajectory_point_t> &points, DeltaStats *stats) {
+    *stats = DeltaStats();
+    ops_.clear();
+    if (points.empty()) {
+      return BF_SUCCESS;
+    }
+
+    for (auto &point : points) {
+      auto status = diff(point, stats);
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+    }
+
+    // the tail of the old trajectory
+    auto &last = points.back();
+    bunny_key_t key;
+    key.robot_id = last.robot_id;
+    key.jointId = 0;
+    bunny_data_t data;
+    for (uint32_t id = last.bunny_id + 1; id < (1u << 16); id++) {
+      key.actual_bunny = static_cast<bunny_id_t>(id);
+      auto status = tables_->iBunnyEntryGet(key, false, &data);
+      if (status == BF_OBJECT_NOT_FOUND) {
+        break;
+      }
+      if (status != BF_SUCCESS) {
+        return status;
+      }
+      DeltaOp op;
+      op.kind = DeltaOp::POINT_DEL;
+      op.key = key;
+      ops_.push_back(op);
+      stats->dels += NUM_JOINTS + 1;
+    }
+
+    return execute();
+  }
+
+ private:
+  struct DeltaOp {
+    enum { I_SET, E_SET, POINT_DEL } kind;
+    bool add;
+    bunny_key_t key;
+    bunny_data_t data;
+    bunny_target_t target;
+  };
+
+  bf_status_t diff(const trajectory_point_t &point, DeltaStats *stats) {
+    bunny_key_t key;
+    key.robot_id = point.robot_id;
+    key.actual_bunny = point.bunny_id;
+    key.jointId = 0;
+
+    // the one bunny entry of the point
+    DeltaOp op;
+    op.key = key;
+    op.kind = DeltaOp::I_SET;
+    op.data.next_id = point.next_id;
+    op.data.duration = point.duration;
+    bunny_data_t data;
+    auto status = tables_->iBunnyEntryGet(key, false, &data);
+    if (status == BF_OBJECT_NOT_FOUND) {
+      op.add = true;
+      ops_.push_back(op);
+      stats->adds++;
+    } else if (status != BF_SUCCESS) {
+      return status;
+    } else if (data.next_id != op.data.next_id || data.duration != op.data.duration) {
+      op.add = false;
+      ops_.push_back(op);
+      stats->mods++;
+    } else {
+      stats->unchanged++;
+    }
+
+    op.kind = DeltaOp::E_SET;
+    for (int j = 0; j < NUM_JOINTS; j++) {
+      key.jointId = j;
+      op.key = key;
+      op.target.tpos = point.positions[j];
+      op.target.tspeed = point.speeds[j];
+      bunny_target_t target;
+      status = tables_->eBunnyEntryGet(key, false, &target);
+      if (status == BF_OBJECT_NOT_FOUND) {
+        op.add = true;
+        ops_.push_back(op);
+        stats->adds++;
+      } else if (status != BF_SUCCESS) {
+        return status;
+      } else if (target.tpos != op.target.tpos || target.tspeed != op.target.tspeed) {
+        op.add = false;
+        ops_.push_back(op);
+        stats->mods++;
+      } else {
+        stats->unchanged++;
+      }
+    }
+    return BF_SUCCESS;
+  }
+
+  bf_status_t execute() {
+    if (ops_.empty()) {
+      return BF_SUCCESS;
+    }
+    auto status = tables_->beginBatch();
+    if (status != BF_SUCCESS) {
+      return status;
+    }
+    for (size_t i = 0; status == BF_SUCCESS && i < ops_.size(); i++) {
+      auto &op = ops_[i];
+      switch (op.kind) {
+        case DeltaOp::I_SET:
+          status = tables_->iBunnyEntryAdd(op.key, op.data, op.add);
+          break;
+        case DeltaOp::E_SET:
+          status = tables_->eBunnyEntryAdd(op.key, op.target, op.add);
+          break;
+        case DeltaOp::POINT_DEL:
+          status = tables_->bunnyPointDel(op.key.robot_id, op.key.actual_bunny);
+          break;
+      }
+    }
+    auto end_status = tables_->endBatch(true);
+    tables_->completeOperations();
+    return status != BF_SUCCESS ? status : end_status;
+  }
+
+  TableBackend *tables_;
+  std::vector<DeltaOp> ops_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
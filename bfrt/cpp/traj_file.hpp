@@ -0,0 +1,137 @@
+#ifndef TRAJ_FILE_HPP
+#define TRAJ_FILE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "cp_types.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+/*******************************************************************************
+ * Binary trajectory format (.utrj), written by bfrt/traj_bin.py.
+ *
+ * Little endian. A 32 byte header followed by fixed size records that are
+ * already in the units of the switch, so they can be installed without any
+ * parsing. The same records are the payload of server command 13.
+ ******************************************************************************/
+
+#define TRAJ_FILE_MAGIC "UTRJ"
+#define TRAJ_FILE_VERSION 1
+
+struct traj_file_header_t {
+  char magic[4];          // TRAJ_FILE_MAGIC
+  uint16_t version;       // TRAJ_FILE_VERSION
+  uint16_t record_size;   // sizeof(traj_record_t)
+  uint32_t count;         // number of records
+  uint32_t flags;         // unused, 0
+  uint64_t reserved[2];
+};
+static_assert(sizeof(traj_file_header_t) == 32, "traj_file_header_t must be 32 bytes");
+
+struct traj_record_t {
+  uint32_t bunny_id;
+  uint32_t next_id;
+  uint32_t duration;      // 2^16 ns units, see msec_to_int
+  uint32_t reserved;
+  uint64_t positions[NUM_JOINTS];  // see double_to_dec
+  uint64_t speeds[NUM_JOINTS];
+};
+static_assert(sizeof(traj_record_t) == 112, "traj_record_t must be 112 bytes");
+
+// The trajectory point of a record for a robot. shift is added to the ids
+// like in client.py.
+inline void traj_record_point(const traj_record_t &record,
+                              const robot_id_t &robot_id,
+                              const int32_t &shift,
+                              trajectory_point_t *point) {
+  point->robot_id = robot_id;
+  point->bunny_id = static_cast<bunny_id_t>(record.bunny_id + shift);
+  point->next_id = static_cast<bunny_id_t>(record.next_id + shift);
+  point->duration = record.duration;
+  memcpy(point->positions, record.positions, sizeof(point->positions));
+  memcpy(point->speeds, record.speeds, sizeof(point->speeds));
+}
+
+// Read-only memory mapping of a trajectory file.
+class TrajFile {
+ public:
+  TrajFile() : data_(nullptr), size_(0), records_(nullptr), count_(0) {}
+  ~TrajFile() { close(); }
+
+  TrajFile(const TrajFile &) = delete;
+  TrajFile &operator=(const TrajFile &) = delete;
+
+  // Map and validate the file. Returns false (and prints why) on error.
+  bool open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cout<<"ERROR: cannot open "<<path<<std::endl;
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(traj_file_header_t))) {
+      std::cout<<"ERROR: "<<path<<" is not a trajectory file"<<std::endl;
+      ::close(fd);
+      return false;
+    }
+    size_ = st.st_size;
+    void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      std::cout<<"ERROR: cannot map "<<path<<std::endl;
+      size_ = 0;
+      return false;
+    }
+    data_ = data;
+    // the records are read once, in order
+    madvise(data_, size_, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    auto header = static_cast<const traj_file_header_t *>(data_);
+    if (memcmp(header->magic, TRAJ_FILE_MAGIC, 4) != 0 ||
+        header->version != TRAJ_FILE_VERSION ||
+        header->record_size != sizeof(traj_record_t) ||
+        size_ < sizeof(traj_file_header_t) + header->count * sizeof(traj_record_t)) {
+      std::cout<<"ERROR: "<<path<<": invalid header or truncated file"<<std::endl;
+      close();
+      return false;
+    }
+    records_ = reinterpret_cast<const traj_record_t *>(header + 1);
+    count_ = header->count;
+    return true;
+  }
+
+  void close() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    records_ = nullptr;
+    count_ = 0;
+  }
+
+  uint32_t count() const { return count_; }
+  const traj_record_t *records() const { return records_; }
+
+ private:
+  void *data_;
+  size_t size_;
+  const traj_record_t *records_;
+  uint32_t count_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
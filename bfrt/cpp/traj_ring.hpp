@@ -0,0 +1,406 @@
+#ifndef TRAJ_RING_HPP
+#define TRAJ_RING_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "bunny_alloc.hpp"
+#include "cp_types.hpp"
+
+// Quota (points) of the robots that are reset without one
+#define TRAJ_RING_DEFAULT_SIZE 1000
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Table changes of the ring manager. They must be executed in the order they
+// are made, like the commands of a robot in the writer pool.
+class TrajRingSink {
+ public:
+  virtual ~TrajRingSink() {}
+
+  virtual void pointAdd(const trajectory_point_t &point) = 0;
+  // Delete the points of [first, last]
+  virtual void rangeDel(const robot_id_t &robot_id, const bunny_id_t &first,
+                        const bunny_id_t &last) = 0;
+  virtual void railwayAdd(const robot_id_t &robot_id, const bunny_id_t &from_id,
+                          const bunny_id_t &to_id) = 0;
+  virtual void railwayMod(const robot_id_t &robot_id, const bunny_id_t &from_id,
+                          const bunny_id_t &to_id) = 0;
+  virtual void railwayDel(const robot_id_t &robot_id, const bunny_id_t &from_id) = 0;
+};
+
+// The trajectory window of one robot in the switch: the ids [0, capacity)
+// are used as a ring buffer, at most quota of them at a time. The installed
+// points are start, start + 1, ...
+// (size of them, end is the next free id), the last one has a railway_switch
+// entry to itself (stop) that holds the robot until more points come.
+//
+// A replacement trajectory (the next epoch) is staged at end, end + 1, ...
+// with its own stop and nothing leading to it. A railway_switch entry from
+// a point of the window (switch_from) to end moves the robot over. The old
+// points up to the switch point are then retired: the robot may still be on
+// them, they are deleted once it is in the new window.
+struct traj_ring_t {
+  uint32_t capacity;  // ids, 0: the robot is not managed
+  uint32_t quota;     // points of the robot in the tables
+  uint32_t start;
+  uint32_t end;
+  uint32_t size;
+  int32_t stop;       // -1: no stop entry
+  uint32_t staged;    // points of the next epoch from end
+  int32_t switch_from;  // -1: the staged points are not reachable yet
+  uint32_t retired_start;
+  uint32_t retired_size;
+  int32_t retired_switch;  // the switch entry of the retired points, -1: none
+};
+
+// Ring buffers of every robot, the C++ version of the g_start, g_end,
+// g_size and g_stop logic of proxy.py.
+//
+// The ids of a robot are allocated in order from the whole 16 bit space and
+// freed in order as the robot passes them, so allocating and freeing are
+// O(1), every upload gets a run of consecutive ids and next_id is always
+// id + 1 (0 after 65535, like bit<16> in ur.p4). The number of points is
+// bounded by the quota of the robot instead, reserved in the tables of its
+// pipes (BunnyQuotas), so the robots can not overfill the tables together.
+//
+// An append first reclaims the points the robot has already passed (the
+// ones before r_actual_bunny), installs the new points after the last one
+// and moves the stop entry to the new last point. The footprint of a robot
+// stays at most quota points however long the stream is.
+//
+// A replacement goes through stage(), switchTo() and finish(): the robot
+// keeps running the old points until the single switch entry is written,
+// there is no moment without a trajectory. The caller must commit the
+// changes of each step before the next one and read the actual bunny of
+// the robot for finish() after the switch entry is committed.
+class TrajRingManager {
+ public:
+  explicit TrajRingManager(const uint32_t &ids = BUNNY_ID_SPACE,
+                           const uint32_t &points_per_pipe = BUNNY_POINT_TABLE_SIZE)
+      : ids_(ids), quotas_(points_per_pipe), rings_(MAX_ROBOTS) {
+    for (auto &ring : rings_) {
+      ring.capacity = 0;
+      ring.quota = 0;
+      clear(&ring);
+    }
+  }
+
+  const traj_ring_t &ring(const robot_id_t &robot_id) const { return rings_[robot_id]; }
+
+  const BunnyQuotas &quotas() const { return quotas_; }
+  void setPipes(const PipeMap *pipes) { quotas_.setPipes(pipes); }
+
+  // Remove the points and the stop entry of the robot and start a new ring
+  // that holds at most quota points. Returns false (and keeps the old ring)
+  // if the pipes of the robot have no room for the quota. The robot must be
+  // set to bunny id 0 (start) afterwards.
+  bool reset(const robot_id_t &robot_id, const uint32_t &quota,
+             TrajRingSink *sink) {
+    if (robot_id >= MAX_ROBOTS || quota < 2 || quota > ids_ ||
+        !quotas_.reserve(robot_id, quota)) {
+      return false;
+    }
+    auto &ring = rings_[robot_id];
+    if (ring.capacity > 0) {
+      removeAll(robot_id, sink);
+    }
+    ring.capacity = ids_;
+    ring.quota = quota;
+    clear(&ring);
+    return true;
+  }
+
+  // Delete every point and switch entry of the ring, a few ranges of its
+  // window, and stop managing the robot.
+  void remove(const robot_id_t &robot_id, TrajRingSink *sink) {
+    if (robot_id >= MAX_ROBOTS || rings_[robot_id].capacity == 0) {
+      return;
+    }
+    removeAll(robot_id, sink);
+    drop(robot_id);
+  }
+
+  // Stop managing the robot without deleting anything, for when its entries
+  // are removed by other means.
+  void drop(const robot_id_t &robot_id) {
+    if (robot_id < MAX_ROBOTS) {
+      rings_[robot_id].capacity = 0;
+      rings_[robot_id].quota = 0;
+      clear(&rings_[robot_id]);
+      quotas_.release(robot_id);
+    }
+  }
+
+  // Delete the points before actual_id, the robot is at actual_id, and the
+  // retired points once it is in the window. Nothing happens if actual_id
+  // is not within the window. Returns the number of deleted points.
+  uint32_t reclaim(const robot_id_t &robot_id, const bunny_id_t &actual_id,
+                   TrajRingSink *sink) {
+    if (robot_id >= MAX_ROBOTS || rings_[robot_id].capacity == 0) {
+      return 0;
+    }
+    auto &ring = rings_[robot_id];
+    uint32_t passed = 0;
+    if (!within(ring, ring.start, ring.size, actual_id, &passed)) {
+      return 0;
+    }
+    uint32_t retired = removeRetired(robot_id, &ring, sink);
+    removeRange(robot_id, ring, passed, sink);
+    return retired + passed;
+  }
+
+  // Install the points after the last one, their ids are replaced by the
+  // ring ids. Returns false (and installs nothing) if they do not fit.
+  bool append(const robot_id_t &robot_id,
+              std::vector<trajectory_point_t> *points,
+              TrajRingSink *sink) {
+    if (robot_id >= MAX_ROBOTS || rings_[robot_id].capacity == 0) {
+      return false;
+    }
+    auto &ring = rings_[robot_id];
+    uint32_t count = points->size();
+    if (count == 0) {
+      return true;
+    }
+    if (ring.staged > 0 || count > freeIds(ring)) {
+      return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+      auto &point = (*points)[i];
+      point.robot_id = robot_id;
+      point.bunny_id = static_cast<bunny_id_t>((ring.end + i) % ring.capacity);
+      point.next_id = static_cast<bunny_id_t>((ring.end + i + 1) % ring.capacity);
+      sink->pointAdd(point);
+    }
+
+    // hold the robot at the new last point before releasing the old one
+    auto stop = static_cast<int32_t>((ring.end + count - 1) % ring.capacity);
+    sink->railwayAdd(robot_id, static_cast<bunny_id_t>(stop), static_cast<bunny_id_t>(stop));
+    if (ring.stop >= 0 && ring.stop != stop) {
+      sink->railwayDel(robot_id, static_cast<bunny_id_t>(ring.stop));
+    }
+    ring.stop = stop;
+    ring.end = (ring.end + count) % ring.capacity;
+    ring.size += count;
+    return true;
+  }
+
+  // Install the points as the next epoch of a robot with a window, after
+  // its last point and with their own stop entry. The robot does not see
+  // them yet. Returns false (and installs nothing) if they do not fit next
+  // to the window or a replacement is already staged.
+  bool stage(const robot_id_t &robot_id,
+             std::vector<trajectory_point_t> *points,
+             TrajRingSink *sink) {
+    if (robot_id >= MAX_ROBOTS || rings_[robot_id].capacity == 0) {
+      return false;
+    }
+    auto &ring = rings_[robot_id];
+    uint32_t count = points->size();
+    if (count == 0 || ring.size == 0 || ring.staged > 0 || count > freeIds(ring)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      auto &point = (*points)[i];
+      point.robot_id = robot_id;
+      point.bunny_id = static_cast<bunny_id_t>((ring.end + i) % ring.capacity);
+      point.next_id = static_cast<bunny_id_t>((ring.end + i + 1) % ring.capacity);
+      sink->pointAdd(point);
+    }
+    auto stop = static_cast<bunny_id_t>((ring.end + count - 1) % ring.capacity);
+    sink->railwayAdd(robot_id, stop, stop);
+    ring.staged = count;
+    return true;
+  }
+
+  // Redirect the robot from at, a point of the window, to the staged points.
+  // A stop entry at at is modified in place. Returns false if nothing is
+  // staged or at is not in the window.
+  bool switchTo(const robot_id_t &robot_id, const bunny_id_t &at, TrajRingSink *sink) {
+    if (robot_id >= MAX_ROBOTS || rings_[robot_id].capacity == 0) {
+      return false;
+    }
+    auto &ring = rings_[robot_id];
+    uint32_t index = 0;
+    if (ring.staged == 0 || ring.switch_from >= 0 ||
+        !within(ring, ring.start, ring.size, at, &index)) {
+      return false;
+    }
+    auto first = static_cast<bunny_id_t>(ring.end);
+    if (ring.stop == at) {
+      sink->railwayMod(robot_id, at, first);
+    } else {
+      sink->railwayAdd(robot_id, at, first);
+    }
+    ring.switch_from = at;
+    return true;
+  }
+
+  // Complete the switch with the actual bunny of the robot, read after the
+  // switch entry was committed. If the robot has not passed the switch
+  // point, the old points after it are deleted and the staged points
+  // become the window. Otherwise the robot missed the switch: it is rolled
+  // back and the robot stays on the old points. Returns true if switched.
+  bool finish(const robot_id_t &robot_id, const bunny_id_t &actual_id,
+              TrajRingSink *sink) {
+    if (robot_id >= MAX_ROBOTS || rings_[robot_id].capacity == 0 ||
+        rings_[robot_id].switch_from < 0) {
+      return false;
+    }
+    auto &ring = rings_[robot_id];
+    auto at = static_cast<bunny_id_t>(ring.switch_from);
+    uint32_t switch_index = 0, actual_index = 0, staged_index = 0;
+    within(ring, ring.start, ring.size, at, &switch_index);
+    bool in_window = within(ring, ring.start, ring.size, actual_id, &actual_index);
+    bool switched = within(ring, ring.end, ring.staged, actual_id, &staged_index);
+    if (!switched && !(in_window && actual_index <= switch_index)) {
+      abort(robot_id, sink);
+      return false;
+    }
+
+    // the robot is in the window, the previous retired points are left behind
+    removeRetired(robot_id, &ring, sink);
+    uint32_t kept = switch_index + 1;
+    uint32_t tail = ring.size - kept;
+    if (tail > 0) {
+      removeIds(robot_id, ring, (ring.start + kept) % ring.capacity, tail, sink);
+    }
+    if (ring.stop >= 0 && ring.stop != ring.switch_from) {
+      sink->railwayDel(robot_id, static_cast<bunny_id_t>(ring.stop));
+    }
+    ring.retired_start = ring.start;
+    ring.retired_size = kept;
+    ring.retired_switch = ring.switch_from;
+
+    ring.start = ring.end;
+    ring.size = ring.staged;
+    ring.end = (ring.end + ring.staged) % ring.capacity;
+    ring.stop = static_cast<int32_t>((ring.end + ring.capacity - 1) % ring.capacity);
+    ring.staged = 0;
+    ring.switch_from = -1;
+    if (switched) {
+      removeRetired(robot_id, &ring, sink);
+    }
+    return true;
+  }
+
+  // Delete the staged points and restore the switch point, the robot keeps
+  // its window.
+  void abort(const robot_id_t &robot_id, TrajRingSink *sink) {
+    if (robot_id >= MAX_ROBOTS || rings_[robot_id].staged == 0) {
+      return;
+    }
+    auto &ring = rings_[robot_id];
+    if (ring.switch_from >= 0) {
+      auto at = static_cast<bunny_id_t>(ring.switch_from);
+      if (ring.stop == ring.switch_from) {
+        sink->railwayMod(robot_id, at, at);
+      } else {
+        sink->railwayDel(robot_id, at);
+      }
+      ring.switch_from = -1;
+    }
+    removeIds(robot_id, ring, ring.end, ring.staged, sink);
+    sink->railwayDel(robot_id,
+                     static_cast<bunny_id_t>((ring.end + ring.staged - 1) % ring.capacity));
+    ring.staged = 0;
+  }
+
+ private:
+  // The staged, retired and window points and their switch entries
+  void removeAll(const robot_id_t &robot_id, TrajRingSink *sink) {
+    auto &ring = rings_[robot_id];
+    abort(robot_id, sink);
+    removeRetired(robot_id, &ring, sink);
+    removeRange(robot_id, ring, ring.size, sink);
+    if (ring.stop >= 0) {
+      sink->railwayDel(robot_id, static_cast<bunny_id_t>(ring.stop));
+    }
+  }
+
+  static void clear(traj_ring_t *ring) {
+    ring->start = 0;
+    ring->end = 0;
+    ring->size = 0;
+    ring->stop = -1;
+    ring->staged = 0;
+    ring->switch_from = -1;
+    ring->retired_start = 0;
+    ring->retired_size = 0;
+    ring->retired_switch = -1;
+  }
+
+  // Whether id is one of the count ids from first, index: its position
+  static bool within(const traj_ring_t &ring, const uint32_t &first, const uint32_t &count,
+                     const bunny_id_t &id, uint32_t *index) {
+    if (id >= ring.capacity) {
+      return false;
+    }
+    *index = (id + ring.capacity - first) % ring.capacity;
+    return *index < count;
+  }
+
+  // Free ids from end up to the retired points or the start of the window,
+  // as far as the quota allows
+  static uint32_t freeIds(const traj_ring_t &ring) {
+    uint32_t points = ring.quota - ring.retired_size - ring.size - ring.staged;
+    if (ring.retired_size == 0 && ring.size == 0) {
+      return std::min(ring.capacity, points);
+    }
+    uint32_t head = ring.retired_size > 0 ? ring.retired_start : ring.start;
+    return std::min((head + ring.capacity - ring.end) % ring.capacity, points);
+  }
+
+  // Delete the retired points and their switch entry, returns their number
+  static uint32_t removeRetired(const robot_id_t &robot_id, traj_ring_t *ring,
+                                TrajRingSink *sink) {
+    uint32_t count = ring->retired_size;
+    if (count > 0) {
+      removeIds(robot_id, *ring, ring->retired_start, count, sink);
+    }
+    if (ring->retired_switch >= 0) {
+      sink->railwayDel(robot_id, static_cast<bunny_id_t>(ring->retired_switch));
+    }
+    ring->retired_size = 0;
+    ring->retired_switch = -1;
+    return count;
+  }
+
+  // Delete count points from first, at most two ranges
+  static void removeIds(const robot_id_t &robot_id, const traj_ring_t &ring,
+                        const uint32_t &first, const uint32_t &count, TrajRingSink *sink) {
+    uint32_t last = first + count - 1;
+    if (last < ring.capacity) {
+      sink->rangeDel(robot_id, static_cast<bunny_id_t>(first), static_cast<bunny_id_t>(last));
+    } else {
+      sink->rangeDel(robot_id, static_cast<bunny_id_t>(first),
+                     static_cast<bunny_id_t>(ring.capacity - 1));
+      sink->rangeDel(robot_id, 0, static_cast<bunny_id_t>(last - ring.capacity));
+    }
+  }
+
+  // Delete the first count points of the window, at most two ranges.
+  static void removeRange(const robot_id_t &robot_id, traj_ring_t &ring,
+                          const uint32_t &count, TrajRingSink *sink) {
+    if (count == 0) {
+      return;
+    }
+    removeIds(robot_id, ring, ring.start, count, sink);
+    ring.start = (ring.start + count) % ring.capacity;
+    ring.size -= count;
+  }
+
+  uint32_t ids_;
+  BunnyQuotas quotas_;
+  std::vector<traj_ring_t> rings_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
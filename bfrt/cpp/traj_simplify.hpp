@@ -0,0 +1,146 @@
+#ifndef TRAJ_SIMPLIFY_HPP
+#define TRAJ_SIMPLIFY_HPP
+
+#include <algorithm>
+#include <cmath>
+
+#include "cp_types.hpp"
+#include "fixed_point.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+/*******************************************************************************
+ * Error-bounded simplification of a trajectory before the upload.
+ *
+ * A kept point stands for the time until the next kept one: its target
+ * speed is commanded all along and the position it describes moves with it,
+ * position + speed * t. A point is dropped if, at its time, that is within
+ * the position tolerance of its own position on every joint and the speed
+ * within the speed tolerance of its own speed; the points are checked
+ * against the last kept point one after the other, so every dropped point is
+ * within the tolerances (greedy, one pass, O(1) memory). The first and the
+ * last point are always kept. Near-linear stretches in joint space collapse
+ * into a few points, points of a robot at rest into one.
+ *
+ * The kept points get consecutive ids from the id of the first point,
+ * next_id = id + 1 (the loop of the last point is kept), and the duration up
+ * to the next kept point, the sum of the durations of the points in between,
+ * so the kept points start at the same times as before.
+ ******************************************************************************/
+
+struct SimplifyConfig {
+  bool enabled = false;
+  double position = 0;  // rad, max deviation of a joint position
+  double speed = 0;     // rad/s, max deviation of a joint speed
+};
+
+struct SimplifyStats {
+  uint64_t points = 0;
+  uint64_t kept = 0;
+  double max_position_error = 0;  // rad, of the dropped points
+  double max_speed_error = 0;     // rad/s
+
+  // input points per kept point
+  double ratio() const { return kept > 0 ? static_cast<double>(points) / kept : 0; }
+};
+
+class TrajSimplifier {
+ public:
+  explicit TrajSimplifier(const SimplifyConfig &config)
+      : config_(config), have_anchor_(false), have_last_(false), span_(0), next_id_(0) {}
+
+  // The points of one trajectory in order, kept points are emitted once
+  // the next kept one is known
+  template <typename F>
+  void push(const trajectory_point_t &point, F emit) {
+    stats_.points++;
+    if (!have_anchor_) {
+      anchor_ = point;
+      have_anchor_ = true;
+      next_id_ = point.bunny_id;
+      return;
+    }
+    if (have_last_) {
+      // last_ is not the last point of the trajectory
+      double position_error, speed_error;
+      if (predicts(last_, &position_error, &speed_error)) {
+        stats_.max_position_error = std::max(stats_.max_position_error, position_error);
+        stats_.max_speed_error = std::max(stats_.max_speed_error, speed_error);
+        span_ += last_.duration;
+      } else {
+        emitAnchor(emit);
+        anchor_ = last_;
+        span_ = anchor_.duration;
+      }
+    } else {
+      span_ = anchor_.duration;
+    }
+    last_ = point;
+    have_last_ = true;
+  }
+
+  template <typename F>
+  void finish(F emit) {
+    if (!have_anchor_) {
+      return;
+    }
+    if (!have_last_) {
+      anchor_.bunny_id = next_id_;
+      emit(anchor_);
+      stats_.kept++;
+      return;
+    }
+    emitAnchor(emit);
+    bool loop = last_.next_id != static_cast<bunny_id_t>(last_.bunny_id + 1);
+    last_.bunny_id = next_id_;
+    last_.next_id = loop ? last_.next_id : static_cast<bunny_id_t>(next_id_ + 1);
+    emit(last_);
+    stats_.kept++;
+  }
+
+  const SimplifyStats &stats() const { return stats_; }
+
+ private:
+  // Whether the anchor, span_ after its start, describes point
+  bool predicts(const trajectory_point_t &point, double *position_error,
+                double *speed_error) const {
+    double t = (static_cast<double>(span_) * 65536) / 1e9;
+    *position_error = 0;
+    *speed_error = 0;
+    for (int j = 0; j < NUM_JOINTS; j++) {
+      double speed = dec_to_double(anchor_.speeds[j]);
+      double position = dec_to_double(anchor_.positions[j]) + speed * t;
+      *position_error = std::max(*position_error,
+                                 std::fabs(dec_to_double(point.positions[j]) - position));
+      *speed_error = std::max(*speed_error, std::fabs(dec_to_double(point.speeds[j]) - speed));
+    }
+    return *position_error <= config_.position && *speed_error <= config_.speed;
+  }
+
+  template <typename F>
+  void emitAnchor(F emit) {
+    anchor_.bunny_id = next_id_;
+    anchor_.next_id = static_cast<bunny_id_t>(next_id_ + 1);
+    anchor_.duration = static_cast<p4_time_t>(span_);
+    next_id_++;
+    emit(anchor_);
+    stats_.kept++;
+  }
+
+  SimplifyConfig config_;
+  SimplifyStats stats_;
+  bool have_anchor_;
+  bool have_last_;
+  trajectory_point_t anchor_;  // the last kept point, not emitted yet
+  trajectory_point_t last_;    // the last pushed point
+  uint64_t span_;              // time from the anchor to last_
+  bunny_id_t next_id_;         // of the anchor
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
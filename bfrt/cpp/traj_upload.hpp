@@ -0,0 +1,263 @@
+#ifndef TRAJ_UPLOAD_HPP
+#define TRAJ_UPLOAD_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "table_backend.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Bounded blocking queue between two pipeline stages. push waits while the
+// queue is full, so a slow stage holds back the ones before it.
+template <typename T>
+class BlockingQueue {
+ public:
+  explicit BlockingQueue(size_t size) : size_(size), closed_(false) {}
+
+  void push(T value) {
+    std::unique_lock<std::mutex> guard(lock_);
+    not_full_.wait(guard, [this] { return items_.size() < size_; });
+    items_.push_back(std::move(value));
+    not_empty_.notify_one();
+  }
+
+  // Returns false once the queue is closed and empty.
+  bool pop(T *value) {
+    std::unique_lock<std::mutex> guard(lock_);
+    not_empty_.wait(guard, [this] { return !items_.empty() || closed_; });
+    if (items_.empty()) {
+      return false;
+    }
+    *value = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> guard(lock_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+ private:
+  size_t size_;
+  bool closed_;
+  std::deque<T> items_;
+  std::mutex lock_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+};
+
+// Pipelined upload of whole trajectories. run_tests and the server build a
+// batch, push it with endBatch(true) and wait for it, so the CPU and the
+// driver take turns. Here three threads overlap them:
+//
+//   1. convert: runs the producer of the trajectory (csv parser, binary
+//      records, ...) and cuts its points into chunks of batch_points
+//   2. build:   adds the points of a chunk in a batch of the next backend
+//      and ends it with endBatch(false)
+//   3. commit:  completeOperations on that backend, then the backend is free
+//               for the build stage again
+//
+// Every backend (session) holds at most one batch in flight, with two of
+// them one batch is built while the other one is pushed to the hardware.
+// The queues between the stages are bounded. The future of a trajectory is
+// ready, and its callback called, when all of its batches are committed.
+// Trajectories are committed in submission order, the batches of one
+// trajectory may reach the hardware in any order, so install the entries
+// that start the robot (railway_switch, r_actual_bunny) only after that.
+class TrajUploader {
+ public:
+  typedef std::function<void(const trajectory_point_t &)> Emit;
+  // Calls emit for every point, returns the number of points or -1.
+  typedef std::function<int64_t(const Emit &emit)> Producer;
+  typedef std::function<void(const bf_status_t &status)> Callback;
+
+  TrajUploader(std::vector<std::unique_ptr<TableBackend>> backends,
+               uint32_t batch_points = 1024, size_t queue_chunks = 8)
+      : backends_(std::move(backends)),
+        batch_points_(batch_points),
+        jobs_(queue_chunks),
+        chunks_(queue_chunks),
+        committing_(backends_.size()),
+        busy_(backends_.size(), false) {
+    convert_thread_ = std::thread(&TrajUploader::convert, this);
+    build_thread_ = std::thread(&TrajUploader::build, this);
+    commit_thread_ = std::thread(&TrajUploader::commit, this);
+  }
+
+  ~TrajUploader() {
+    jobs_.close();
+    convert_thread_.join();
+    build_thread_.join();
+    commit_thread_.join();
+  }
+
+  TrajUploader(const TrajUploader &) = delete;
+  TrajUploader &operator=(const TrajUploader &) = delete;
+
+  // Queue a trajectory, waits while the pipeline is full. The producer (and
+  // everything it reads) must stay valid until the future is ready.
+  std::future<bf_status_t> submit(Producer producer, Callback done = Callback()) {
+    std::shared_ptr<Job> job(new Job());
+    job->producer = std::move(producer);
+    job->done = std::move(done);
+    auto future = job->promise.get_future();
+    jobs_.push(job);
+    return future;
+  }
+
+ private:
+  struct Job {
+    Producer producer;
+    Callback done;
+    std::promise<bf_status_t> promise;
+
+    // The first error, of the build or the commit stage, which run on
+    // different chunks of the job at the same time
+    void fail(const bf_status_t &error) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (status == BF_SUCCESS) {
+        status = error;
+      }
+    }
+
+    bf_status_t result() {
+      std::lock_guard<std::mutex> guard(lock);
+      return status;
+    }
+
+   private:
+    std::mutex lock;
+    bf_status_t status = BF_SUCCESS;
+  };
+
+  struct Chunk {
+    std::shared_ptr<Job> job;
+    std::vector<trajectory_point_t> points;
+    bool last = false;
+    bf_status_t status = BF_SUCCESS;  // of the producer, last chunk only
+    size_t backend = 0;  // set by the build stage
+    bool has_batch = false;  // a batch of the chunk was opened on backend
+  };
+
+  void convert() {
+    std::shared_ptr<Job> job;
+    while (jobs_.pop(&job)) {
+      Chunk chunk;
+      chunk.job = job;
+      chunk.points.reserve(batch_points_);
+      auto count = job->producer([&](const trajectory_point_t &point) {
+        chunk.points.push_back(point);
+        if (chunk.points.size() == batch_points_) {
+          Chunk full;
+          full.job = job;
+          full.points.reserve(batch_points_);
+          std::swap(full, chunk);
+          chunks_.push(std::move(full));
+        }
+      });
+      chunk.last = true;
+      chunk.status = count < 0 ? BF_INVALID_ARG : BF_SUCCESS;
+      chunks_.push(std::move(chunk));
+    }
+    chunks_.close();
+  }
+
+  void build() {
+    size_t next = 0;
+    Chunk chunk;
+    while (chunks_.pop(&chunk)) {
+      auto &job = *chunk.job;
+      chunk.backend = next;
+      next = (next + 1) % backends_.size();
+      if (!chunk.points.empty() && job.result() == BF_SUCCESS) {
+        waitIdle(chunk.backend);
+        auto backend = backends_[chunk.backend].get();
+        auto status = backend->beginBatch();
+        if (status == BF_SUCCESS) {
+          chunk.has_batch = true;
+          for (size_t i = 0; status == BF_SUCCESS && i < chunk.points.size(); i++) {
+            status = backend->bunnyPointAdd(chunk.points[i]);
+          }
+          // the batch is ended even after an error, like CommandBatch
+          auto end_status = backend->endBatch(false);
+          if (status == BF_SUCCESS) {
+            status = end_status;
+          }
+          setBusy(chunk.backend, true);
+        }
+        if (status != BF_SUCCESS) {
+          job.fail(status);
+        }
+      }
+      if (chunk.last && chunk.status != BF_SUCCESS) {
+        job.fail(chunk.status);
+      }
+      committing_.push(std::move(chunk));
+    }
+    committing_.close();
+  }
+
+  void commit() {
+    Chunk chunk;
+    while (committing_.pop(&chunk)) {
+      if (chunk.has_batch) {
+        // the backend holds no other batch until this one is completed
+        auto status = backends_[chunk.backend]->completeOperations();
+        if (status != BF_SUCCESS) {
+          chunk.job->fail(status);
+        }
+        setBusy(chunk.backend, false);
+      }
+      if (chunk.last) {
+        auto &job = *chunk.job;
+        auto status = job.result();
+        if (job.done) {
+          job.done(status);
+        }
+        job.promise.set_value(status);
+      }
+    }
+  }
+
+  void waitIdle(const size_t &backend) {
+    std::unique_lock<std::mutex> guard(busy_lock_);
+    idle_.wait(guard, [&] { return !busy_[backend]; });
+  }
+
+  void setBusy(const size_t &backend, const bool &busy) {
+    std::lock_guard<std::mutex> guard(busy_lock_);
+    busy_[backend] = busy;
+    idle_.notify_all();
+  }
+
+  std::vector<std::unique_ptr<TableBackend>> backends_;
+  uint32_t batch_points_;
+  BlockingQueue<std::shared_ptr<Job>> jobs_;
+  BlockingQueue<Chunk> chunks_;
+  // one slot per backend: a chunk waits here while its batch is pushed
+  BlockingQueue<Chunk> committing_;
+  std::vector<bool> busy_;
+  std::mutex busy_lock_;
+  std::condition_variable idle_;
+  std::thread convert_thread_;
+  std::thread build_thread_;
+  std::thread commit_thread_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
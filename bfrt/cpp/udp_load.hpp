@@ -0,0 +1,568 @@
+#ifndef UDP_LOAD_HPP
+#define UDP_LOAD_HPP
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cp_types.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+/*******************************************************************************
+ * The UDP path of the robots, without a switch: a load generator of cur_t
+ * packets with a receiver of the replies, and a responder that answers them
+ * in place of ur.p4.
+ *
+ * A robot sends from UDP source port UR_ROBOT_PORT | robot_id (ROBOT_ID_LEN
+ * 8 of params.p4) a payload of the cur_t header (jointId, position, speed,
+ * big endian) and gets it back with the ports swapped and the commanded
+ * speed. The switch does not parse beyond cur_t, so the generator appends a
+ * trailer (sequence number and send time) that comes back unchanged and
+ * gives the latency of every reply without a table of the packets in flight.
+ * control_t is an Ethernet frame of its own (etherType 0x1234), it is not
+ * part of the load.
+ ******************************************************************************/
+
+#define UR_ROBOT_PORT 0xFF00
+#define UR_CUR_SIZE 17           // jointId, position, speed
+#define UR_LOAD_TRAILER_SIZE 12  // sequence number, send time (ns)
+#define UR_LOAD_PACKET_SIZE (UR_CUR_SIZE + UR_LOAD_TRAILER_SIZE)
+#define UR_LOAD_DEFAULT_PORT 50004
+
+// CLOCK_MONOTONIC, the clock of timerfd
+inline uint64_t monotonic_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+inline void cur_encode(const ur_packet_t &packet, uint8_t *buf) {
+  uint64_t position = htobe64(packet.position);
+  uint64_t speed = htobe64(packet.speed);
+  buf[0] = packet.jointId;
+  memcpy(buf + 1, &position, sizeof(position));
+  memcpy(buf + 9, &speed, sizeof(speed));
+}
+
+// The robot id is taken from the source port, false if the packet is not a
+// cur_t packet for ur.p4
+inline bool cur_decode(const uint8_t *buf, const size_t &size, const uint16_t &src_port,
+                       ur_packet_t *packet) {
+  if (size < UR_CUR_SIZE || (src_port & 0xff00) != UR_ROBOT_PORT) {
+    return false;
+  }
+  uint64_t position;
+  uint64_t speed;
+  memcpy(&position, buf + 1, sizeof(position));
+  memcpy(&speed, buf + 9, sizeof(speed));
+  packet->robot_id = static_cast<robot_id_t>(src_port & 0xff);
+  packet->jointId = buf[0];
+  packet->position = be64toh(position);
+  packet->speed = be64toh(speed);
+  return true;
+}
+
+inline void cur_set_speed(const dec_t &speed, uint8_t *buf) {
+  uint64_t value = htobe64(speed);
+  memcpy(buf + 9, &value, sizeof(value));
+}
+
+// Latencies (ns) in log-linear buckets: exact below 64 ns, then 32 buckets
+// per power of two (3% resolution), so millions of replies per robot cost
+// no memory
+class LatencyHistogram {
+ public:
+  LatencyHistogram() : counts_(BUCKETS, 0) {}
+
+  void add(const uint64_t &ns) {
+    counts_[bucket(ns)]++;
+    count_++;
+    sum_ += ns;
+    max_ = std::max(max_, ns);
+  }
+
+  void merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < BUCKETS; i++) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+  double mean() const { return count_ > 0 ? static_cast<double>(sum_) / count_ : 0; }
+
+  // nearest rank, the upper bound of its bucket (the max in the last one)
+  uint64_t percentile(const double &p) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(p * count_ + 0.999999), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(upper(i), max_);
+      }
+    }
+    return max_;
+  }
+
+ private:
+  static const size_t BUCKETS = 64 + 58 * 32;
+
+  static size_t bucket(const uint64_t &ns) {
+    if (ns < 64) {
+      return ns;
+    }
+    int exponent = 63 - __builtin_clzll(ns);
+    return 64 + (exponent - 6) * 32 + ((ns >> (exponent - 5)) & 31);
+  }
+
+  static uint64_t upper(const size_t &i) {
+    if (i < 64) {
+      return i;
+    }
+    int exponent = (i - 64) / 32 + 6;
+    uint64_t sub = (i - 64) % 32;
+    return ((32 + sub + 1) << (exponent - 5)) - 1;
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t max_ = 0;
+};
+
+// Large socket buffers, the bursts of a fleet are far beyond the defaults.
+// SO_RCVBUFFORCE/SO_SNDBUFFORCE pass net.core.*mem_max with CAP_NET_ADMIN.
+inline void udp_buffers(const int &sock, int bytes) {
+  if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) != 0) {
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+  }
+  if (setsockopt(sock, SOL_SOCKET, SO_SNDBUFFORCE, &bytes, sizeof(bytes)) != 0) {
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes));
+  }
+}
+
+// The commanded speed of a cur_t packet, received at now_ns (monotonic_ns)
+typedef std::function<dec_t(const ur_packet_t &packet, const uint64_t &now_ns)> cur_handler_t;
+
+/*******************************************************************************
+ * Answers the cur_t packets of a UDP port like ur.p4: the reply goes back to
+ * the sender with the speed of the handler, the rest of the payload
+ * unchanged. Other packets are dropped. One thread, batches of recvmmsg and
+ * sendmmsg.
+ ******************************************************************************/
+class UdpResponder {
+ public:
+  UdpResponder(const uint16_t &port, cur_handler_t handler)
+      : handler_(handler), sock_(-1), stop_(false), packets_(0), ignored_(0), batches_(0) {
+    sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock_ < 0) {
+      perror("ERROR: udp socket");
+      return;
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    // the stop flag is checked at least every 100 ms
+    timeval timeout = {0, 100000};
+    setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    udp_buffers(sock_, 8 << 20);
+    if (bind(sock_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+      perror("ERROR: cannot bind the udp port");
+      close(sock_);
+      sock_ = -1;
+      return;
+    }
+    thread_ = std::thread(&UdpResponder::run, this);
+  }
+
+  ~UdpResponder() {
+    stop_.store(true);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (sock_ >= 0) {
+      close(sock_);
+      std::cout<<"udp responder: "<<packets_<<" cur_t packets answered, "<<ignored_
+               <<" other packets dropped, "<<batches_<<" batches"<<std::endl;
+    }
+  }
+
+  bool ok() const { return sock_ >= 0; }
+
+ private:
+  static const int BATCH = 64;
+  static const int BUF_SIZE = 256;
+
+  void run() {
+    std::vector<uint8_t> bufs(BATCH * BUF_SIZE);
+    sockaddr_in addrs[BATCH];
+    iovec iovs[BATCH];
+    mmsghdr msgs[BATCH];
+    mmsghdr replies[BATCH];
+    while (!stop_.load(std::memory_order_relaxed)) {
+      for (int i = 0; i < BATCH; i++) {
+        iovs[i].iov_base = &bufs[i * BUF_SIZE];
+        iovs[i].iov_len = BUF_SIZE;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+      }
+      int received = recvmmsg(sock_, msgs, BATCH, MSG_WAITFORONE, nullptr);
+      if (received <= 0) {
+        continue;
+      }
+      uint64_t now = monotonic_ns();
+      int count = 0;
+      for (int i = 0; i < received; i++) {
+        uint8_t *buf = &bufs[i * BUF_SIZE];
+        ur_packet_t packet;
+        if (!cur_decode(buf, msgs[i].msg_len, ntohs(addrs[i].sin_port), &packet)) {
+          ignored_++;
+          continue;
+        }
+        cur_set_speed(handler_(packet, now), buf);
+        iovs[i].iov_len = msgs[i].msg_len;
+        replies[count] = msgs[i];
+        replies[count].msg_hdr.msg_iov = &iovs[i];
+        count++;
+      }
+      for (int sent = 0; sent < count;) {
+        int n = sendmmsg(sock_, replies + sent, count - sent, 0);
+        if (n <= 0) {
+          break;
+        }
+        sent += n;
+      }
+      packets_ += count;
+      batches_++;
+    }
+  }
+
+  cur_handler_t handler_;
+  int sock_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+  uint64_t packets_;
+  uint64_t ignored_;
+  uint64_t batches_;
+};
+
+struct LoadConfig {
+  std::string host = "127.0.0.1";
+  uint16_t port = UR_LOAD_DEFAULT_PORT;
+  uint32_t robots = MAX_ROBOTS;
+  uint32_t first_robot = 0;
+  uint32_t rate = 1000;    // packets per joint per s
+  double time = 10;        // s of sending
+  uint32_t drain_ms = 100; // wait for the last replies
+  bool busy_poll = false;  // spin instead of timerfd and blocking epoll
+  std::string output;      // report file, stdout if empty
+};
+
+// The replies of a robot
+struct LoadRobotStats {
+  uint64_t sent = 0;
+  uint64_t send_errors = 0;
+  uint64_t received = 0;
+  uint64_t bad = 0;        // too short, not from the load
+  double jitter = 0;       // RFC 3550 interarrival jitter, ns
+  uint64_t last_latency = 0;
+  LatencyHistogram latency;
+};
+
+/*******************************************************************************
+ * Load of a fleet: every robot sends its NUM_JOINTS cur_t packets rate times
+ * per second with one sendmmsg on its own socket (the source port is the
+ * robot id). The robots are spread evenly over the period; a wake-up (timerfd
+ * on absolute deadlines, or spinning with busy_poll) sends every robot that
+ * is due, so a late wake-up catches up instead of shifting the schedule. A
+ * receiver thread takes the replies of all sockets through epoll and
+ * recvmmsg and records per robot the latency (receive time minus the send
+ * time of the trailer) and the interarrival jitter.
+ ******************************************************************************/
+class LoadGenerator {
+ public:
+  explicit LoadGenerator(const LoadConfig &config)
+      : config_(config), stats_(config.robots), stop_(false) {}
+
+  ~LoadGenerator() {
+    for (auto sock : socks_) {
+      close(sock);
+    }
+  }
+
+  bool run(std::ostream &out) {
+    if (config_.robots == 0 || config_.first_robot + config_.robots > MAX_ROBOTS ||
+        config_.rate == 0 || config_.time <= 0) {
+      std::cout<<"ERROR: invalid load robots, rate or time"<<std::endl;
+      return false;
+    }
+    if (!open()) {
+      return false;
+    }
+    std::thread receiver(&LoadGenerator::receive, this);
+    uint64_t elapsed = send();
+    std::this_thread::sleep_for(std::chrono::milliseconds(config_.drain_ms));
+    stop_.store(true);
+    receiver.join();
+    report(out, elapsed);
+    return true;
+  }
+
+ private:
+  static const int BATCH = 64;
+
+  // A socket per robot, bound to its port and connected to the switch
+  bool open() {
+    sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_port = htons(config_.port);
+    if (inet_pton(AF_INET, config_.host.c_str(), &to.sin_addr) != 1) {
+      std::cout<<"ERROR: invalid load host "<<config_.host<<std::endl;
+      return false;
+    }
+    for (uint32_t r = 0; r < config_.robots; r++) {
+      int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+      if (sock < 0) {
+        perror("ERROR: udp socket");
+        return false;
+      }
+      socks_.push_back(sock);
+      udp_buffers(sock, 256 << 10);
+      sockaddr_in from;
+      memset(&from, 0, sizeof(from));
+      from.sin_family = AF_INET;
+      from.sin_port = htons(UR_ROBOT_PORT | (config_.first_robot + r));
+      from.sin_addr.s_addr = htonl(INADDR_ANY);
+      if (bind(sock, reinterpret_cast<sockaddr *>(&from), sizeof(from)) != 0 ||
+          connect(sock, reinterpret_cast<sockaddr *>(&to), sizeof(to)) != 0) {
+        perror("ERROR: cannot bind the robot port");
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Gives the ns from the first send to the end of the schedule
+  uint64_t send() {
+    struct RobotPackets {
+      uint8_t bufs[NUM_JOINTS][UR_LOAD_PACKET_SIZE];
+      iovec iovs[NUM_JOINTS];
+      mmsghdr msgs[NUM_JOINTS];
+      uint32_t seq;
+    };
+    std::vector<RobotPackets> packets(config_.robots);
+    for (uint32_t r = 0; r < config_.robots; r++) {
+      auto &p = packets[r];
+      memset(&p, 0, sizeof(p));
+      for (int j = 0; j < NUM_JOINTS; j++) {
+        ur_packet_t packet;
+        packet.robot_id = static_cast<robot_id_t>(config_.first_robot + r);
+        packet.jointId = static_cast<joint_id_t>(j);
+        packet.position = 0;
+        packet.speed = 0;
+        cur_encode(packet, p.bufs[j]);
+        p.iovs[j].iov_base = p.bufs[j];
+        p.iovs[j].iov_len = UR_LOAD_PACKET_SIZE;
+        p.msgs[j].msg_hdr.msg_iov = &p.iovs[j];
+        p.msgs[j].msg_hdr.msg_iovlen = 1;
+      }
+    }
+
+    int timer = -1;
+    if (!config_.busy_poll) {
+      timer = timerfd_create(CLOCK_MONOTONIC, 0);
+    }
+    const uint64_t period = 1000000000ULL / config_.rate;
+    const uint64_t sends = static_cast<uint64_t>(config_.time * config_.rate) * config_.robots;
+    const uint64_t start = monotonic_ns() + 1000000;
+    auto due = [&](const uint64_t &n) {
+      return start + (n / config_.robots) * period + (n % config_.robots) * period / config_.robots;
+    };
+    for (uint64_t n = 0; n < sends;) {
+      uint64_t deadline = due(n);
+      uint64_t now = monotonic_ns();
+      if (now < deadline) {
+        if (timer >= 0) {
+          itimerspec spec;
+          memset(&spec, 0, sizeof(spec));
+          spec.it_value.tv_sec = deadline / 1000000000ULL;
+          spec.it_value.tv_nsec = deadline % 1000000000ULL;
+          uint64_t expirations;
+          if (timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, nullptr) == 0 &&
+              read(timer, &expirations, sizeof(expirations)) < 0) {
+            perror("ERROR: timerfd");
+          }
+        }
+        while ((now = monotonic_ns()) < deadline) {
+        }
+      }
+      for (; n < sends && due(n) <= now; n++) {
+        uint32_t r = n % config_.robots;
+        auto &p = packets[r];
+        lateness_.add(now - due(n));
+        uint64_t tx = htobe64(monotonic_ns());
+        for (int j = 0; j < NUM_JOINTS; j++) {
+          uint32_t seq = htobe32(p.seq++);
+          memcpy(p.bufs[j] + UR_CUR_SIZE, &seq, sizeof(seq));
+          memcpy(p.bufs[j] + UR_CUR_SIZE + sizeof(seq), &tx, sizeof(tx));
+        }
+        int sent = sendmmsg(socks_[r], p.msgs, NUM_JOINTS, 0);
+        sent = std::max(sent, 0);
+        stats_[r].sent += sent;
+        stats_[r].send_errors += NUM_JOINTS - sent;
+      }
+    }
+    if (timer >= 0) {
+      close(timer);
+    }
+    return monotonic_ns() - start;
+  }
+
+  void receive() {
+    int epoll = epoll_create1(0);
+    for (uint32_t r = 0; r < socks_.size(); r++) {
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.u32 = r;
+      epoll_ctl(epoll, EPOLL_CTL_ADD, socks_[r], &event);
+    }
+    uint8_t bufs[BATCH][UR_LOAD_PACKET_SIZE + 1];
+    iovec iovs[BATCH];
+    mmsghdr msgs[BATCH];
+    epoll_event events[BATCH];
+    while (!stop_.load(std::memory_order_relaxed)) {
+      int ready = epoll_wait(epoll, events, BATCH, config_.busy_poll ? 0 : 10);
+      for (int e = 0; e < ready; e++) {
+        uint32_t r = events[e].data.u32;
+        auto &stats = stats_[r];
+        while (true) {
+          for (int i = 0; i < BATCH; i++) {
+            iovs[i].iov_base = bufs[i];
+            iovs[i].iov_len = sizeof(bufs[i]);
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+          }
+          int received = recvmmsg(socks_[r], msgs, BATCH, MSG_DONTWAIT, nullptr);
+          if (received <= 0) {
+            break;
+          }
+          uint64_t now = monotonic_ns();
+          for (int i = 0; i < received; i++) {
+            if (msgs[i].msg_len != UR_LOAD_PACKET_SIZE) {
+              stats.bad++;
+              continue;
+            }
+            uint64_t tx;
+            memcpy(&tx, bufs[i] + UR_CUR_SIZE + sizeof(uint32_t), sizeof(tx));
+            tx = be64toh(tx);
+            if (tx > now) {
+              stats.bad++;
+              continue;
+            }
+            uint64_t latency = now - tx;
+            if (stats.received > 0) {
+              double d = std::fabs(static_cast<double>(latency) - stats.last_latency);
+              stats.jitter += (d - stats.jitter) / 16;
+            }
+            stats.last_latency = latency;
+            stats.latency.add(latency);
+            stats.received++;
+          }
+        }
+      }
+    }
+    close(epoll);
+  }
+
+  void report(std::ostream &out, const uint64_t &elapsed) {
+    LoadRobotStats all;
+    double jitter_sum = 0;
+    for (auto &stats : stats_) {
+      all.sent += stats.sent;
+      all.send_errors += stats.send_errors;
+      all.received += stats.received;
+      all.bad += stats.bad;
+      all.jitter = std::max(all.jitter, stats.jitter);
+      jitter_sum += stats.jitter;
+      all.latency.merge(stats.latency);
+    }
+    double seconds = elapsed / 1e9;
+    out<<std::fixed<<std::setprecision(1);
+    out<<"# load "<<config_.host<<":"<<config_.port<<" robots "<<config_.first_robot<<"-"
+       <<config_.first_robot + config_.robots - 1<<" rate "<<config_.rate<<" Hz time "
+       <<seconds<<" s pacing "<<(config_.busy_poll ? "busy poll" : "timerfd")<<"\n";
+    // a slower rate than asked for: the generator could not keep up
+    out<<"# sent "<<all.sent<<" ("<<all.sent / seconds<<" /s of "
+       <<static_cast<double>(config_.rate) * config_.robots * NUM_JOINTS<<") send errors "
+       <<all.send_errors
+       <<" received "<<all.received<<" lost "<<all.sent - std::min(all.sent, all.received)
+       <<" bad "<<all.bad<<"\n";
+    out<<"# send lateness (us) p50 "<<lateness_.percentile(0.5) / 1e3<<" p99 "
+       <<lateness_.percentile(0.99) / 1e3<<" max "<<lateness_.max() / 1e3<<"\n";
+    out<<"# robot sent received lost latency (us) p50 p99 p999 max mean jitter\n";
+    for (uint32_t r = 0; r < stats_.size(); r++) {
+      line(out, std::to_string(config_.first_robot + r), stats_[r], stats_[r].jitter);
+    }
+    // the largest jitter of the robots, then their mean
+    line(out, "all", all, all.jitter);
+    out<<"# mean jitter (us) "<<jitter_sum / stats_.size() / 1e3<<"\n";
+    out<<std::flush;
+  }
+
+  static void line(std::ostream &out, const std::string &name, const LoadRobotStats &stats,
+                   const double &jitter) {
+    auto &latency = stats.latency;
+    out<<name<<" "<<stats.sent<<" "<<stats.received<<" "
+       <<stats.sent - std::min(stats.sent, stats.received)<<" "
+       <<latency.percentile(0.5) / 1e3<<" "<<latency.percentile(0.99) / 1e3<<" "
+       <<latency.percentile(0.999) / 1e3<<" "<<latency.max() / 1e3<<" "
+       <<latency.mean() / 1e3<<" "<<jitter / 1e3<<"\n";
+  }
+
+  LoadConfig config_;
+  std::vector<int> socks_;
+  std::vector<LoadRobotStats> stats_;
+  LatencyHistogram lateness_;
+  std::atomic<bool> stop_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
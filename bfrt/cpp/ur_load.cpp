@@ -0,0 +1,152 @@
+#include <getopt.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "udp_load.hpp"
+
+/***********************************************************************************
+ * Load generator of the robot packets of ur.p4 (udp_load.hpp), with a stand-in
+ * responder. Runs without the SDE:
+ *
+ *   ur_load --respond --port 50004 --time 0 &
+ *   ur_load --host 127.0.0.1 --port 50004 --robots 255 --rate 1000 --time 10
+ **********************************************************************************/
+
+static bfrt::examples::tna_exact_match::LoadConfig load_config;
+static bool respond_mode = false;
+
+static void parse_options(int argc, char **argv) {
+  int option_index = 0;
+  enum opts {
+    OPT_HOST = 1,
+    OPT_PORT,
+    OPT_ROBOTS,
+    OPT_FIRST_ROBOT,
+    OPT_RATE,
+    OPT_TIME,
+    OPT_DRAIN,
+    OPT_BUSY_POLL,
+    OPT_OUTPUT,
+    OPT_RESPOND,
+  };
+  static struct option options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"host", required_argument, 0, OPT_HOST},
+      {"port", required_argument, 0, OPT_PORT},
+      {"robots", required_argument, 0, OPT_ROBOTS},
+      {"first-robot", required_argument, 0, OPT_FIRST_ROBOT},
+      {"rate", required_argument, 0, OPT_RATE},
+      {"time", required_argument, 0, OPT_TIME},
+      {"drain", required_argument, 0, OPT_DRAIN},
+      {"busy-poll", no_argument, 0, OPT_BUSY_POLL},
+      {"output", required_argument, 0, OPT_OUTPUT},
+      {"respond", no_argument, 0, OPT_RESPOND},
+      {0, 0, 0, 0}};
+
+  while (1) {
+    int c = getopt_long(argc, argv, "h", options, &option_index);
+
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+      case OPT_HOST:
+        load_config.host = optarg;
+        break;
+      case OPT_PORT:
+        load_config.port = static_cast<uint16_t>(atoi(optarg));
+        break;
+      case OPT_ROBOTS:
+        load_config.robots = strtoul(optarg, NULL, 10);
+        if (load_config.robots == 0 || load_config.robots > MAX_ROBOTS) {
+          printf("ERROR : invalid number of robots: %s\n", optarg);
+          exit(1);
+        }
+        break;
+      case OPT_FIRST_ROBOT:
+        load_config.first_robot = strtoul(optarg, NULL, 10);
+        break;
+      case OPT_RATE:
+        load_config.rate = strtoul(optarg, NULL, 10);
+        if (load_config.rate == 0 || load_config.rate > 1000000) {
+          printf("ERROR : invalid rate: %s\n", optarg);
+          exit(1);
+        }
+        break;
+      case OPT_TIME:
+        load_config.time = strtod(optarg, NULL);
+        break;
+      case OPT_DRAIN:
+        load_config.drain_ms = strtoul(optarg, NULL, 10);
+        break;
+      case OPT_BUSY_POLL:
+        load_config.busy_poll = true;
+        break;
+      case OPT_OUTPUT:
+        load_config.output = optarg;
+        break;
+      case OPT_RESPOND:
+        respond_mode = true;
+        break;
+      case 'h':
+      case '?':
+        printf(
+            "Usage : ur_load [--host <ip of the switch, default 127.0.0.1>] "
+            "[--port <udp port, default %d>]\n"
+            "        [--robots <n, default %d>] [--first-robot <id, default 0>] "
+            "[--rate <packets per joint per s, default 1000>]\n"
+            "        [--time <s, default 10>] [--drain <ms of waiting for the last "
+            "replies, default 100>] [--busy-poll]\n"
+            "        [--output <report file>]\n"
+            "        ur_load --respond [--port <udp port>] [--time <s, 0: until "
+            "killed>]\n",
+            UR_LOAD_DEFAULT_PORT, MAX_ROBOTS);
+        exit(c == 'h' ? 0 : 1);
+        break;
+      default:
+        printf("Invalid option\n");
+        exit(1);
+        break;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  parse_options(argc, argv);
+
+  if (respond_mode) {
+    // echoes the speed, the cost of the path without the pipeline
+    bfrt::examples::tna_exact_match::UdpResponder responder(
+        load_config.port,
+        [](const bfrt::examples::tna_exact_match::ur_packet_t &packet, const uint64_t &) {
+          return packet.speed;
+        });
+    if (!responder.ok()) {
+      return 1;
+    }
+    std::cout<<"READY! udp port "<<load_config.port<<std::endl;
+    if (load_config.time > 0) {
+      std::this_thread::sleep_for(std::chrono::duration<double>(load_config.time));
+    } else {
+      while (true) {
+        std::this_thread::sleep_for(std::chrono::hours(1));
+      }
+    }
+    return 0;
+  }
+
+  bfrt::examples::tna_exact_match::LoadGenerator generator(load_config);
+  if (load_config.output.empty()) {
+    return generator.run(std::cout) ? 0 : 1;
+  }
+  std::ofstream out(load_config.output);
+  if (!out) {
+    std::cout<<"ERROR: cannot open "<<load_config.output<<std::endl;
+    return 1;
+  }
+  return generator.run(out) ? 0 : 1;
+}
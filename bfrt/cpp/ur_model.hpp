@@ -0,0 +1,217 @@
+#ifndef UR_MODEL_HPP
+#define UR_MODEL_HPP
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mem_backend.hpp"
+#include "pipe_map.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+/*******************************************************************************
+ * Software model of the robot control loop of ur.p4, on the hw state of a
+ * MemDevice: whatever cp installed through a MemBackend is what the model
+ * sees, after the batch is pushed.
+ *
+ * A cur_t packet of a robot goes through
+ *   - the ingress: r_next_bunny, end_time and r_actual_bunny, the time check
+ *     of resubmit_setter and railway_switch. When the end time of the bunny
+ *     has passed, the resubmitted pass looks up bunny for the next bunny and
+ *     updates the three registers (and sends the progress digest).
+ *   - the egress: bunny_e, robot_class, the three weighting functions of
+ *     the active function_version and speed_limit, which give the speed of
+ *     the reply.
+ * Like on the switch, the metadata starts at 0: a bunny miss moves the robot
+ * to the bunny with a next id and a duration of 0, a bunny_e miss targets
+ * position and speed 0.
+ *
+ * Times are 2^16 ns units (global_tstamp[47:16]) of the now_ns given with
+ * the packet, so the model runs on any clock, faster than real time too.
+ * The weighting functions are looked up in a copy of the active version
+ * hashed by mask, rebuilt when the functions are written.
+ ******************************************************************************/
+
+// What the switch sends back for a cur_t packet
+struct ur_reply_t {
+  dec_t speed;              // hdr.cur.speed, the commanded speed
+  bunny_id_t actual_bunny;  // hdr.bridge, the key of bunny_e
+  bool resubmitted;         // the robot moved to the next bunny
+  bool bunny_hit;           // the resubmitted pass found the bunny entry
+  bool target_hit;          // bunny_e had an entry
+};
+
+class UrModel {
+ public:
+  UrModel(MemDevice *device, const PipeMap &pipes)
+      : device_(device), pipes_(pipes), indexes_(device->hw.size()) {}
+
+  // One cur_t packet. Robots beyond the registers are not served, their
+  // packets come back unchanged.
+  ur_reply_t cur(const ur_packet_t &packet, const uint64_t &now_ns) {
+    ur_reply_t reply;
+    reply.speed = packet.speed;
+    reply.actual_bunny = 0;
+    reply.resubmitted = false;
+    reply.bunny_hit = false;
+    reply.target_hit = false;
+    const robot_id_t robot_id = packet.robot_id;
+    if (robot_id >= MAX_ROBOTS) {
+      return reply;
+    }
+
+    std::lock_guard<std::mutex> guard(device_->lock);
+    uint32_t pipe = pipes_.registerPipe(robot_id);
+    pipe = pipe < device_->hw.size() ? pipe : 0;
+    auto &ingress = device_->hw[pipe];
+    p4_time_t actual_time = static_cast<p4_time_t>(now_ns >> 16);
+
+    // a new packet
+    bunny_id_t next_bunny = ingress.r_next_bunny[robot_id];
+    p4_time_t end_time = ingress.end_time[robot_id];
+    end_time = end_time + 0x00ffffff;
+    end_time = end_time - actual_time;
+    bool resubmit = (end_time & 0xff000000) == 0;
+    bunny_id_t actual_bunny = ingress.r_actual_bunny[robot_id];
+    auto to_id = ingress.railway_switch.find(railway_key_pack(robot_id, actual_bunny));
+    if (to_id != nullptr) {
+      next_bunny = *to_id;
+    }
+
+    if (resubmit) {
+      // the resubmitted packet, only hdr.resubmit (next_bunny) is kept
+      actual_bunny = next_bunny;
+      bunny_key_t key;
+      key.robot_id = robot_id;
+      key.actual_bunny = actual_bunny;
+      key.jointId = 0;
+      auto data = ingress.bunny.find(bunny_point_pack(key));
+      reply.bunny_hit = data != nullptr;
+      ingress.r_next_bunny[robot_id] = data != nullptr ? data->next_id : 0;
+      ingress.r_actual_bunny[robot_id] = actual_bunny;
+      ingress.end_time[robot_id] += data != nullptr ? data->duration : 0;
+      reply.resubmitted = true;
+      device_->notifyProgress(robot_id, pipe);
+    }
+    reply.actual_bunny = actual_bunny;
+
+    auto &egress_pipes = pipes_.egressPipes(robot_id);
+    pipe = egress_pipes[0] == ALL_PIPES ? 0 : egress_pipes[0];
+    pipe = pipe < device_->hw.size() ? pipe : 0;
+    auto &egress = device_->hw[pipe];
+    auto &functions = functionIndex(pipe);
+    bunny_key_t key;
+    key.robot_id = robot_id;
+    key.actual_bunny = actual_bunny;
+    key.jointId = packet.jointId;
+    auto target = egress.bunny_e.find(bunny_key_pack(key));
+    reply.target_hit = target != nullptr;
+    dec_t target_position = target != nullptr ? target->tpos : 0;
+    dec_t target_speed = target != nullptr ? target->tspeed : 0;
+    dec_t speed = packet.speed;
+
+    // calculate_diff and the functions
+    target_position = target_position - packet.position;
+    dec_t d;
+    if (functionMatch(functions, FUNCTION_TARGET, target_speed, &d)) {
+      target_speed = d;
+    }
+    if (functionMatch(functions, FUNCTION_ACTUAL, speed, &d)) {
+      speed = d;
+    }
+    if (functionMatch(functions, FUNCTION_DIFF, target_position, &d)) {
+      target_position = target_position + d;
+    }
+    speed = speed + target_speed;
+    speed = speed + target_position;
+    reply.speed = egress.limitSpeed(robot_id, packet.jointId, speed);
+    return reply;
+  }
+
+  // One control_t packet: the end time of the robot in ig_md.robot_id, which
+  // control packets leave at 0, is pushed by end. Gives the actual and the
+  // new end time of the reply.
+  void control(const p4_time_t &end, const uint64_t &now_ns, p4_time_t *actual,
+               p4_time_t *end_time) {
+    std::lock_guard<std::mutex> guard(device_->lock);
+    uint32_t pipe = pipes_.registerPipe(0);
+    auto &ingress = device_->hw[pipe < device_->hw.size() ? pipe : 0];
+    *actual = static_cast<p4_time_t>(now_ns >> 16);
+    ingress.end_time[0] += end;
+    *end_time = ingress.end_time[0];
+  }
+
+ private:
+  // The entries of the active version of the functions of a pipe: the masks
+  // and, by mask, value -> d
+  struct FunctionIndex {
+    uint64_t generation = ~0ULL;
+    uint8_t version = 0;
+    std::vector<std::pair<dec_t, std::unordered_map<dec_t, dec_t>>> masks[NUM_FUNCTIONS];
+  };
+
+  // Called with the device lock held
+  const FunctionIndex &functionIndex(const uint32_t &pipe) {
+    auto &index = indexes_[pipe];
+    auto &tables = device_->hw[pipe];
+    if (index.generation == tables.function_generation) {
+      return index;
+    }
+    index.generation = tables.function_generation;
+    index.version = tables.function_version;
+    for (int f = 0; f < NUM_FUNCTIONS; f++) {
+      auto &masks = index.masks[f];
+      masks.clear();
+      for (auto &entry : tables.functions[f]) {
+        if (entry.first.version != index.version) {
+          continue;
+        }
+        auto group = std::find_if(masks.begin(), masks.end(),
+                                  [&](const std::pair<dec_t, std::unordered_map<dec_t, dec_t>> &m) {
+                                    return m.first == entry.first.mask;
+                                  });
+        if (group == masks.end()) {
+          masks.emplace_back(entry.first.mask, std::unordered_map<dec_t, dec_t>());
+          group = masks.end() - 1;
+        }
+        group->second[entry.first.value] = entry.second;
+      }
+    }
+    return index;
+  }
+
+  // Same result as MemTables::weigh: of the matching entries, the one with
+  // the smallest key
+  static bool functionMatch(const FunctionIndex &index, const uint32_t &function,
+                            const dec_t &x, dec_t *d) {
+    bool found = false;
+    function_key_t best;
+    for (auto &group : index.masks[function]) {
+      auto entry = group.second.find(x & group.first);
+      if (entry == group.second.end()) {
+        continue;
+      }
+      function_key_t key = {index.version, entry->first, group.first};
+      if (!found || key < best) {
+        best = key;
+        *d = entry->second;
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  MemDevice *device_;
+  const PipeMap &pipes_;
+  std::vector<FunctionIndex> indexes_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
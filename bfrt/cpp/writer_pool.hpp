@@ -0,0 +1,245 @@
+#ifndef WRITER_POOL_HPP
+#define WRITER_POOL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "pipe_map.hpp"
+#include "table_backend.hpp"
+
+namespace bfrt {
+namespace examples {
+namespace tna_exact_match {
+
+// Bounded lock-free queue (D. Vyukov's MPMC array queue). Every slot has a
+// sequence number telling whether it is free for the producer of a round or
+// filled for the consumer of the round. size must be a power of two.
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t size)
+      : mask_(size - 1), slots_(size), head_(0), tail_(0) {
+    for (size_t i = 0; i < size; i++) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(const T &value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      auto &slot = slots_[pos & mask_];
+      size_t seq = slot.seq.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          slot.value = value;
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool pop(T *value) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      auto &slot = slots_[pos & mask_];
+      size_t seq = slot.seq.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          *value = slot.value;
+          slot.seq.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;  // empty
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  size_t mask_;
+  std::vector<Slot> slots_;
+  // consumer and producer positions on separate cache lines
+  char pad0_[64];
+  std::atomic<size_t> head_;
+  char pad1_[64];
+  std::atomic<size_t> tail_;
+};
+
+// Pool of table writer threads. Every worker has its own TableBackend (for
+// BfRt: its own session and key/data objects) and its own queue. Commands
+// are sharded by robot, so the commands of a robot are executed in order and
+// a long upload of one robot does not delay the commands of robots on other
+// workers. With an asymmetric pipe map the robots of a pipe are kept on the
+// same workers, so each session writes a single pipe.
+//
+// A worker opens a batch for the commands it finds in its queue and commits
+// it when the queue runs empty or max_batch commands were executed.
+//
+// Cmd is a plain copyable command, execute runs it on a backend.
+template <typename Cmd>
+class WriterPool {
+ public:
+  typedef bf_status_t (*Execute)(TableBackend *backend, const Cmd &cmd);
+
+  WriterPool(std::vector<std::unique_ptr<TableBackend>> backends,
+             const PipeMap &pipes, Execute execute,
+             size_t queue_size = 4096, uint32_t max_batch = 512)
+      : pipes_(pipes), execute_(execute), max_batch_(max_batch), stop_(false) {
+    for (auto &backend : backends) {
+      workers_.emplace_back(new Worker(std::move(backend), queue_size));
+    }
+    for (auto &worker : workers_) {
+      worker->thread = std::thread(&WriterPool::run, this, worker.get());
+    }
+  }
+
+  ~WriterPool() {
+    flush();
+    stop_.store(true);
+    for (auto &worker : workers_) {
+      worker->thread.join();
+    }
+  }
+
+  size_t size() const { return workers_.size(); }
+
+  // The worker of a robot
+  size_t shard(const robot_id_t &robot_id) const {
+    size_t workers = workers_.size();
+    auto &ingress = pipes_.ingressPipes(robot_id);
+    if (!pipes_.asymmetric() || ingress.size() != 1 || workers < pipes_.numPipes()) {
+      return robot_id % workers;
+    }
+    size_t per_pipe = workers / pipes_.numPipes();
+    return ingress[0] + pipes_.numPipes() * (robot_id % per_pipe);
+  }
+
+  // Queue a command of the robot. Waits while the queue of its worker is full.
+  void submit(const robot_id_t &robot_id, const Cmd &cmd) {
+    auto &worker = *workers_[shard(robot_id)];
+    worker.submitted.fetch_add(1, std::memory_order_relaxed);
+    while (!worker.queue.push(cmd)) {
+      std::this_thread::yield();
+    }
+  }
+
+  // Wait until the submitted commands of the robot are committed.
+  void flush(const robot_id_t &robot_id) { wait(*workers_[shard(robot_id)]); }
+
+  // Wait until every submitted command is committed.
+  void flush() {
+    for (auto &worker : workers_) {
+      wait(*worker);
+    }
+  }
+
+  // Number of commands that failed so far
+  uint64_t errors() const {
+    uint64_t errors = 0;
+    for (auto &worker : workers_) {
+      errors += worker->errors.load(std::memory_order_relaxed);
+    }
+    return errors;
+  }
+
+  // Number of commands that failed so far on the worker of the robot
+  uint64_t errors(const robot_id_t &robot_id) const {
+    return workers_[shard(robot_id)]->errors.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Worker {
+    Worker(std::unique_ptr<TableBackend> backend, size_t queue_size)
+        : backend(std::move(backend)), queue(queue_size),
+          submitted(0), committed(0), errors(0) {}
+
+    std::unique_ptr<TableBackend> backend;
+    BoundedQueue<Cmd> queue;
+    std::atomic<uint64_t> submitted;
+    std::atomic<uint64_t> committed;
+    std::atomic<uint64_t> errors;
+    std::thread thread;
+  };
+
+  void wait(const Worker &worker) {
+    uint64_t submitted = worker.submitted.load(std::memory_order_relaxed);
+    while (worker.committed.load(std::memory_order_acquire) < submitted) {
+      std::this_thread::yield();
+    }
+  }
+
+  void run(Worker *worker) {
+    Cmd cmd;
+    uint32_t idle = 0;
+    while (true) {
+      if (!worker->queue.pop(&cmd)) {
+        if (stop_.load()) {
+          return;
+        }
+        // spin a little, then back off to not burn a core while idle
+        if (++idle > 1000) {
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        } else {
+          std::this_thread::yield();
+        }
+        continue;
+      }
+      idle = 0;
+
+      auto status = worker->backend->beginBatch();
+      if (status != BF_SUCCESS) {
+        // the command is dropped, the next one tries a new batch
+        worker->errors.fetch_add(1, std::memory_order_relaxed);
+        worker->committed.fetch_add(1, std::memory_order_release);
+        continue;
+      }
+      uint32_t count = 0;
+      uint32_t failed = 0;
+      do {
+        if (execute_(worker->backend.get(), cmd) != BF_SUCCESS) {
+          failed++;
+        }
+        count++;
+      } while (count < max_batch_ && worker->queue.pop(&cmd));
+      status = worker->backend->endBatch(true);
+      if (status == BF_SUCCESS) {
+        status = worker->backend->completeOperations();
+      }
+      if (status != BF_SUCCESS) {
+        // the other commands of a failed batch did not take effect either
+        failed = count;
+      }
+      worker->errors.fetch_add(failed, std::memory_order_relaxed);
+      worker->committed.fetch_add(count, std::memory_order_release);
+    }
+  }
+
+  const PipeMap &pipes_;
+  Execute execute_;
+  uint32_t max_batch_;
+  std::atomic<bool> stop_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+}  // tna_exact_match
+}  // examples
+}  // bfrt
+
+#endif
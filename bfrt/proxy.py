@@ -193,7 +193,42 @@ def free_unused_bunny_data(s):
         g_size = g_end
 
 
+def upload_traj_to_cp_ring(data,s,reset):
+    """Upload the csv traj. to the ring of g_robot_id in cp (commands 16, 17 and 25).
+
+    Note: cp reclaims the passed points and moves the stop entry itself. A
+    reset replaces the points after the actual one while the robot keeps
+    moving (command 25); only if that fails is the ring reset and the robot
+    restarted from the new traj.
+    """
+
+    if reset:
+        s.sendall(pack_int(25))
+        s.sendall(pack_int(g_robot_id))
+        s.sendall(pack_int(-1))
+        s.sendall(bunny_id_packer.pack(len(data)))
+        s.sendall(data)
+        switched = struct.Struct("i").unpack(s.recv(4,socket.MSG_WAITALL))[0]
+        print("switched:",switched)
+        if switched>=0:
+            return True
+
+        s.sendall(pack_int(16))
+        s.sendall(pack_int(g_robot_id))
+        s.sendall(bunny_id_packer.pack(0))
+    s.sendall(pack_int(17))
+    s.sendall(pack_int(g_robot_id))
+    s.sendall(bunny_id_packer.pack(len(data)))
+    s.sendall(data)
+    appended = struct.Struct("i").unpack(s.recv(4,socket.MSG_WAITALL))[0]
+    print("appended:",appended)
+    return appended>=0
+
+
 bunny_id_packer = struct.Struct("I")
+# ids wrap around after the points that fit in the bunny table
+# (BUNNY_POINT_TABLE_SIZE of params.p4), the window can never outgrow it
+g_mod = 50000
 # these variables maintain a ring data structure
 g_start = 0 # firstuploaded bunny id
 g_end = 0  # last uploaded bunny id
@@ -202,6 +237,10 @@ g_stop = -1 # position if the stop redirection (the last tray point is always lo
 
 g_in_restart = False # not used currently
 
+# with --cp [robot id] the ring is kept by cp instead of the variables above
+g_cp_ring = "--cp" in sys.argv
+g_robot_id = int(sys.argv[sys.argv.index("--cp")+1]) if g_cp_ring and len(sys.argv)>sys.argv.index("--cp")+1 else 0
+
 def handle_client(client_sock):
     """ Handle a client request. """
 
@@ -229,6 +268,15 @@ def handle_client(client_sock):
     # read data
     data = client_sock.recv(data_len,socket.MSG_WAITALL)
 
+    if g_cp_ring:
+        s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        s.connect(("localhost", 5555))
+        ok = upload_traj_to_cp_ring(data,s,command_type==0)
+        s.sendall(struct.Struct("i").pack(-1))
+        s.close()
+        client_sock.sendall(pj_int_packer.pack(1 if ok else 0))
+        return
+
     # get traj from data
     data = data.decode()
     lines = [ l.strip() for l in data.split("\n")]
@@ -241,10 +289,10 @@ def handle_client(client_sock):
     s.connect(("localhost", 5555))
 
     if command_type==0: # reset mode
-        upload_traj_in_reset_mode(client_sock,traj,s,1000)
+        upload_traj_in_reset_mode(client_sock,traj,s,g_mod)
     else: # append mode
         free_unused_bunny_data(s)
-        upload_traj_in_append_mode(traj,s,1000)
+        upload_traj_in_append_mode(traj,s,g_mod)
 
     s.sendall(struct.Struct("i").pack(-1))
     s.close()
@@ -5,6 +5,8 @@ import struct
 import time
 
 INT_MAX = 2147483647
+NUM_ROBOT_CLASSES = 4
+JOINT_SPEED_LIMITS = [3.5,3.5,3.5,3.5,3.5,3.5]
 
 p4 = bfrt.ur.pipe
 
@@ -86,6 +88,12 @@ def clear_bunny_data(verbose=True, batching=True):
     def table_clear(table, verbose=False, batching=False):
         """ Delete the content of the given table. """
 
+        # the table clear of the driver, entry by entry only if it fails
+        try:
+            table.clear()
+            return
+        except Exception as e:
+            print(e)
         try:
             entries = table.get(regex=True, print_ents=False)
             for r in entries:
@@ -127,13 +135,12 @@ def add_new_bunny(robot_id,bunny_id,next_id,duration,positions,speeds):
         return  int(INT_MAX/(16*4*math.pi) * db)
 
     def add_ingress_part():
-        for i in range(6):
-            p4.SwitchIngress.bunny.add_with_set_target(
-                robot_id=robot_id,
-                actual_bunny=bunny_id,
-                jointid=i,
-                next_id=next_id,
-                duration=msec_to_int(duration))
+        # one entry, shared by the 6 joints of the point
+        p4.SwitchIngress.bunny.add_with_set_target(
+            robot_id=robot_id,
+            actual_bunny=bunny_id,
+            next_id=next_id,
+            duration=msec_to_int(duration))
 
     def add_egress_part():
         for i in range(6):
@@ -169,6 +176,8 @@ def clear_function_data():
     table_clear(p4.SwitchEgress.diff_speed_function)
     table_clear(p4.SwitchEgress.actual_speed_function)
     table_clear(p4.SwitchEgress.target_speed_function)
+    # the entries of setup.py are version 0, cp may have flipped it
+    p4.SwitchEgress.function_version.set_default_with_set_function_version(version=0)
     
 def add_function_entry(table_char,speed,mask,value):
     """Add a function entry to a function table. 
@@ -189,6 +198,7 @@ def add_function_entry(table_char,speed,mask,value):
 
     def add_diff_speed_entry(speed,mask,value):
          p4.SwitchEgress.diff_speed_function.add_with_update_diff_speed(
+            function_version=0,
             target_position=speed,
             target_position_mask=mask, 
             match_priority=None, 
@@ -197,6 +207,7 @@ def add_function_entry(table_char,speed,mask,value):
     
     def add_target_speed_entry(speed,mask,value):
          p4.SwitchEgress.target_speed_function.add_with_update_target_speed(
+            function_version=0,
             target_speed=speed,
             target_speed_mask=mask, 
             match_priority=None, 
@@ -205,6 +216,7 @@ def add_function_entry(table_char,speed,mask,value):
     
     def add_actual_speed_entry(speed,mask,value):
          p4.SwitchEgress.actual_speed_function.add_with_update_actual_speed(
+            function_version=0,
             speed=speed,
             speed_mask=mask, 
             match_priority=None, 
@@ -218,6 +230,75 @@ def add_function_entry(table_char,speed,mask,value):
     if table_char=="D":
         add_diff_speed_entry(speed,mask,value)
 
+# (robot_class, joint, value, mask) of the installed speed_limit entries
+speed_limit_keys = {}
+
+def get_speed_limit_cover(d):
+    """Get the (value, mask) entries matching the speeds beyond the limit d.
+
+    Same prefix cover as get_lpm in gen_speed_limit_entries.py and
+    speed_limit_cover in cpp/speed_limit.hpp."""
+
+    bits = int(INT_MAX/(16*4*math.pi) * d) & (2**64-1)
+    negative = d<0
+    prefix = 2**63 if negative else 0
+    cover = []
+    for i in range(62,-1,-1):
+        bit = (bits>>i)&1
+        if bit==(1 if negative else 0):
+            cover.append((prefix | (0 if negative else 1<<i), ((2**64-1)<<i) & (2**64-1)))
+        prefix |= bit<<i
+    return cover
+
+def set_speed_limits(robot_class,limits):
+    """Replace the joint speed limits of a robot class.
+
+    Args:
+        robot_class (int): robot class, robots without a class are of class 0
+        limits (list of float): limit of each joint in rad/s, 0: no limit
+
+    Unlike cp, the entries are not replaced in one transaction here.
+    """
+
+    global p4
+    global speed_limit_keys
+
+    table = p4.SwitchEgress.speed_limit
+    for key in speed_limit_keys.pop(robot_class,[]):
+        try:
+            table.delete(robot_class=key[0], jointid=key[1], speed=key[2],
+                speed_mask=key[3], match_priority=0)
+        except Exception as e:
+            print(e)
+
+    keys = []
+    for j in range(6):
+        if limits[j]<=0:
+            continue
+        for d in [limits[j],-limits[j]]:
+            limit = int(INT_MAX/(16*4*math.pi) * d) & (2**64-1)
+            for value, mask in get_speed_limit_cover(d):
+                try:
+                    table.add_with_override_speed(robot_class=robot_class, jointid=j,
+                        speed=value, speed_mask=mask, match_priority=0, limit=limit)
+                    keys.append((robot_class,j,value,mask))
+                except Exception as e:
+                    print("ERROR DURING SPEED LIMIT ADD")
+                    print(e)
+    speed_limit_keys[robot_class] = keys
+
+def set_robot_class(robot_id,robot_class):
+    """Set the robot class whose speed limits apply to the robot."""
+
+    global p4
+
+    try:
+        p4.SwitchEgress.robot_class.add_with_set_robot_class(
+            robot_id=robot_id, robot_class=robot_class)
+    except Exception:
+        p4.SwitchEgress.robot_class.mod_with_set_robot_class(
+            robot_id=robot_id, robot_class=robot_class)
+
 def remove_range(robot_id,first,last):
     """Delete the trajectory points within the given range.
 
@@ -226,14 +307,15 @@ def remove_range(robot_id,first,last):
         last (int): id of the last bunny to remove
     """
 
+    # delete by key, without reading the entries first
     for i in range(first,last+1):
+        try:
+            p4.SwitchIngress.bunny.delete(robot_id=robot_id,actual_bunny=i)
+        except:
+            pass
         for j in range(6):
             try:
-                p4.SwitchIngress.bunny.get(robot_id=robot_id,actual_bunny=i, jointid=j,print_ents=False).remove()
-            except:
-                pass
-            try:
-                p4.SwitchEgress.bunny_e.get(robot_id=robot_id,actual_bunny_id=i, jointid=j, print_ents=False).remove()
+                p4.SwitchEgress.bunny_e.delete(robot_id=robot_id,actual_bunny_id=i, jointid=j)
             except:
                 pass
 
@@ -334,6 +416,9 @@ def run_tests():
 
 #run_tests()
 
+for robot_class in range(NUM_ROBOT_CLASSES):
+    set_speed_limits(robot_class,JOINT_SPEED_LIMITS)
+
 print("READY!")
 
 s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
@@ -395,6 +480,18 @@ while True:
             bunny_id = bunny_id_packer.unpack(recv_all(client_socket,4))[0]
             set_actual_bunny_id(rid,bunny_id)
             print("New actual bunny id: "+str(bunny_id))
+        elif cmd==22:
+            print("INFO: set speed limits")
+            robot_class = unpack_int( recv_all(client_socket,4) )
+            limits = struct.Struct("6d").unpack(recv_all(client_socket,48))
+            set_speed_limits(robot_class,limits)
+            entries = len(speed_limit_keys.get(robot_class,[]))
+            client_socket.sendall(struct.Struct("i").pack(entries))
+        elif cmd==23:
+            print("INFO: set robot class")
+            rid = unpack_int( recv_all(client_socket,4) )
+            robot_class = unpack_int( recv_all(client_socket,4) )
+            set_robot_class(rid,robot_class)
         else:
             print("WARN: invalid command: "+str(cmd))
         cmd = unpack_int( recv_all(client_socket,4) )
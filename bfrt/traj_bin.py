@@ -0,0 +1,83 @@
+#/bin/python3
+"""Binary trajectory format (.utrj) of the C++ control plane (cpp/traj_file.hpp).
+
+Usage: python3 traj_bin.py <input csv> <output utrj> [--loop]
+
+The csv has the layout of trajs.csv (time, timesecs, timens, 6 pos, 6 vel,
+6 acc). The ids, durations and conversions are the same as in client.py and
+setup.py, but they are done once, when the file is written. With --loop the
+last point continues with the first one (client.py), otherwise with the next
+id (proxy.py).
+"""
+
+import math
+import struct
+import sys
+
+INT_MAX = 2147483647
+
+MAGIC = b"UTRJ"
+VERSION = 1
+header_packer = struct.Struct("<4sHHII16x")
+record_packer = struct.Struct("<IIII6Q6Q")
+
+def msec_to_int(m):
+    """Convert the duration to the proper int representation."""
+
+    return int(m)*1000000//65536
+
+def double_to_dec(db):
+    """Convert the speed and position values to the proper int representation."""
+
+    return int(INT_MAX/(16*4*math.pi) * db) & 0xFFFFFFFFFFFFFFFF
+
+def get_traj_from_csv(fname, loop=False):
+    """Load a traj from a csv file as (id, next_id, duration in ms, positions, speeds) tuples."""
+
+    lines = [ l.strip() for l in open(fname)]
+    data = [ [ float(x.strip()) for x in l.split(',')] for l in lines[1:] if len(l)>0 ]
+
+    def get_duration(i):
+        if i+1<len(data):
+            return 1000*(data[i+1][0]-data[i][0])
+        else:
+            return 2000
+
+    def get_next(i):
+        if i+1<len(data) or not loop:
+            return i+1
+        else:
+            return 0
+
+    return [ (i, get_next(i), get_duration(i),data[i][3:9],data[i][9:15]) for i in range(len(data)) ]
+
+def pack_records(traj):
+    """Pack traj points to binary records."""
+
+    return b"".join(record_packer.pack(r[0], r[1], msec_to_int(r[2]), 0,
+        *([double_to_dec(x) for x in r[3]] + [double_to_dec(x) for x in r[4]]))
+        for r in traj)
+
+def write_traj_bin(fname, traj):
+    """Write traj points to a binary trajectory file."""
+
+    with open(fname, "wb") as f:
+        f.write(header_packer.pack(MAGIC, VERSION, record_packer.size, len(traj), 0))
+        f.write(pack_records(traj))
+
+def read_traj_bin(fname):
+    """Read the records of a binary trajectory file (the payload of command 13)."""
+
+    data = open(fname, "rb").read()
+    magic, version, record_size, count, _ = header_packer.unpack_from(data)
+    if magic!=MAGIC or version!=VERSION or record_size!=record_packer.size:
+        raise Exception("invalid trajectory file: "+fname)
+    return count, data[header_packer.size:header_packer.size+count*record_size]
+
+if __name__ == "__main__":
+    if len(sys.argv)<3:
+        print("Usage: python3",sys.argv[0],"<input csv> <output utrj> [--loop]")
+        exit(-1)
+    traj = get_traj_from_csv(sys.argv[1], "--loop" in sys.argv[3:])
+    write_traj_bin(sys.argv[2], traj)
+    print(len(traj),"points written to",sys.argv[2])
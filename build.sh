@@ -1,4 +1,3 @@
-python3 gen_speed_limit_entries.py > a_speed_limit_entries.p4
 #python3 gen_diff_speed_function_entries.py > a_diff_speed_function_entries.p4
 
 
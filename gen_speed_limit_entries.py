@@ -1,3 +1,6 @@
+# Prints the speed_limit entries of JOINT_SPEED_LIMITS in the P4 const entry
+# syntax. ur.p4 no longer compiles them in: cp (bfrt/cpp/speed_limit.hpp) and
+# setup.py install the same entries at runtime, this is their reference.
 import math
 import numpy as np
 